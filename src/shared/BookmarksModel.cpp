@@ -46,7 +46,7 @@ int BookmarksModel::columnCount(const QModelIndex &parent) const {
 QVariant BookmarksModel::data(const QModelIndex &index, int role) const {
     if (role == Qt::DisplayRole ||
         ((role == Qt::EditRole || role == Qt::ToolTipRole) && index.column() == DescriptionColumn)) {
-        const Bookmark &bookmark = std::next(cbegin(), index.row())->second;
+        const Bookmark &bookmark = atRow(index.row())->second;
 
         if (index.column() == FrameColumn)
             return bookmark.frame;
@@ -88,7 +88,7 @@ Qt::ItemFlags BookmarksModel::flags(const QModelIndex &index) const {
 
 bool BookmarksModel::setData(const QModelIndex &index, const QVariant &value, int role) {
     if (role == Qt::EditRole && index.column() == DescriptionColumn) {
-        iterator it = std::next(begin(), index.row());
+        iterator it = atRow(index.row());
 
         it->second.description = value.toString().toStdString();
 
@@ -107,13 +107,11 @@ void BookmarksModel::insert(const value_type &bookmark) {
     if (it != cend() && it->first == bookmark.first)
         return;
 
-    int new_row = 0;
-    if (size())
-        new_row = (int)std::distance(cbegin(), it);
+    int new_row = rowOf(it);
 
     beginInsertRows(QModelIndex(), new_row, new_row);
 
-    BookmarkMap::insert(it, bookmark);
+    IndexedFrameMap<Bookmark>::insert(it, bookmark);
 
     endInsertRows();
 }
@@ -125,11 +123,11 @@ void BookmarksModel::erase(int frame) {
     if (it == cend())
         return;
 
-    int row = (int)std::distance(cbegin(), it);
+    int row = rowOf(it);
 
     beginRemoveRows(QModelIndex(), row, row);
 
-    BookmarkMap::erase(it);
+    IndexedFrameMap<Bookmark>::erase(it);
 
     endRemoveRows();
 }
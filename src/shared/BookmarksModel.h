@@ -23,10 +23,11 @@ SOFTWARE.
 
 #include <QAbstractTableModel>
 
+#include "IndexedFrameMap.h"
 #include "WobblyTypes.h"
 
 
-class BookmarksModel : public QAbstractTableModel, private BookmarkMap {
+class BookmarksModel : public QAbstractTableModel, private IndexedFrameMap<Bookmark> {
     Q_OBJECT
 
 public:
@@ -50,14 +51,15 @@ public:
 
     bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
 
-    using BookmarkMap::at;
-    using BookmarkMap::cbegin;
-    using BookmarkMap::cend;
-    using BookmarkMap::lower_bound;
-    using BookmarkMap::upper_bound;
-    using BookmarkMap::count;
-    using BookmarkMap::size;
-    using BookmarkMap::const_iterator;
+    using IndexedFrameMap<Bookmark>::at;
+    using IndexedFrameMap<Bookmark>::atRow;
+    using IndexedFrameMap<Bookmark>::cbegin;
+    using IndexedFrameMap<Bookmark>::cend;
+    using IndexedFrameMap<Bookmark>::lower_bound;
+    using IndexedFrameMap<Bookmark>::upper_bound;
+    using IndexedFrameMap<Bookmark>::count;
+    using IndexedFrameMap<Bookmark>::size;
+    using IndexedFrameMap<Bookmark>::const_iterator;
 
     void insert(const value_type &bookmark);
 
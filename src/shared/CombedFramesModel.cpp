@@ -18,6 +18,8 @@ SOFTWARE.
 */
 
 
+#include <algorithm>
+
 #include "CombedFramesModel.h"
 
 CombedFramesModel::CombedFramesModel(QObject *parent)
@@ -37,7 +39,7 @@ int CombedFramesModel::rowCount(const QModelIndex &parent) const {
 
 QVariant CombedFramesModel::data(const QModelIndex &index, int role) const {
     if (role == Qt::DisplayRole) {
-        return QVariant(*std::next(cbegin(), index.row()));
+        return QVariant(at(index.row()));
     }
 
     return QVariant();
@@ -59,35 +61,66 @@ QVariant CombedFramesModel::headerData(int section, Qt::Orientation orientation,
 }
 
 
+size_t CombedFramesModel::count(int frame) const {
+    return std::binary_search(cbegin(), cend(), frame);
+}
+
+
+CombedFramesModel::const_iterator CombedFramesModel::lower_bound(int frame) const {
+    return std::lower_bound(cbegin(), cend(), frame);
+}
+
+
+CombedFramesModel::const_iterator CombedFramesModel::upper_bound(int frame) const {
+    return std::upper_bound(cbegin(), cend(), frame);
+}
+
+
 void CombedFramesModel::insert(int frame) {
-    std::set<int>::const_iterator it = lower_bound(frame);
+    const_iterator it = lower_bound(frame);
 
     if (it != cend() && *it == frame)
         return;
 
-    int new_row = 0;
-    if (size())
-        new_row = (int)std::distance(cbegin(), it);
+    int new_row = (int)(it - cbegin());
 
     beginInsertRows(QModelIndex(), new_row, new_row);
 
-    std::set<int>::insert(it, frame);
+    std::vector<int>::insert(begin() + new_row, frame);
 
     endInsertRows();
 }
 
 
+// One model reset instead of one row insertion per frame.
+// The new frames are sorted on their own and merged in, rather than inserted one by one.
+void CombedFramesModel::insert(const std::vector<int> &frames) {
+    beginResetModel();
+
+    size_t old_size = size();
+
+    std::vector<int>::insert(end(), frames.cbegin(), frames.cend());
+
+    std::sort(begin() + old_size, end());
+    std::inplace_merge(begin(), begin() + old_size, end());
+
+    std::vector<int>::erase(std::unique(begin(), end()), end());
+
+    endResetModel();
+}
+
+
 void CombedFramesModel::erase(int frame) {
-    std::set<int>::const_iterator it = find(frame);
+    const_iterator it = lower_bound(frame);
 
-    if (it == cend())
+    if (it == cend() || *it != frame)
         return;
 
-    int row = (int)std::distance(cbegin(), it);
+    int row = (int)(it - cbegin());
 
     beginRemoveRows(QModelIndex(), row, row);
 
-    std::set<int>::erase(it);
+    std::vector<int>::erase(begin() + row);
 
     endRemoveRows();
 }
@@ -99,7 +132,7 @@ void CombedFramesModel::clear() {
 
     beginRemoveRows(QModelIndex(), 0, size() - 1);
 
-    std::set<int>::clear();
+    std::vector<int>::clear();
 
     endRemoveRows();
 }
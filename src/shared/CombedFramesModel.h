@@ -21,12 +21,13 @@ SOFTWARE.
 #ifndef COMBEDFRAMESMODEL_H
 #define COMBEDFRAMESMODEL_H
 
-#include <set>
+#include <vector>
 
 #include <QAbstractListModel>
 
 
-class CombedFramesModel : public QAbstractListModel, private std::set<int> {
+// The frames are kept sorted, so a row is an index and a frame is found by binary search.
+class CombedFramesModel : public QAbstractListModel, private std::vector<int> {
     Q_OBJECT
 
 public:
@@ -38,16 +39,21 @@ public:
 
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
 
-    using std::set<int>::cbegin;
-    using std::set<int>::cend;
-    using std::set<int>::count;
-    using std::set<int>::lower_bound;
-    using std::set<int>::upper_bound;
-    using std::set<int>::size;
-    using std::set<int>::const_iterator;
+    using std::vector<int>::cbegin;
+    using std::vector<int>::cend;
+    using std::vector<int>::size;
+    using std::vector<int>::const_iterator;
+
+    size_t count(int frame) const;
+
+    const_iterator lower_bound(int frame) const;
+
+    const_iterator upper_bound(int frame) const;
 
     void insert(int frame);
 
+    void insert(const std::vector<int> &frames);
+
     void erase(int frame);
 
     void clear();
@@ -0,0 +1,106 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+#ifndef FRAMERANGEINDEX_H
+#define FRAMERANGEINDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+// Remembers which values cover which ranges of frames, and answers which
+// values cover a given frame, no matter how many different sets of ranges
+// were added to it. The ranges may overlap.
+//
+// It's a segment tree over all the non-negative frame numbers. A range is
+// stored in the O(log n) nodes that cover it exactly, and a frame is found
+// by walking from its leaf to the root, so a lookup costs O(log n + k),
+// where k is the number of ranges found. Only the nodes that hold ranges
+// are allocated.
+//
+// The frames must not be negative.
+template <typename T>
+class FrameRangeIndex {
+    static const int depth = 31;
+
+    std::unordered_map<uint64_t, std::vector<T> > nodes;
+
+    // Calls function for every node which covers part of the range first..last.
+    template <typename Function>
+    static void forEachNode(int first, int last, Function function) {
+        uint64_t left = ((uint64_t)1 << depth) + first;
+        uint64_t right = ((uint64_t)1 << depth) + last + 1;
+
+        while (left < right) {
+            if (left & 1)
+                function(left++);
+            if (right & 1)
+                function(--right);
+
+            left >>= 1;
+            right >>= 1;
+        }
+    }
+
+public:
+    void insert(int first, int last, const T &value) {
+        forEachNode(first, last, [this, &value] (uint64_t node) {
+            nodes[node].push_back(value);
+        });
+    }
+
+
+    // Must be called with the same range the value was inserted with.
+    void erase(int first, int last, const T &value) {
+        forEachNode(first, last, [this, &value] (uint64_t node) {
+            auto it = nodes.find(node);
+            if (it == nodes.end())
+                return;
+
+            std::vector<T> &values = it->second;
+
+            auto value_it = std::find(values.begin(), values.end(), value);
+            if (value_it != values.end())
+                values.erase(value_it);
+
+            if (values.empty())
+                nodes.erase(it);
+        });
+    }
+
+
+    void clear() {
+        nodes.clear();
+    }
+
+
+    // Appends the values whose ranges cover frame to found, in no particular order.
+    void find(int frame, std::vector<T> &found) const {
+        for (uint64_t node = ((uint64_t)1 << depth) + frame; node > 0; node >>= 1) {
+            auto it = nodes.find(node);
+            if (it != nodes.cend())
+                found.insert(found.end(), it->second.cbegin(), it->second.cend());
+        }
+    }
+};
+
+#endif // FRAMERANGEINDEX_H
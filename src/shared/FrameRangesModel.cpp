@@ -45,7 +45,7 @@ int FrameRangesModel::columnCount(const QModelIndex &parent) const {
 
 QVariant FrameRangesModel::data(const QModelIndex &index, int role) const {
     if (role == Qt::DisplayRole) {
-        const FrameRange &range = std::next(cbegin(), index.row())->second;
+        const FrameRange &range = atRow(index.row())->second;
 
         if (index.column() == FirstColumn)
             return range.first;
@@ -81,13 +81,11 @@ void FrameRangesModel::insert(const std::pair<int, FrameRange> &range) {
     if (it != cend() && it->first == range.first)
         return;
 
-    int new_row = 0;
-    if (size())
-        new_row = (int)std::distance(cbegin(), it);
+    int new_row = rowOf(it);
 
     beginInsertRows(QModelIndex(), new_row, new_row);
 
-    std::map<int, FrameRange>::insert(it, range);
+    IndexedFrameMap<FrameRange>::insert(it, range);
 
     endInsertRows();
 }
@@ -99,11 +97,11 @@ void FrameRangesModel::erase(int frame) {
     if (it == cend())
         return;
 
-    int row = (int)std::distance(cbegin(), it);
+    int row = rowOf(it);
 
     beginRemoveRows(QModelIndex(), row, row);
 
-    std::map<int, FrameRange>::erase(it);
+    IndexedFrameMap<FrameRange>::erase(it);
 
     endRemoveRows();
 }
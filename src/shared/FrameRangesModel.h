@@ -23,6 +23,8 @@ SOFTWARE.
 
 #include <QAbstractTableModel>
 
+#include "IndexedFrameMap.h"
+
 
 struct FrameRange {
     int first;
@@ -30,7 +32,7 @@ struct FrameRange {
 };
 
 
-class FrameRangesModel : public QAbstractTableModel, private std::map<int, FrameRange> {
+class FrameRangesModel : public QAbstractTableModel, private IndexedFrameMap<FrameRange> {
     Q_OBJECT
 
     enum Columns {
@@ -50,11 +52,11 @@ public:
 
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
 
-    using std::map<int, FrameRange>::cbegin;
-    using std::map<int, FrameRange>::cend;
-    using std::map<int, FrameRange>::upper_bound;
-    using std::map<int, FrameRange>::count;
-    using std::map<int, FrameRange>::size;
+    using IndexedFrameMap<FrameRange>::cbegin;
+    using IndexedFrameMap<FrameRange>::cend;
+    using IndexedFrameMap<FrameRange>::upper_bound;
+    using IndexedFrameMap<FrameRange>::count;
+    using IndexedFrameMap<FrameRange>::size;
 
     void insert(const std::pair<int, FrameRange> &range);
 
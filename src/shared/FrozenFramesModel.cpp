@@ -46,7 +46,7 @@ int FrozenFramesModel::columnCount(const QModelIndex &parent) const {
 
 QVariant FrozenFramesModel::data(const QModelIndex &index, int role) const {
     if (role == Qt::DisplayRole) {
-        const FreezeFrame &frozen = std::next(cbegin(), index.row())->second;
+        const FreezeFrame &frozen = atRow(index.row())->second;
 
         if (index.column() == FirstColumn)
             return QVariant(frozen.first);
@@ -80,34 +80,32 @@ QVariant FrozenFramesModel::headerData(int section, Qt::Orientation orientation,
 
 
 void FrozenFramesModel::insert(const value_type &freeze_frame) {
-    FreezeFrameMap::const_iterator it = lower_bound(freeze_frame.first);
+    const_iterator it = lower_bound(freeze_frame.first);
 
     if (it != cend() && it->first == freeze_frame.first)
         return;
 
-    int new_row = 0;
-    if (size())
-        new_row = (int)std::distance(cbegin(), it);
+    int new_row = rowOf(it);
 
     beginInsertRows(QModelIndex(), new_row, new_row);
 
-    FreezeFrameMap::insert(it, freeze_frame);
+    IndexedFrameMap<FreezeFrame>::insert(it, freeze_frame);
 
     endInsertRows();
 }
 
 
 void FrozenFramesModel::erase(int freeze_frame) {
-    FreezeFrameMap::const_iterator it = find(freeze_frame);
+    const_iterator it = find(freeze_frame);
 
     if (it == cend())
         return;
 
-    int row = (int)std::distance(cbegin(), it);
+    int row = rowOf(it);
 
     beginRemoveRows(QModelIndex(), row, row);
 
-    FreezeFrameMap::erase(it);
+    IndexedFrameMap<FreezeFrame>::erase(it);
 
     endRemoveRows();
 }
@@ -21,14 +21,13 @@ SOFTWARE.
 #ifndef FROZENFRAMESMODEL_H
 #define FROZENFRAMESMODEL_H
 
-#include <map>
-
 #include <QAbstractTableModel>
 
+#include "IndexedFrameMap.h"
 #include "WobblyTypes.h"
 
 
-class FrozenFramesModel : public QAbstractTableModel, private FreezeFrameMap {
+class FrozenFramesModel : public QAbstractTableModel, private IndexedFrameMap<FreezeFrame> {
     Q_OBJECT
 
     enum Columns {
@@ -49,10 +48,10 @@ public:
 
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
 
-    using FreezeFrameMap::size;
-    using FreezeFrameMap::cbegin;
-    using FreezeFrameMap::cend;
-    using FreezeFrameMap::upper_bound;
+    using IndexedFrameMap<FreezeFrame>::size;
+    using IndexedFrameMap<FreezeFrame>::cbegin;
+    using IndexedFrameMap<FreezeFrame>::cend;
+    using IndexedFrameMap<FreezeFrame>::upper_bound;
 
     void insert(const value_type &freeze_frame);
 
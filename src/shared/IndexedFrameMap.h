@@ -0,0 +1,190 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+#ifndef INDEXEDFRAMEMAP_H
+#define INDEXEDFRAMEMAP_H
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+
+
+// A std::map keyed by frame number, which can also tell which row an element
+// is in and which element is in a given row, without walking the whole map.
+// The Qt models use it, because their views ask for elements by row.
+//
+// The frames are grouped in blocks of 64. A Fenwick tree holds the number of
+// elements in each block, so at most one block's elements are ever walked.
+//
+// The keys must not be negative.
+template <typename T>
+class IndexedFrameMap : private std::map<int, T> {
+    typedef std::map<int, T> Base;
+
+    static const int block_shift = 6;
+
+    // Fenwick tree. Element i holds the number of elements in blocks i - (i & -i) to i - 1.
+    std::vector<int> block_counts;
+
+    // Called after inserting and before erasing.
+    void updateBlockCount(int key, int change) {
+        size_t block = (size_t)key >> block_shift;
+
+        if (block + 1 < block_counts.size()) {
+            addToBlockCount(block, change);
+            return;
+        }
+
+        // Only an insertion gets here. The tree grows to fit the new key,
+        // and is rebuilt from the map, which already contains it.
+        block_counts.assign(std::max(block_counts.size() * 2, block + 2), 0);
+
+        for (auto it = Base::cbegin(); it != Base::cend(); it++)
+            addToBlockCount((size_t)it->first >> block_shift, 1);
+    }
+
+    void addToBlockCount(size_t block, int change) {
+        for (size_t i = block + 1; i < block_counts.size(); i += i & -i)
+            block_counts[i] += change;
+    }
+
+    // Number of elements in the blocks before block.
+    int countBefore(size_t block) const {
+        int elements = 0;
+
+        for (size_t i = std::min(block, block_counts.size() - 1); i > 0; i -= i & -i)
+            elements += block_counts[i];
+
+        return elements;
+    }
+
+public:
+    typedef typename Base::key_type key_type;
+    typedef typename Base::mapped_type mapped_type;
+    typedef typename Base::value_type value_type;
+    typedef typename Base::iterator iterator;
+    typedef typename Base::const_iterator const_iterator;
+
+    IndexedFrameMap()
+        : block_counts(1, 0)
+    {
+
+    }
+
+    using Base::at;
+    using Base::begin;
+    using Base::end;
+    using Base::cbegin;
+    using Base::cend;
+    using Base::count;
+    using Base::empty;
+    using Base::find;
+    using Base::lower_bound;
+    using Base::upper_bound;
+    using Base::size;
+
+    std::pair<iterator, bool> insert(const value_type &value) {
+        std::pair<iterator, bool> result = Base::insert(value);
+
+        if (result.second)
+            updateBlockCount(value.first, 1);
+
+        return result;
+    }
+
+    iterator insert(const_iterator hint, const value_type &value) {
+        size_t old_size = size();
+
+        iterator it = Base::insert(hint, value);
+
+        if (size() != old_size)
+            updateBlockCount(value.first, 1);
+
+        return it;
+    }
+
+    iterator erase(const_iterator position) {
+        updateBlockCount(position->first, -1);
+
+        return Base::erase(position);
+    }
+
+    size_t erase(int key) {
+        const_iterator it = find(key);
+
+        if (it == cend())
+            return 0;
+
+        erase(it);
+
+        return 1;
+    }
+
+    void clear() {
+        Base::clear();
+        block_counts.assign(1, 0);
+    }
+
+    int rowOf(const_iterator position) const {
+        if (position == cend())
+            return (int)size();
+
+        size_t block = (size_t)position->first >> block_shift;
+
+        int row = countBefore(block);
+
+        for (const_iterator it = Base::lower_bound((int)(block << block_shift)); it != position; it++)
+            row++;
+
+        return row;
+    }
+
+    const_iterator atRow(int row) const {
+        if (row < 0 || row >= (int)size())
+            return cend();
+
+        // Walk down the tree to the block holding the row.
+        size_t block = 0;
+
+        size_t step = 1;
+        while (step * 2 < block_counts.size())
+            step *= 2;
+
+        for (; step; step /= 2) {
+            if (block + step < block_counts.size() && block_counts[block + step] <= row) {
+                block += step;
+                row -= block_counts[block];
+            }
+        }
+
+        return std::next(Base::lower_bound((int)(block << block_shift)), row);
+    }
+
+    iterator atRow(int row) {
+        const_iterator it = static_cast<const IndexedFrameMap *>(this)->atRow(row);
+
+        // Turns the const_iterator into an iterator.
+        return Base::erase(it, it);
+    }
+};
+
+#endif // INDEXEDFRAMEMAP_H
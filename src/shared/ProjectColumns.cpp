@@ -0,0 +1,274 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+
+#include "ProjectColumns.h"
+
+
+#define COLUMNS_MAGIC "WOBCOLS"
+#define COLUMNS_VERSION 1
+#define HEADER_SIZE 24
+#define TABLE_ENTRY_SIZE 32
+
+
+struct CRC32Table {
+    uint32_t values[256];
+
+    CRC32Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int j = 0; j < 8; j++)
+                c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+            values[i] = c;
+        }
+    }
+};
+
+
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+
+ProjectColumns::ProjectColumns()
+    : file_data(nullptr)
+    , file_size(0)
+{
+
+}
+
+
+ProjectColumns::~ProjectColumns() {
+    // QFile unmaps the file when it gets closed.
+    file.close();
+}
+
+
+std::string ProjectColumns::getSidecarPath(const std::string &project_path, uint32_t checksum) {
+    return project_path + "." + QString::number(checksum, 16).rightJustified(8, QLatin1Char('0')).toStdString() + ".columns";
+}
+
+
+// Sidecars are called "<project>.<checksum>.columns", or "<project>.columns" if an older version wrote them.
+void ProjectColumns::removeOldSidecars(const std::string &project_path, const std::string &keep_path) {
+    QFileInfo project_info(QString::fromStdString(project_path));
+    QDir dir = project_info.dir();
+
+    QString prefix = project_info.fileName() + QLatin1Char('.');
+    QString suffix = QStringLiteral(".columns");
+    QString keep_name = keep_path.empty() ? QString() : QFileInfo(QString::fromStdString(keep_path)).fileName();
+
+    QStringList names = dir.entryList(QStringList(QLatin1Char('*') + suffix), QDir::Files);
+
+    for (int i = 0; i < names.size(); i++) {
+        const QString &name = names[i];
+
+        if (name == keep_name || !name.startsWith(prefix) || !name.endsWith(suffix))
+            continue;
+
+        QString checksum = name.mid(prefix.size(), name.size() - prefix.size() - suffix.size());
+
+        bool is_sidecar = checksum.isEmpty();
+        if (checksum.size() == 8)
+            checksum.toUInt(&is_sidecar, 16);
+
+        if (is_sidecar)
+            QFile::remove(dir.filePath(name));
+    }
+}
+
+
+uint32_t ProjectColumns::crc32(const void *data, size_t size, uint32_t crc) {
+    static const CRC32Table table;
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table.values[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+
+const ProjectColumns::Column &ProjectColumns::findColumn(uint32_t id) const {
+    for (size_t i = 0; i < columns.size(); i++)
+        if (columns[i].id == id)
+            return columns[i];
+
+    throw WobblyException(path + ": column " + std::to_string(id) + " is missing.");
+}
+
+
+void ProjectColumns::addColumn(uint32_t id, uint32_t element_size, uint64_t count, QByteArray &data) {
+    Column column;
+    column.id = id;
+    column.element_size = element_size;
+    column.count = count;
+    column.offset = 0;
+    column.checksum = crc32(data.constData(), data.size());
+    column.data.swap(data);
+
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns[i].id == id) {
+            columns[i] = column;
+            return;
+        }
+    }
+
+    columns.push_back(column);
+}
+
+
+QByteArray ProjectColumns::makeHeader(int num_frames) const {
+    QByteArray header(HEADER_SIZE + TABLE_ENTRY_SIZE * (int)columns.size(), 0);
+    uchar *h = (uchar *)header.data();
+
+    memcpy(h, COLUMNS_MAGIC, sizeof(COLUMNS_MAGIC));
+    qToLittleEndian<quint32>(COLUMNS_VERSION, h + 8);
+    qToLittleEndian<quint32>((quint32)num_frames, h + 12);
+    qToLittleEndian<quint32>((quint32)columns.size(), h + 16);
+
+    uint64_t offset = alignOffset(header.size());
+
+    for (size_t i = 0; i < columns.size(); i++) {
+        uchar *entry = h + HEADER_SIZE + TABLE_ENTRY_SIZE * i;
+
+        qToLittleEndian<quint32>(columns[i].id, entry);
+        qToLittleEndian<quint32>(columns[i].element_size, entry + 4);
+        qToLittleEndian<quint64>(columns[i].count, entry + 8);
+        qToLittleEndian<quint64>(offset, entry + 16);
+        qToLittleEndian<quint32>(columns[i].checksum, entry + 24);
+
+        offset = alignOffset(offset + columns[i].data.size());
+    }
+
+    return header;
+}
+
+
+uint32_t ProjectColumns::getChecksum(int num_frames) const {
+    QByteArray header = makeHeader(num_frames);
+
+    return crc32(header.constData(), header.size());
+}
+
+
+uint32_t ProjectColumns::writeFile(const std::string &file_path, int num_frames) const {
+    QByteArray header = makeHeader(num_frames);
+
+    // The old file stays in place until the new one is complete.
+    QSaveFile out(QString::fromStdString(file_path));
+
+    if (!out.open(QIODevice::WriteOnly))
+        throw WobblyException("Couldn't open column file '" + file_path + "'. Error message: " + out.errorString().toStdString());
+
+    const char padding[8] = { 0 };
+
+    bool ok = out.write(header) == header.size();
+
+    for (size_t i = 0; ok && i < columns.size(); i++) {
+        int padding_size = (int)(alignOffset(out.pos()) - out.pos());
+        ok = out.write(padding, padding_size) == padding_size &&
+             out.write(columns[i].data) == columns[i].data.size();
+    }
+
+    if (!ok || !out.commit())
+        throw WobblyException("Couldn't write the columns to file '" + file_path + "'. Error message: " + out.errorString().toStdString());
+
+    return crc32(header.constData(), header.size());
+}
+
+
+void ProjectColumns::readFile(const std::string &file_path, uint32_t checksum) {
+    path = file_path;
+    columns.clear();
+
+    file.close();
+    file.setFileName(QString::fromStdString(file_path));
+
+    if (!file.open(QIODevice::ReadOnly))
+        throw WobblyException("Couldn't open column file '" + file_path + "'. Error message: " + file.errorString().toStdString());
+
+    file_size = file.size();
+    file_data = file.map(0, file_size);
+    if (!file_data) {
+        file_contents = file.readAll();
+        file_data = (const uchar *)file_contents.constData();
+        file_size = file_contents.size();
+    }
+
+    if (file_size < HEADER_SIZE || memcmp(file_data, COLUMNS_MAGIC, sizeof(COLUMNS_MAGIC)))
+        throw WobblyException(file_path + ": not a Wobbly column file.");
+
+    uint32_t version = qFromLittleEndian<quint32>(file_data + 8);
+    if (version > COLUMNS_VERSION)
+        throw WobblyException(file_path + ": the column file's version is " + std::to_string(version) + ", but this software only understands version " + std::to_string(COLUMNS_VERSION) + " and older. Upgrade the software and try again.");
+
+    uint32_t column_count = qFromLittleEndian<quint32>(file_data + 16);
+    uint64_t table_size = HEADER_SIZE + (uint64_t)TABLE_ENTRY_SIZE * column_count;
+
+    if (file_size < table_size)
+        throw WobblyException(file_path + ": the column table is truncated.");
+
+    if (crc32(file_data, table_size) != checksum)
+        throw WobblyException(file_path + ": the column file doesn't belong to this project. It was probably overwritten by another program or an older save.");
+
+    for (uint32_t i = 0; i < column_count; i++) {
+        const uchar *entry = file_data + HEADER_SIZE + TABLE_ENTRY_SIZE * i;
+
+        Column column;
+        column.id = qFromLittleEndian<quint32>(entry);
+        column.element_size = qFromLittleEndian<quint32>(entry + 4);
+        column.count = qFromLittleEndian<quint64>(entry + 8);
+        column.offset = qFromLittleEndian<quint64>(entry + 16);
+        column.checksum = qFromLittleEndian<quint32>(entry + 24);
+
+        if (column.element_size && column.count > file_size / column.element_size)
+            throw WobblyException(file_path + ": column " + std::to_string(column.id) + " is truncated.");
+
+        uint64_t size = column.count * column.element_size;
+
+        if (column.offset < table_size || column.offset > file_size || size > file_size - column.offset)
+            throw WobblyException(file_path + ": column " + std::to_string(column.id) + " is truncated.");
+
+        if (crc32(file_data + column.offset, size) != column.checksum)
+            throw WobblyException(file_path + ": column " + std::to_string(column.id) + " is damaged (checksum mismatch).");
+
+        columns.push_back(column);
+    }
+}
+
+
+bool ProjectColumns::hasColumn(uint32_t id) const {
+    for (size_t i = 0; i < columns.size(); i++)
+        if (columns[i].id == id)
+            return true;
+
+    return false;
+}
+
+
+size_t ProjectColumns::getColumnCount(uint32_t id) const {
+    return findColumn(id).count;
+}
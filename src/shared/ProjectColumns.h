@@ -0,0 +1,151 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#ifndef PROJECTCOLUMNS_H
+#define PROJECTCOLUMNS_H
+
+#include <cstdint>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+#include <QByteArray>
+#include <QFile>
+#include <QtEndian>
+
+#include "WobblyException.h"
+
+
+// Binary file holding the per-frame arrays of a project, next to the JSON.
+//
+// Layout, all little endian:
+//   header: "WOBCOLS\0", version, number of frames, number of columns, reserved (24 bytes)
+//   column table: id, element size, element count, offset, CRC-32, reserved (32 bytes each)
+//   column data, each column starting at a multiple of 8 bytes.
+//
+// The CRC-32 of the header and the column table is returned by writeFile() and
+// passed to readFile(), so a project can tell if its sidecar belongs to it.
+class ProjectColumns {
+public:
+    enum ColumnID {
+        ColumnMics = 1,
+        ColumnMMetrics,
+        ColumnVMetrics,
+        ColumnMatches,
+        ColumnOriginalMatches,
+        ColumnDecimateMetrics,
+        ColumnCombedFrames,
+        ColumnDecimatedFrames
+    };
+
+private:
+    struct Column {
+        uint32_t id;
+        uint32_t element_size;
+        uint64_t count;
+        uint64_t offset;
+        uint32_t checksum;
+
+        // Only used when writing.
+        QByteArray data;
+    };
+
+    std::vector<Column> columns;
+
+    std::string path;
+    QFile file;
+    QByteArray file_contents;
+    const uchar *file_data;
+    uint64_t file_size;
+
+    const Column &findColumn(uint32_t id) const;
+
+    void addColumn(uint32_t id, uint32_t element_size, uint64_t count, QByteArray &data);
+
+    QByteArray makeHeader(int num_frames) const;
+
+public:
+    ProjectColumns();
+
+    ~ProjectColumns();
+
+    // The checksum is part of the name, so a new sidecar never replaces the one the project on disk still refers to.
+    static std::string getSidecarPath(const std::string &project_path, uint32_t checksum);
+
+    // Deletes the project's sidecars other than keep_path, which may be empty.
+    // Call only after the project that no longer refers to them was written.
+    static void removeOldSidecars(const std::string &project_path, const std::string &keep_path);
+
+    static uint32_t crc32(const void *data, size_t size, uint32_t crc = 0);
+
+    // components is the number of values in one element (e.g. 5 for the mics).
+    template <typename T>
+    void addColumn(uint32_t id, const T *values, size_t count, uint32_t components = 1) {
+        size_t values_count = count * components;
+
+        QByteArray data((int)(values_count * sizeof(T)), 0);
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        if (values_count)
+            memcpy(data.data(), values, values_count * sizeof(T));
+#else
+        for (size_t i = 0; i < values_count; i++)
+            qToLittleEndian<T>(values[i], (uchar *)data.data() + i * sizeof(T));
+#endif
+
+        addColumn(id, sizeof(T) * components, count, data);
+    }
+
+    // The CRC-32 writeFile() will return, without writing anything.
+    uint32_t getChecksum(int num_frames) const;
+
+    // Returns the CRC-32 of the header and the column table.
+    uint32_t writeFile(const std::string &file_path, int num_frames) const;
+
+    // Maps the file if possible. Throws if the file is damaged or doesn't match the checksum.
+    void readFile(const std::string &file_path, uint32_t checksum);
+
+    bool hasColumn(uint32_t id) const;
+
+    // Number of elements in the column.
+    size_t getColumnCount(uint32_t id) const;
+
+    template <typename T>
+    void getColumn(uint32_t id, T *values, size_t count, uint32_t components = 1) const {
+        const Column &column = findColumn(id);
+
+        if (column.element_size != sizeof(T) * components || column.count != count)
+            throw WobblyException(path + ": column " + std::to_string(id) + " has " + std::to_string(column.count) + " elements of " + std::to_string(column.element_size) + " bytes, expected " + std::to_string(count) + " elements of " + std::to_string(sizeof(T) * components) + " bytes.");
+
+        size_t values_count = count * components;
+        const uchar *source = file_data + column.offset;
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        if (values_count)
+            memcpy(values, source, values_count * sizeof(T));
+#else
+        for (size_t i = 0; i < values_count; i++)
+            values[i] = qFromLittleEndian<T>(source + i * sizeof(T));
+#endif
+    }
+};
+
+#endif // PROJECTCOLUMNS_H
@@ -0,0 +1,285 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <QFileInfo>
+#include <QSaveFile>
+
+#define RAPIDJSON_NAMESPACE rj
+#define RAPIDJSON_HAS_STDSTRING 1
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include "ProjectJournal.h"
+#include "WobblyException.h"
+
+
+#define JOURNAL_MAGIC "wobbly journal"
+#define JOURNAL_VERSION 1
+
+// Entries kept in memory before they are written and synced.
+#define JOURNAL_BATCH_SIZE 256
+
+// Size at which the journal asks to be folded into the project file.
+#define JOURNAL_COMPACTION_SIZE (4 << 20)
+
+
+static std::string makeHeader(const std::string &id) {
+    rj::StringBuffer buffer;
+    rj::Writer<rj::StringBuffer> writer(buffer);
+
+    writer.StartArray();
+    writer.String(JOURNAL_MAGIC);
+    writer.Int(JOURNAL_VERSION);
+    writer.String(id);
+    writer.EndArray();
+
+    return std::string(buffer.GetString(), buffer.GetSize()) + "\n";
+}
+
+
+static bool parseHeader(const std::string &line, const std::string &id) {
+    rj::Document json;
+    json.Parse(line.c_str());
+
+    return !json.HasParseError() &&
+           json.IsArray() && json.Size() == 3 &&
+           json[0].IsString() && std::string(json[0].GetString()) == JOURNAL_MAGIC &&
+           json[1].IsInt() && json[1].GetInt() <= JOURNAL_VERSION &&
+           json[2].IsString() && std::string(json[2].GetString()) == id;
+}
+
+
+static bool parseEntry(const std::string &line, uint64_t *sequence) {
+    rj::Document json;
+    json.Parse(line.c_str());
+
+    if (json.HasParseError() ||
+        !json.IsArray() || json.Size() != 2 ||
+        !json[0].IsUint64() ||
+        !json[1].IsArray() || !json[1].Size() || !json[1][0].IsString())
+        return false;
+
+    *sequence = json[0].GetUint64();
+
+    return true;
+}
+
+
+ProjectJournal::ProjectJournal()
+    : pending_entries(0)
+    , compaction_requested(false)
+{
+
+}
+
+
+ProjectJournal::~ProjectJournal() {
+    try {
+        close();
+    } catch (WobblyException &) {
+        // Nothing sensible to do here. The entries that couldn't be written are lost.
+    }
+}
+
+
+std::string ProjectJournal::getJournalPath(const std::string &project_path) {
+    return project_path + ".journal";
+}
+
+
+std::vector<ProjectJournal::Entry> ProjectJournal::readFile(const std::string &path, const std::string &id) {
+    std::vector<Entry> entries;
+
+    QFile in(QString::fromStdString(path));
+
+    if (!in.open(QIODevice::ReadOnly))
+        return entries;
+
+    QByteArray line = in.readLine();
+
+    if (!line.endsWith('\n') || !parseHeader(std::string(line.constData(), line.size()), id))
+        return entries;
+
+    while (true) {
+        line = in.readLine();
+
+        // A missing newline means the program died in the middle of writing the line.
+        if (!line.endsWith('\n'))
+            break;
+
+        Entry entry;
+        entry.line.assign(line.constData(), line.size() - 1);
+
+        if (!parseEntry(entry.line, &entry.sequence))
+            break;
+
+        entries.push_back(entry);
+    }
+
+    return entries;
+}
+
+
+void ProjectJournal::open(const std::string &journal_path, const std::string &project_id) {
+    close();
+
+    path = journal_path;
+    id = project_id;
+    compaction_requested = false;
+
+    // Rewriting the old entries also drops whatever damaged tail the file had.
+    rewrite(path, 0);
+}
+
+
+void ProjectJournal::close() {
+    if (!file.isOpen())
+        return;
+
+    flush();
+
+    file.close();
+}
+
+
+bool ProjectJournal::isOpen() const {
+    return file.isOpen();
+}
+
+
+const std::string &ProjectJournal::getPath() const {
+    return path;
+}
+
+
+void ProjectJournal::append(uint64_t sequence, const std::string &record) {
+    pending.push_back('[');
+    pending += std::to_string(sequence);
+    pending.push_back(',');
+    pending += record;
+    pending += "]\n";
+
+    if (++pending_entries >= JOURNAL_BATCH_SIZE)
+        flush();
+}
+
+
+void ProjectJournal::flush() {
+    if (pending.empty())
+        return;
+
+    bool ok = file.write(pending.c_str(), pending.size()) == (qint64)pending.size() && file.flush();
+
+    pending.clear();
+    pending_entries = 0;
+
+    if (ok) {
+#ifdef _WIN32
+        ok = _commit(file.handle()) == 0;
+#else
+        ok = fsync(file.handle()) == 0;
+#endif
+    }
+
+    if (!ok)
+        throw WobblyException("Couldn't write to journal file '" + path + "'. Error message: " + file.errorString().toStdString());
+}
+
+
+void ProjectJournal::compact(uint64_t saved_sequence) {
+    if (!file.isOpen())
+        return;
+
+    flush();
+
+    rewrite(path, saved_sequence);
+}
+
+
+void ProjectJournal::moveTo(const std::string &journal_path, uint64_t saved_sequence) {
+    if (!file.isOpen())
+        return;
+
+    flush();
+
+    std::string old_path = path;
+
+    rewrite(journal_path, saved_sequence);
+
+    if (old_path != journal_path)
+        QFile::remove(QString::fromStdString(old_path));
+}
+
+
+// Writes the entries of the journal at path that come after saved_sequence to new_path,
+// and leaves the journal open there for appending. QSaveFile only replaces the old file
+// once the new one is complete, so a crash never loses the entries being rewritten.
+void ProjectJournal::rewrite(const std::string &new_path, uint64_t saved_sequence) {
+    std::vector<Entry> entries = readFile(path, id);
+
+    QSaveFile out(QString::fromStdString(new_path));
+
+    if (!out.open(QIODevice::WriteOnly))
+        throw WobblyException("Couldn't open journal file '" + new_path + "'. Error message: " + out.errorString().toStdString());
+
+    std::string contents = makeHeader(id);
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].sequence <= saved_sequence)
+            continue;
+
+        contents += entries[i].line;
+        contents.push_back('\n');
+    }
+
+    if (out.write(contents.c_str(), contents.size()) != (qint64)contents.size() || !out.commit())
+        throw WobblyException("Couldn't write to journal file '" + new_path + "'. Error message: " + out.errorString().toStdString());
+
+    // The old file was replaced, so the handle has to be reopened.
+    file.close();
+
+    path = new_path;
+    file.setFileName(QString::fromStdString(path));
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        throw WobblyException("Couldn't open journal file '" + path + "'. Error message: " + file.errorString().toStdString());
+
+    compaction_requested = false;
+}
+
+
+bool ProjectJournal::wantsCompaction() {
+    if (compaction_requested || !file.isOpen())
+        return false;
+
+    if (file.size() + (qint64)pending.size() < JOURNAL_COMPACTION_SIZE)
+        return false;
+
+    compaction_requested = true;
+
+    return true;
+}
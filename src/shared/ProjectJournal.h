@@ -0,0 +1,96 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+#ifndef PROJECTJOURNAL_H
+#define PROJECTJOURNAL_H
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include <QFile>
+
+
+// Append-only log of the edits made to a project since it was last saved.
+//
+// One JSON array per line. The first line is the header:
+//   ["wobbly journal", version, project id]
+// Every other line is one edit:
+//   [sequence number, [operation, arguments...]]
+//
+// A line without its newline is the end of an interrupted write and is ignored.
+class ProjectJournal {
+public:
+    struct Entry {
+        uint64_t sequence;
+        std::string line;
+    };
+
+private:
+    std::string path;
+    std::string id;
+    QFile file;
+
+    std::string pending;
+    int pending_entries;
+
+    bool compaction_requested;
+
+    void rewrite(const std::string &new_path, uint64_t saved_sequence);
+
+public:
+    ProjectJournal();
+
+    ~ProjectJournal();
+
+    static std::string getJournalPath(const std::string &project_path);
+
+    // Returns the complete entries of the journal at path, in order. Returns
+    // nothing if there is no journal or it belongs to a different project.
+    static std::vector<Entry> readFile(const std::string &path, const std::string &id);
+
+    // Keeps the existing entries if the journal belongs to the project id.
+    void open(const std::string &journal_path, const std::string &project_id);
+
+    void close();
+
+    bool isOpen() const;
+
+    const std::string &getPath() const;
+
+    // The entries are written and synced in batches, when there are enough
+    // of them or when flush() is called.
+    void append(uint64_t sequence, const std::string &record);
+
+    void flush();
+
+    // Drops the entries that are already in the project file.
+    void compact(uint64_t saved_sequence);
+
+    // Like compact(), but the remaining entries go to journal_path, and the old file is deleted.
+    void moveTo(const std::string &journal_path, uint64_t saved_sequence);
+
+    // True once the journal has grown big enough to be worth folding into
+    // the project file. Reset by compact().
+    bool wantsCompaction();
+};
+
+#endif // PROJECTJOURNAL_H
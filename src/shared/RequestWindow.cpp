@@ -0,0 +1,113 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#include <algorithm>
+
+#include "RequestWindow.h"
+
+
+#define PERIOD_MILLISECONDS 2000
+
+
+RequestWindow::RequestWindow()
+    : size(1)
+    , minimum_size(1)
+    , maximum_size(1)
+    , frames_in_period(0)
+    , period_end(0)
+    , period_start(0)
+    , direction(1)
+    , previous_fps(0)
+    , last_fps(0)
+{
+
+}
+
+
+void RequestWindow::start(int initial_size, int maximum) {
+    maximum_size = std::max(1, maximum);
+    size = std::max(minimum_size, std::min(initial_size, maximum_size));
+
+    frames_in_period = 0;
+    period_start = 0;
+    period_end = PERIOD_MILLISECONDS;
+    direction = 1;
+    previous_fps = 0;
+    last_fps = 0;
+}
+
+
+int RequestWindow::getSize() const {
+    return size;
+}
+
+
+double RequestWindow::getThroughput() const {
+    return last_fps;
+}
+
+
+bool RequestWindow::frameDone(int64_t elapsed_milliseconds) {
+    int frames = ++frames_in_period;
+
+    int64_t end = period_end;
+    if (elapsed_milliseconds < end)
+        return false;
+
+    // Only one thread gets to end the period.
+    if (!period_end.compare_exchange_strong(end, elapsed_milliseconds + PERIOD_MILLISECONDS))
+        return false;
+
+    // Slow sources need longer periods, or the measurements are mostly noise.
+    if (frames < 2 * size)
+        return false;
+
+    frames_in_period -= frames;
+
+    double fps = (double)frames * 1000 / (elapsed_milliseconds - period_start);
+    period_start = elapsed_milliseconds;
+
+    resize(fps);
+
+    return true;
+}
+
+
+void RequestWindow::resize(double fps) {
+    last_fps = fps;
+
+    if (previous_fps > 0) {
+        if (fps < previous_fps * 0.95) {
+            // The last step made things worse.
+            direction = -direction;
+        } else if (fps < previous_fps * 1.05) {
+            // No real difference, so don't keep more frames in memory than needed.
+            direction = -1;
+        }
+    }
+
+    previous_fps = fps;
+
+    int current = size;
+    int step = std::max(1, current / 4);
+
+    size = std::max(minimum_size, std::min(current + direction * step, maximum_size));
+}
@@ -0,0 +1,65 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#ifndef REQUESTWINDOW_H
+#define REQUESTWINDOW_H
+
+#include <atomic>
+#include <cstdint>
+
+
+// Decides how many frame requests to keep in flight.
+// Every measuring period the throughput is compared with that of the previous period,
+// and the window keeps growing or shrinking in the same direction while it helps.
+// frameDone() can be called from several threads at once.
+class RequestWindow {
+    std::atomic<int> size;
+    int minimum_size;
+    int maximum_size;
+
+    std::atomic<int> frames_in_period;
+    std::atomic<int64_t> period_end;
+
+    // Only touched by the thread that ends a period.
+    int64_t period_start;
+    int direction;
+    double previous_fps;
+
+    std::atomic<double> last_fps;
+
+    void resize(double fps);
+
+public:
+    RequestWindow();
+
+    void start(int initial_size, int maximum);
+
+    int getSize() const;
+
+    // Throughput measured during the last period, in frames per second.
+    double getThroughput() const;
+
+    // The time is measured by the caller from the start of the work.
+    // Returns true if the window was resized.
+    bool frameDone(int64_t elapsed_milliseconds);
+};
+
+#endif // REQUESTWINDOW_H
@@ -45,7 +45,7 @@ int SectionsModel::columnCount(const QModelIndex &parent) const {
 
 QVariant SectionsModel::data(const QModelIndex &index, int role) const {
     if (role == Qt::DisplayRole) {
-        const Section &section = std::next(cbegin(), index.row())->second;
+        const Section &section = atRow(index.row())->second;
 
         if (index.column() == StartColumn)
             return section.start;
@@ -85,45 +85,54 @@ QVariant SectionsModel::headerData(int section, Qt::Orientation orientation, int
 
 
 void SectionsModel::insert(const value_type &section) {
-    SectionMap::const_iterator it = lower_bound(section.first);
+    const_iterator it = lower_bound(section.first);
 
     if (it != cend() && it->first == section.first)
         return;
 
-    int new_row = 0;
-    if (size())
-        new_row = (int)std::distance(cbegin(), it);
+    int new_row = rowOf(it);
 
     beginInsertRows(QModelIndex(), new_row, new_row);
 
-    SectionMap::insert(it, section);
+    IndexedFrameMap<Section>::insert(it, section);
 
     endInsertRows();
 }
 
 
+// One model reset instead of one row insertion per section.
+void SectionsModel::insert(const std::vector<Section> &sections) {
+    beginResetModel();
+
+    for (auto it = sections.cbegin(); it != sections.cend(); it++)
+        IndexedFrameMap<Section>::insert(std::make_pair(it->start, *it));
+
+    endResetModel();
+}
+
+
 void SectionsModel::erase(int section_start) {
-    SectionMap::const_iterator it = find(section_start);
+    const_iterator it = find(section_start);
 
     if (it == cend())
         return;
 
-    int row = (int)std::distance(cbegin(), it);
+    int row = rowOf(it);
 
     beginRemoveRows(QModelIndex(), row, row);
 
-    SectionMap::erase(it);
+    IndexedFrameMap<Section>::erase(it);
 
     endRemoveRows();
 }
 
 
 void SectionsModel::setSectionPresetName(int section_start, size_t preset_index, const std::string &preset_name) {
-    SectionMap::iterator it = find(section_start);
+    iterator it = find(section_start);
 
     it->second.presets[preset_index] = preset_name;
 
-    int row = (int)std::distance(begin(), it);
+    int row = rowOf(it);
 
     QModelIndex cell = index(row, PresetsColumn);
     emit dataChanged(cell, cell);
@@ -131,11 +140,11 @@ void SectionsModel::setSectionPresetName(int section_start, size_t preset_index,
 
 
 void SectionsModel::appendSectionPreset(int section_start, const std::string &preset_name) {
-    SectionMap::iterator it = find(section_start);
+    iterator it = find(section_start);
 
     it->second.presets.push_back(preset_name);
 
-    int row = (int)std::distance(begin(), it);
+    int row = rowOf(it);
 
     QModelIndex cell = index(row, PresetsColumn);
     emit dataChanged(cell, cell);
@@ -143,11 +152,11 @@ void SectionsModel::appendSectionPreset(int section_start, const std::string &pr
 
 
 void SectionsModel::deleteSectionPreset(int section_start, size_t preset_index) {
-    SectionMap::iterator it = find(section_start);
+    iterator it = find(section_start);
 
     it->second.presets.erase(it->second.presets.cbegin() + preset_index);
 
-    int row = (int)std::distance(begin(), it);
+    int row = rowOf(it);
 
     QModelIndex cell = index(row, PresetsColumn);
     emit dataChanged(cell, cell);
@@ -158,11 +167,11 @@ void SectionsModel::moveSectionPresetUp(int section_start, size_t preset_index)
     if (preset_index == 0)
         return;
 
-    SectionMap::iterator it = find(section_start);
+    iterator it = find(section_start);
 
     std::swap(it->second.presets[preset_index - 1], it->second.presets[preset_index]);
 
-    int row = (int)std::distance(begin(), it);
+    int row = rowOf(it);
 
     QModelIndex cell = index(row, PresetsColumn);
     emit dataChanged(cell, cell);
@@ -170,14 +179,14 @@ void SectionsModel::moveSectionPresetUp(int section_start, size_t preset_index)
 
 
 void SectionsModel::moveSectionPresetDown(int section_start, size_t preset_index) {
-    SectionMap::iterator it = find(section_start);
+    iterator it = find(section_start);
 
     if (preset_index == it->second.presets.size() - 1)
         return;
 
     std::swap(it->second.presets[preset_index], it->second.presets[preset_index + 1]);
 
-    int row = (int)std::distance(begin(), it);
+    int row = rowOf(it);
 
     QModelIndex cell = index(row, PresetsColumn);
     emit dataChanged(cell, cell);
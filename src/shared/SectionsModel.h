@@ -23,10 +23,11 @@ SOFTWARE.
 
 #include <QAbstractTableModel>
 
+#include "IndexedFrameMap.h"
 #include "WobblyTypes.h"
 
 
-class SectionsModel : public QAbstractTableModel, private SectionMap {
+class SectionsModel : public QAbstractTableModel, private IndexedFrameMap<Section> {
     Q_OBJECT
 
 public:
@@ -46,13 +47,15 @@ public:
 
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
 
-    using SectionMap::cbegin;
-    using SectionMap::cend;
-    using SectionMap::upper_bound;
-    using SectionMap::count;
+    using IndexedFrameMap<Section>::cbegin;
+    using IndexedFrameMap<Section>::cend;
+    using IndexedFrameMap<Section>::upper_bound;
+    using IndexedFrameMap<Section>::count;
 
     void insert(const value_type &section);
 
+    void insert(const std::vector<Section> &sections);
+
     void erase(int section_start);
 
     void setSectionPresetName(int section_start, size_t preset_index, const std::string &preset_name);
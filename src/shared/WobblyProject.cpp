@@ -18,30 +18,42 @@ SOFTWARE.
 */
 
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <map>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QUuid>
+
+#include <zlib.h>
 
 #define RAPIDJSON_NAMESPACE rj
 #define RAPIDJSON_HAS_STDSTRING 1
 #include "rapidjson/document.h"
 #include "rapidjson/prettywriter.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/stringbuffer.h"
 #include "rapidjson/error/en.h"
 
+#include "ProjectColumns.h"
 #include "RandomStuff.h"
 #include "WobblyException.h"
 #include "WobblyProject.h"
 
 
-#define PROJECT_FORMAT_VERSION 2
+#define PROJECT_FORMAT_VERSION 4
 
 
 namespace Keys {
@@ -153,6 +165,1280 @@ namespace Keys {
         const char float_samples[] = "float" " " "samples";;
         const char dither[] = "dither";;
     }
+    const char columns[] = "columns";;
+    namespace Columns {
+        const char file[] = "file";;
+        const char checksum[] = "checksum";;
+    }
+    const char journal[] = "journal";;
+    namespace Journal {
+        const char id[] = "id";;
+        const char sequence[] = "sequence";;
+    }
+}
+
+
+// Each cycle's decimated frames are a mask where bit n means frame n of the cycle.
+static int countDecimatedFrames(uint8_t mask) {
+    static const int8_t counts[32] = {
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5
+    };
+
+    return counts[mask & 0x1f];
+}
+
+
+static const char vlq_digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+
+static int vlqDigitValue(char c) {
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+
+// Below this many values per thread, starting the threads costs more than it saves.
+static const size_t delta_chunk_minimum = 1 << 18;
+
+
+// Number of pieces to split count values into, one per thread.
+static size_t getDeltaChunks(size_t count) {
+    size_t threads = std::thread::hardware_concurrency();
+
+    return std::max<size_t>(1, std::min<size_t>(threads, count / delta_chunk_minimum));
+}
+
+
+// Calls function(i) for each i in [0, count), each in its own thread. The first one runs in the calling thread.
+template <typename Function>
+static void runInThreads(size_t count, const Function &function) {
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+
+    for (size_t i = 1; i < count; i++)
+        threads.emplace_back(function, i);
+
+    function(0);
+
+    for (auto &thread : threads)
+        thread.join();
+}
+
+
+// Used for the mics and the metrics since project format version 4.
+// Each value is stored as the difference from the same component of the previous element,
+// zigzag encoded, as base64 digits of 5 bits each, lowest bits first. 0x20 in a digit means more digits follow.
+//
+// Values first to last - 1 (counting every component) are appended to encoded.
+template <typename T>
+static void encodeDeltaRange(const T *values, size_t first, size_t last, size_t components, std::string &encoded) {
+    for (size_t i = first; i < last; i++) {
+        int64_t delta = (int64_t)values[i] - (i >= components ? (int64_t)values[i - components] : 0);
+        uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+
+        do {
+            int digit = zigzag & 0x1f;
+            zigzag >>= 5;
+            if (zigzag)
+                digit |= 0x20;
+            encoded.push_back(vlq_digits[digit]);
+        } while (zigzag);
+    }
+}
+
+
+// The pieces only depend on the input, so they can be encoded separately and joined.
+template <typename T>
+static std::string encodeDeltas(const T *values, size_t count, size_t components) {
+    size_t total = count * components;
+    size_t chunks = getDeltaChunks(total);
+
+    std::vector<std::string> pieces(chunks);
+
+    runInThreads(chunks, [&] (size_t chunk) {
+        size_t first = total * chunk / chunks;
+        size_t last = total * (chunk + 1) / chunks;
+
+        pieces[chunk].reserve((last - first) * 2);
+        encodeDeltaRange(values, first, last, components, pieces[chunk]);
+    });
+
+    if (chunks == 1)
+        return std::move(pieces[0]);
+
+    size_t length = 0;
+    for (const auto &piece : pieces)
+        length += piece.size();
+
+    std::string encoded;
+    encoded.reserve(length);
+
+    for (const auto &piece : pieces)
+        encoded += piece;
+
+    return encoded;
+}
+
+
+// Reads the digits of one value starting at pos. Fails if they are invalid or don't end before length.
+static bool readDelta(const char *encoded, size_t length, size_t &pos, int64_t &delta) {
+    uint64_t zigzag = 0;
+    int shift = 0;
+    int digit;
+
+    do {
+        if (pos == length || shift > 60)
+            return false;
+
+        digit = vlqDigitValue(encoded[pos++]);
+        if (digit < 0)
+            return false;
+
+        zigzag |= (uint64_t)(digit & 0x1f) << shift;
+        shift += 5;
+    } while (digit & 0x20);
+
+    delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+
+    return true;
+}
+
+
+// Decodes values first to last - 1 from encoded[begin] up to encoded[end], which must hold exactly those.
+// previous has the last value of each component before first, and is updated.
+template <typename T>
+static bool decodeDeltaRange(const char *encoded, size_t begin, size_t end, T *values, size_t first, size_t last, size_t components, int64_t *previous) {
+    size_t pos = begin;
+
+    for (size_t i = first; i < last; i++) {
+        int64_t delta;
+        if (!readDelta(encoded, end, pos, delta))
+            return false;
+
+        // Unsigned, because previous is garbage if an earlier piece was damaged.
+        int64_t value = (int64_t)((uint64_t)delta + (uint64_t)previous[i % components]);
+
+        if (value < std::numeric_limits<T>::min() || value > std::numeric_limits<T>::max())
+            return false;
+
+        values[i] = (T)value;
+        previous[i % components] = value;
+    }
+
+    return pos == end;
+}
+
+
+// Every value depends on the ones before it, so the pieces are read twice. The first pass
+// counts the values in each piece and adds up their deltas, which gives the values
+// preceding every piece. The second pass decodes the pieces with those.
+template <typename T>
+static bool decodeDeltas(const char *encoded, size_t length, T *values, size_t count, size_t components) {
+    size_t total = count * components;
+    size_t chunks = getDeltaChunks(total);
+
+    if (chunks == 1) {
+        std::vector<int64_t> previous(components, 0);
+
+        return decodeDeltaRange(encoded, 0, length, values, 0, total, components, previous.data());
+    }
+
+    // The pieces have to start at the beginning of a value, after a digit without 0x20.
+    std::vector<size_t> bounds(chunks + 1);
+    bounds[chunks] = length;
+
+    for (size_t chunk = 1; chunk < chunks; chunk++) {
+        size_t pos = std::max(length * chunk / chunks, bounds[chunk - 1]);
+
+        while (pos > 0 && pos < length) {
+            int digit = vlqDigitValue(encoded[pos - 1]);
+            if (digit < 0 || !(digit & 0x20))
+                break;
+            pos++;
+        }
+
+        bounds[chunk] = pos;
+    }
+
+    std::vector<size_t> counts(chunks, 0);
+    // Sums of the deltas, by position in the piece modulo components.
+    std::vector<std::vector<uint64_t> > sums(chunks, std::vector<uint64_t>(components, 0));
+    std::vector<int> results(chunks, 0);
+
+    runInThreads(chunks, [&] (size_t chunk) {
+        size_t pos = bounds[chunk];
+
+        while (pos < bounds[chunk + 1]) {
+            int64_t delta;
+            if (!readDelta(encoded, bounds[chunk + 1], pos, delta))
+                return;
+
+            sums[chunk][counts[chunk] % components] += (uint64_t)delta;
+            counts[chunk]++;
+        }
+
+        results[chunk] = 1;
+    });
+
+    size_t values_found = 0;
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        if (!results[chunk])
+            return false;
+
+        values_found += counts[chunk];
+    }
+
+    if (values_found != total)
+        return false;
+
+    std::vector<size_t> firsts(chunks, 0);
+    std::vector<std::vector<int64_t> > previous(chunks, std::vector<int64_t>(components, 0));
+
+    for (size_t chunk = 1; chunk < chunks; chunk++) {
+        firsts[chunk] = firsts[chunk - 1] + counts[chunk - 1];
+        previous[chunk] = previous[chunk - 1];
+
+        for (size_t i = 0; i < components; i++) {
+            int64_t &value = previous[chunk][(firsts[chunk - 1] + i) % components];
+            value = (int64_t)((uint64_t)value + sums[chunk - 1][i]);
+        }
+    }
+
+    runInThreads(chunks, [&] (size_t chunk) {
+        results[chunk] = decodeDeltaRange(encoded, bounds[chunk], bounds[chunk + 1], values, firsts[chunk], firsts[chunk] + counts[chunk], components, previous[chunk].data());
+    });
+
+    for (size_t chunk = 0; chunk < chunks; chunk++)
+        if (!results[chunk])
+            return false;
+
+    return true;
+}
+
+
+// The delta coded mics and metrics of a project, decoded separately from the rest of it.
+// A vector is empty if its key wasn't in the project.
+struct WobblyProject::DeferredMetrics {
+    std::string path;
+
+    std::string mics_text;
+    std::string mmetrics_text;
+    std::string vmetrics_text;
+    std::string decimate_metrics_text;
+
+    std::vector<std::array<int16_t, 5> > mics;
+    std::vector<std::array<int32_t, 2> > mmetrics;
+    std::vector<std::array<int32_t, 2> > vmetrics;
+    std::vector<int> decimate_metrics;
+
+    // Set by decode() if any of them are damaged.
+    std::string error;
+
+    bool isEmpty() const {
+        return mics.empty() && mmetrics.empty() && vmetrics.empty() && decimate_metrics.empty();
+    }
+
+    void decode() {
+        if (mics.size() && !decodeDeltas(mics_text.c_str(), mics_text.size(), mics[0].data(), mics.size(), 5))
+            error = path + ": JSON key '" + Keys::mics + "' must contain exactly " + std::to_string(mics.size() * 5) + " delta coded values.";
+        else if (mmetrics.size() && !decodeDeltas(mmetrics_text.c_str(), mmetrics_text.size(), mmetrics[0].data(), mmetrics.size(), 2))
+            error = path + ": JSON key '" + Keys::mmetrics + "' must contain exactly " + std::to_string(mmetrics.size() * 2) + " delta coded values.";
+        else if (vmetrics.size() && !decodeDeltas(vmetrics_text.c_str(), vmetrics_text.size(), vmetrics[0].data(), vmetrics.size(), 2))
+            error = path + ": JSON key '" + Keys::vmetrics + "' must contain exactly " + std::to_string(vmetrics.size() * 2) + " delta coded values.";
+        else if (decimate_metrics.size() && !decodeDeltas(decimate_metrics_text.c_str(), decimate_metrics_text.size(), decimate_metrics.data(), decimate_metrics.size(), 1))
+            error = path + ": JSON key '" + Keys::decimate_metrics + "' must contain exactly " + std::to_string(decimate_metrics.size()) + " delta coded values.";
+
+        std::string().swap(mics_text);
+        std::string().swap(mmetrics_text);
+        std::string().swap(vmetrics_text);
+        std::string().swap(decimate_metrics_text);
+    }
+};
+
+
+// Feeds a QFile to rapidjson's Reader in blocks, so the whole file never has to be in memory.
+// Works like rapidjson's FileReadStream.
+class ProjectFileStream {
+public:
+    typedef char Ch;
+
+    // gzip compressed files are recognised by their first two bytes.
+    explicit ProjectFileStream(QFile &_file)
+        : file(_file)
+        , buffer(1 << 16)
+        , read_count(0)
+        , count(0)
+        , current(buffer.data())
+        , last(nullptr)
+        , eof(false)
+        , error(false)
+        , compressed(false)
+        , stream_end(false)
+    {
+        QByteArray magic = file.peek(2);
+
+        if (magic.size() == 2 && (uchar)magic[0] == 0x1f && (uchar)magic[1] == 0x8b) {
+            compressed = true;
+            input.resize(1 << 16);
+
+            zstream.zalloc = Z_NULL;
+            zstream.zfree = Z_NULL;
+            zstream.opaque = Z_NULL;
+            zstream.next_in = Z_NULL;
+            zstream.avail_in = 0;
+
+            // 15 + 16: gzip header, largest window.
+            if (inflateInit2(&zstream, 15 + 16) != Z_OK) {
+                compressed = false;
+                error = true;
+                error_message = "zlib initialisation failed.";
+                eof = true;
+            }
+        }
+
+        read();
+    }
+
+    ~ProjectFileStream() {
+        if (compressed)
+            inflateEnd(&zstream);
+    }
+
+    Ch Peek() const {
+        return *current;
+    }
+
+    Ch Take() {
+        Ch c = *current;
+        read();
+        return c;
+    }
+
+    size_t Tell() const {
+        return count + (current - buffer.data());
+    }
+
+    // Only needed to satisfy the Stream concept.
+    void Put(Ch) { RAPIDJSON_ASSERT(false); }
+    void Flush() { RAPIDJSON_ASSERT(false); }
+    Ch *PutBegin() { RAPIDJSON_ASSERT(false); return nullptr; }
+    size_t PutEnd(Ch *) { RAPIDJSON_ASSERT(false); return 0; }
+
+    bool hasError() const {
+        return error;
+    }
+
+    std::string errorString() const {
+        return error_message.size() ? error_message : file.errorString().toStdString();
+    }
+
+private:
+    QFile &file;
+    std::vector<char> buffer;
+    size_t read_count;
+    size_t count;
+    char *current;
+    char *last;
+    bool eof;
+    bool error;
+
+    bool compressed;
+    bool stream_end;
+    z_stream zstream;
+    std::vector<char> input;
+    std::string error_message;
+
+    // Decompresses straight into the parser's buffer.
+    qint64 inflateBlock(char *data, qint64 size) {
+        zstream.next_out = (Bytef *)data;
+        zstream.avail_out = (uInt)size;
+
+        while (zstream.avail_out && !stream_end) {
+            if (!zstream.avail_in) {
+                qint64 result = file.read(input.data(), input.size());
+                if (result < 0)
+                    return -1;
+
+                if (result == 0) {
+                    error_message = "the compressed data ends too early.";
+                    return -1;
+                }
+
+                zstream.next_in = (Bytef *)input.data();
+                zstream.avail_in = (uInt)result;
+            }
+
+            int ret = inflate(&zstream, Z_NO_FLUSH);
+
+            if (ret == Z_STREAM_END) {
+                stream_end = true;
+            } else if (ret != Z_OK) {
+                error_message = std::string("the compressed data is damaged: ") + (zstream.msg ? zstream.msg : "unknown zlib error") + ".";
+                return -1;
+            }
+        }
+
+        return size - zstream.avail_out;
+    }
+
+    void read() {
+        if (current < last) {
+            current++;
+        } else if (!eof) {
+            count += read_count;
+
+            // One byte is kept for the terminating 0.
+            qint64 result;
+            if (compressed)
+                result = inflateBlock(buffer.data(), buffer.size() - 1);
+            else
+                result = file.read(buffer.data(), buffer.size() - 1);
+
+            if (result < 0) {
+                error = true;
+                result = 0;
+            }
+
+            read_count = result;
+            current = buffer.data();
+            last = current + read_count - 1;
+
+            if (read_count < buffer.size() - 1) {
+                buffer[read_count] = 0;
+                last++;
+                eof = true;
+            }
+        }
+    }
+};
+
+
+// Receives a project from rapidjson's Reader. The per-frame data goes straight into vectors
+// as the tokens arrive. Everything else is small, and becomes a regular DOM.
+// Problems with the per-frame data are only noted here, because checking it needs the
+// number of frames, which comes from the trims. readProject reports them.
+// The values of skipped keys are dropped as they are tokenised, without being stored anywhere.
+class ProjectHandler : public rj::BaseReaderHandler<rj::UTF8<>, ProjectHandler> {
+public:
+    enum PerFrameKey {
+        NoKey = -1,
+        MicsKey,
+        MMetricsKey,
+        VMetricsKey,
+        MatchesKey,
+        OriginalMatchesKey,
+        CombedFramesKey,
+        DecimatedFramesKey,
+        DecimateMetricsKey,
+        PerFrameKeyCount
+    };
+
+    enum CaptureType {
+        CaptureMissing,
+        CaptureString,
+        CaptureArray,
+        CaptureOther
+    };
+
+    struct Capture {
+        CaptureType type;
+        // Number of elements, if it's an array.
+        size_t elements;
+        // First element with the wrong type, or -1.
+        int64_t bad_element;
+        // The elements are arrays (ranges and runs in format version 4) instead of integers.
+        bool nested;
+        // The value, if it's a string.
+        std::string text;
+    };
+
+    Capture captures[PerFrameKeyCount];
+
+    std::vector<std::array<int16_t, 5> > mics;
+    std::vector<std::array<int32_t, 2> > mmetrics;
+    std::vector<std::array<int32_t, 2> > vmetrics;
+    std::vector<char> matches;
+    std::vector<char> original_matches;
+    // Frame numbers, or pairs of numbers for the ranges and the runs.
+    std::vector<int> combed_frames;
+    std::vector<int> decimated_frames;
+    std::vector<int> decimate_metrics;
+    // Five characters per run.
+    std::string decimation_patterns;
+
+    explicit ProjectHandler(rj::Document &_document)
+        : document(_document)
+        , allocator(_document.GetAllocator())
+        , values(rj::kArrayType)
+        , depth(0)
+        , pending(NoKey)
+        , active(NoKey)
+        , element_is_array(false)
+        , item_int_count(0)
+        , skip_pending(false)
+        , skip_depth(0)
+    {
+        for (int i = 0; i < PerFrameKeyCount; i++)
+            resetCapture((PerFrameKey)i);
+    }
+
+    // Only keys of the root object can be skipped.
+    void skipKey(const char *key) {
+        skipped_keys.push_back(key);
+    }
+
+    bool Null() { rj::Value v; return addValue(v); }
+    bool Bool(bool b) { rj::Value v(b); return addValue(v); }
+    bool Int(int i) { rj::Value v(i); return addValue(v); }
+    bool Uint(unsigned u) { rj::Value v(u); return addValue(v); }
+    bool Int64(int64_t i) { rj::Value v(i); return addValue(v); }
+    bool Uint64(uint64_t u) { rj::Value v(u); return addValue(v); }
+    bool Double(double d) { rj::Value v(d); return addValue(v); }
+
+    bool String(const char *str, rj::SizeType length, bool) {
+        if (skipToken())
+            return true;
+
+        if (pending != NoKey) {
+            captures[pending].type = CaptureString;
+            captures[pending].text.assign(str, length);
+            pending = NoKey;
+            return true;
+        }
+
+        if (active != NoKey) {
+            captureString(str, length);
+            return true;
+        }
+
+        rj::Value v(str, length, allocator);
+        return addValue(v);
+    }
+
+    bool Key(const char *str, rj::SizeType length, bool) {
+        // Objects inside the per-frame data are already wrong.
+        if (active != NoKey || skip_depth)
+            return true;
+
+        if (depth == 1) {
+            for (const auto &skipped : skipped_keys) {
+                if (skipped.size() == length && !memcmp(skipped.c_str(), str, length)) {
+                    skip_pending = true;
+                    return true;
+                }
+            }
+
+            PerFrameKey key = findPerFrameKey(str, length);
+
+            if (key != NoKey) {
+                resetCapture(key);
+                pending = key;
+                return true;
+            }
+        }
+
+        rj::Value v(str, length, allocator);
+        values.PushBack(v, allocator);
+        return true;
+    }
+
+    bool StartObject() {
+        return startContainer(false);
+    }
+
+    bool EndObject(rj::SizeType) {
+        return endContainer();
+    }
+
+    bool StartArray() {
+        return startContainer(true);
+    }
+
+    bool EndArray(rj::SizeType) {
+        return endContainer();
+    }
+
+    // Moves the root value into the document. Call after a successful parse.
+    void finish() {
+        if (values.Size())
+            static_cast<rj::Value &>(document).Swap(values[0]);
+    }
+
+private:
+    rj::Document &document;
+    rj::Document::AllocatorType &allocator;
+
+    // Values of the containers being built, and their contents.
+    rj::Value values;
+    // Where the contents of each open container start in values.
+    std::vector<rj::SizeType> starts;
+
+    int depth;
+
+    // The next value belongs to this key.
+    PerFrameKey pending;
+    // Currently inside the array of this key.
+    PerFrameKey active;
+
+    // The current element of the active key, if it's an array.
+    bool element_is_array;
+    std::string item_types;
+    int item_ints[5];
+    int item_int_count;
+    std::string item_string;
+
+    std::vector<std::string> skipped_keys;
+    // The next value belongs to a skipped key.
+    bool skip_pending;
+    // Number of containers open inside the value of a skipped key.
+    int skip_depth;
+
+    // Consumes the token if it belongs to the value of a skipped key.
+    bool skipToken() {
+        if (skip_pending) {
+            skip_pending = false;
+            return true;
+        }
+
+        return skip_depth > 0;
+    }
+
+    static PerFrameKey findPerFrameKey(const char *str, rj::SizeType length) {
+        static const char *keys[PerFrameKeyCount] = {
+            Keys::mics,
+            Keys::mmetrics,
+            Keys::vmetrics,
+            Keys::matches,
+            Keys::original_matches,
+            Keys::combed_frames,
+            Keys::decimated_frames,
+            Keys::decimate_metrics
+        };
+
+        for (int i = 0; i < PerFrameKeyCount; i++)
+            if (strlen(keys[i]) == length && !memcmp(keys[i], str, length))
+                return (PerFrameKey)i;
+
+        return NoKey;
+    }
+
+    void resetCapture(PerFrameKey key) {
+        Capture &c = captures[key];
+        c.type = CaptureMissing;
+        c.elements = 0;
+        c.bad_element = -1;
+        c.nested = false;
+        c.text.clear();
+
+        if (key == MicsKey)
+            mics.clear();
+        else if (key == MMetricsKey)
+            mmetrics.clear();
+        else if (key == VMetricsKey)
+            vmetrics.clear();
+        else if (key == MatchesKey)
+            matches.clear();
+        else if (key == OriginalMatchesKey)
+            original_matches.clear();
+        else if (key == CombedFramesKey)
+            combed_frames.clear();
+        else if (key == DecimatedFramesKey) {
+            decimated_frames.clear();
+            decimation_patterns.clear();
+        } else if (key == DecimateMetricsKey)
+            decimate_metrics.clear();
+    }
+
+    // No valid element has more than five items.
+    void addItemType(char type) {
+        if (item_types.size() < 6)
+            item_types.push_back(type);
+    }
+
+    void markBadElement() {
+        Capture &c = captures[active];
+
+        if (c.bad_element < 0)
+            c.bad_element = c.elements - 1;
+    }
+
+    // Level 1 is directly inside the array of the active key, level 2 is inside one of its elements.
+    int getLevel() const {
+        return depth - 1;
+    }
+
+    bool addValue(rj::Value &v) {
+        if (skipToken())
+            return true;
+
+        if (pending != NoKey) {
+            captures[pending].type = CaptureOther;
+            pending = NoKey;
+            return true;
+        }
+
+        if (active != NoKey) {
+            captureValue(v);
+            return true;
+        }
+
+        values.PushBack(v, allocator);
+        return true;
+    }
+
+    void captureValue(const rj::Value &v) {
+        Capture &c = captures[active];
+
+        if (getLevel() == 1) {
+            c.elements++;
+
+            if (c.nested || !v.IsInt()) {
+                markBadElement();
+                return;
+            }
+
+            if (active == CombedFramesKey)
+                combed_frames.push_back(v.GetInt());
+            else if (active == DecimatedFramesKey)
+                decimated_frames.push_back(v.GetInt());
+            else if (active == DecimateMetricsKey)
+                decimate_metrics.push_back(v.GetInt());
+            else
+                markBadElement();
+        } else if (getLevel() == 2 && element_is_array) {
+            if (v.IsInt() && item_int_count < 5) {
+                item_ints[item_int_count++] = v.GetInt();
+                addItemType('i');
+            } else {
+                addItemType('x');
+            }
+        }
+    }
+
+    void captureString(const char *str, rj::SizeType length) {
+        Capture &c = captures[active];
+
+        if (getLevel() == 1) {
+            c.elements++;
+
+            if (length != 1)
+                markBadElement();
+            else if (active == MatchesKey)
+                matches.push_back(str[0]);
+            else if (active == OriginalMatchesKey)
+                original_matches.push_back(str[0]);
+            else
+                markBadElement();
+        } else if (getLevel() == 2 && element_is_array) {
+            item_string.assign(str, length);
+            addItemType('s');
+        }
+    }
+
+    bool startContainer(bool is_array) {
+        if (skip_pending || skip_depth) {
+            skip_pending = false;
+            skip_depth++;
+            return true;
+        }
+
+        if (pending != NoKey) {
+            captures[pending].type = is_array ? CaptureArray : CaptureOther;
+            active = pending;
+            pending = NoKey;
+            depth++;
+            return true;
+        }
+
+        if (active != NoKey) {
+            Capture &c = captures[active];
+
+            if (getLevel() == 1) {
+                c.elements++;
+
+                element_is_array = is_array;
+                item_types.clear();
+                item_int_count = 0;
+                item_string.clear();
+
+                if (!is_array)
+                    markBadElement();
+                else if (c.elements == 1)
+                    c.nested = true;
+                else if (!c.nested)
+                    markBadElement();
+            } else if (getLevel() == 2) {
+                addItemType('x');
+            }
+
+            depth++;
+            return true;
+        }
+
+        rj::Value v(is_array ? rj::kArrayType : rj::kObjectType);
+        values.PushBack(v, allocator);
+        starts.push_back(values.Size());
+        depth++;
+        return true;
+    }
+
+    bool endContainer() {
+        if (skip_depth) {
+            skip_depth--;
+            return true;
+        }
+
+        depth--;
+
+        if (active != NoKey) {
+            if (getLevel() == 1 && element_is_array)
+                finishElement();
+            else if (depth == 1)
+                active = NoKey;
+
+            return true;
+        }
+
+        rj::SizeType start = starts.back();
+        starts.pop_back();
+
+        rj::Value &container = values[start - 1];
+
+        if (container.IsObject()) {
+            for (rj::SizeType i = start; i + 1 < values.Size(); i += 2)
+                container.AddMember(values[i], values[i + 1], allocator);
+        } else {
+            for (rj::SizeType i = start; i < values.Size(); i++)
+                container.PushBack(values[i], allocator);
+        }
+
+        while (values.Size() > start)
+            values.PopBack();
+
+        return true;
+    }
+
+    void finishElement() {
+        element_is_array = false;
+
+        if (!captures[active].nested)
+            return;
+
+        if (active == MicsKey && item_types == "iiiii")
+            mics.push_back({ { (int16_t)item_ints[0], (int16_t)item_ints[1], (int16_t)item_ints[2], (int16_t)item_ints[3], (int16_t)item_ints[4] } });
+        else if (active == MMetricsKey && item_types == "ii")
+            mmetrics.push_back({ { item_ints[0], item_ints[1] } });
+        else if (active == VMetricsKey && item_types == "ii")
+            vmetrics.push_back({ { item_ints[0], item_ints[1] } });
+        else if (active == CombedFramesKey && item_types == "ii") {
+            combed_frames.push_back(item_ints[0]);
+            combed_frames.push_back(item_ints[1]);
+        } else if (active == DecimatedFramesKey && item_types == "isi" && item_string.size() == 5) {
+            decimated_frames.push_back(item_ints[0]);
+            decimated_frames.push_back(item_ints[1]);
+            decimation_patterns += item_string;
+        } else {
+            markBadElement();
+        }
+    }
+};
+
+
+typedef rj::Writer<rj::StringBuffer> JournalWriter;
+
+
+static void writeJournalArgument(JournalWriter &writer, int value) {
+    writer.Int(value);
+}
+
+
+static void writeJournalArgument(JournalWriter &writer, size_t value) {
+    writer.Uint64(value);
+}
+
+
+static void writeJournalArgument(JournalWriter &writer, bool value) {
+    writer.Bool(value);
+}
+
+
+static void writeJournalArgument(JournalWriter &writer, char value) {
+    writer.String(&value, 1);
+}
+
+
+static void writeJournalArgument(JournalWriter &writer, const std::string &value) {
+    writer.String(value);
+}
+
+
+static void writeJournalArgument(JournalWriter &writer, const std::vector<int> &values) {
+    writer.StartArray();
+    for (size_t i = 0; i < values.size(); i++)
+        writer.Int(values[i]);
+    writer.EndArray();
+}
+
+
+static void writeJournalArgument(JournalWriter &writer, const ImportedThings &imports) {
+    writer.StartArray();
+    writer.Bool(imports.geometry);
+    writer.Bool(imports.presets);
+    writer.Bool(imports.custom_lists);
+    writer.Bool(imports.crop);
+    writer.Bool(imports.resize);
+    writer.Bool(imports.bit_depth);
+    writer.Bool(imports.mic_search);
+    writer.Bool(imports.zoom);
+    writer.EndArray();
+}
+
+
+static void writeJournalArguments(JournalWriter &) {
+
+}
+
+
+template <typename T, typename... Args>
+static void writeJournalArguments(JournalWriter &writer, const T &value, const Args &... args) {
+    writeJournalArgument(writer, value);
+    writeJournalArguments(writer, args...);
+}
+
+
+// Records one call to a mutator in the journal, once it has returned without
+// throwing. The mutators called by other mutators are part of the outer call,
+// so only the outermost one gets recorded.
+class WobblyProject::JournalScope {
+public:
+    template <typename... Args>
+    JournalScope(WobblyProject *_project, const char *operation, const Args &... args)
+        : project(_project)
+        , outermost(project->journal_depth++ == 0)
+    {
+        if (!outermost || !project->journal)
+            return;
+
+        JournalWriter writer(record);
+        writer.StartArray();
+        writer.String(operation);
+        writeJournalArguments(writer, args...);
+        writer.EndArray();
+    }
+
+    ~JournalScope() {
+        project->journal_depth--;
+
+        if (outermost && project->journal && !std::uncaught_exception())
+            project->recordMutation(std::string(record.GetString(), record.GetSize()));
+    }
+
+private:
+    WobblyProject *project;
+    bool outermost;
+    rj::StringBuffer record;
+};
+
+
+// Reads the arguments of a journal record: [operation, arguments...].
+class JournalArguments {
+public:
+    JournalArguments(const rj::Value &_record)
+        : record(_record)
+        , operation(_record[0].GetString())
+    { }
+
+    const std::string &getOperation() const {
+        return operation;
+    }
+
+    void expect(rj::SizeType count) const {
+        if (record.Size() != count + 1)
+            throw WobblyException("Journal record '" + operation + "' must have exactly " + std::to_string(count) + " arguments.");
+    }
+
+    int getInt(rj::SizeType index) const {
+        const rj::Value &value = get(index);
+        if (!value.IsInt())
+            throw invalid(index, "an integer");
+        return value.GetInt();
+    }
+
+    size_t getSize(rj::SizeType index) const {
+        const rj::Value &value = get(index);
+        if (!value.IsUint64())
+            throw invalid(index, "an unsigned integer");
+        return (size_t)value.GetUint64();
+    }
+
+    bool getBool(rj::SizeType index) const {
+        const rj::Value &value = get(index);
+        if (!value.IsBool())
+            throw invalid(index, "a boolean");
+        return value.GetBool();
+    }
+
+    std::string getString(rj::SizeType index) const {
+        const rj::Value &value = get(index);
+        if (!value.IsString())
+            throw invalid(index, "a string");
+        return std::string(value.GetString(), value.GetStringLength());
+    }
+
+    char getChar(rj::SizeType index) const {
+        const rj::Value &value = get(index);
+        if (!value.IsString() || value.GetStringLength() != 1)
+            throw invalid(index, "a string with one character");
+        return value.GetString()[0];
+    }
+
+    std::vector<int> getInts(rj::SizeType index) const {
+        const rj::Value &value = get(index);
+        if (!value.IsArray())
+            throw invalid(index, "an array of integers");
+
+        std::vector<int> values;
+        values.reserve(value.Size());
+        for (rj::SizeType i = 0; i < value.Size(); i++) {
+            if (!value[i].IsInt())
+                throw invalid(index, "an array of integers");
+            values.push_back(value[i].GetInt());
+        }
+
+        return values;
+    }
+
+    ImportedThings getImports(rj::SizeType index) const {
+        const rj::Value &value = get(index);
+        if (!value.IsArray() || value.Size() != 8)
+            throw invalid(index, "an array of 8 booleans");
+
+        for (rj::SizeType i = 0; i < value.Size(); i++)
+            if (!value[i].IsBool())
+                throw invalid(index, "an array of 8 booleans");
+
+        ImportedThings imports;
+        imports.geometry = value[0].GetBool();
+        imports.presets = value[1].GetBool();
+        imports.custom_lists = value[2].GetBool();
+        imports.crop = value[3].GetBool();
+        imports.resize = value[4].GetBool();
+        imports.bit_depth = value[5].GetBool();
+        imports.mic_search = value[6].GetBool();
+        imports.zoom = value[7].GetBool();
+
+        return imports;
+    }
+
+private:
+    const rj::Value &record;
+    std::string operation;
+
+    const rj::Value &get(rj::SizeType index) const {
+        if (index + 1 >= record.Size())
+            throw WobblyException("Journal record '" + operation + "' has too few arguments.");
+
+        return record[index + 1];
+    }
+
+    WobblyException invalid(rj::SizeType index, const std::string &expected) const {
+        return WobblyException("Argument number " + std::to_string(index) + " of journal record '" + operation + "' must be " + expected + ".");
+    }
+};
+
+
+// Repeats one recorded call. Everything it calls is public, so replaying
+// goes through the same checks as the original edit did.
+static void applyJournalRecord(WobblyProject *project, const rj::Value &record) {
+    JournalArguments args(record);
+    const std::string &operation = args.getOperation();
+
+    if (operation == "addFreezeFrame") {
+        args.expect(3);
+        project->addFreezeFrame(args.getInt(0), args.getInt(1), args.getInt(2));
+    } else if (operation == "deleteFreezeFrame") {
+        args.expect(1);
+        project->deleteFreezeFrame(args.getInt(0));
+    } else if (operation == "addPreset") {
+        if (record.Size() == 2)
+            project->addPreset(args.getString(0));
+        else {
+            args.expect(2);
+            project->addPreset(args.getString(0), args.getString(1));
+        }
+    } else if (operation == "renamePreset") {
+        args.expect(2);
+        project->renamePreset(args.getString(0), args.getString(1));
+    } else if (operation == "deletePreset") {
+        args.expect(1);
+        project->deletePreset(args.getString(0));
+    } else if (operation == "setPresetContents") {
+        args.expect(2);
+        project->setPresetContents(args.getString(0), args.getString(1));
+    } else if (operation == "setMatch") {
+        args.expect(2);
+        project->setMatch(args.getInt(0), args.getChar(1));
+    } else if (operation == "cycleMatchBCN") {
+        args.expect(1);
+        project->cycleMatchBCN(args.getInt(0));
+    } else if (operation == "cycleMatch") {
+        args.expect(1);
+        project->cycleMatch(args.getInt(0));
+    } else if (operation == "addSection") {
+        args.expect(1);
+        project->addSection(args.getInt(0));
+    } else if (operation == "addSections") {
+        args.expect(1);
+        project->addSections(args.getInts(0));
+    } else if (operation == "deleteSection") {
+        args.expect(1);
+        project->deleteSection(args.getInt(0));
+    } else if (operation == "setSectionPreset") {
+        args.expect(2);
+        project->setSectionPreset(args.getInt(0), args.getString(1));
+    } else if (operation == "deleteSectionPreset") {
+        args.expect(2);
+        project->deleteSectionPreset(args.getInt(0), args.getSize(1));
+    } else if (operation == "moveSectionPresetUp") {
+        args.expect(2);
+        project->moveSectionPresetUp(args.getInt(0), args.getSize(1));
+    } else if (operation == "moveSectionPresetDown") {
+        args.expect(2);
+        project->moveSectionPresetDown(args.getInt(0), args.getSize(1));
+    } else if (operation == "setSectionMatchesFromPattern") {
+        args.expect(2);
+        project->setSectionMatchesFromPattern(args.getInt(0), args.getString(1));
+    } else if (operation == "setSectionDecimationFromPattern") {
+        args.expect(2);
+        project->setSectionDecimationFromPattern(args.getInt(0), args.getString(1));
+    } else if (operation == "setRangeMatchesFromPattern") {
+        args.expect(3);
+        project->setRangeMatchesFromPattern(args.getInt(0), args.getInt(1), args.getString(2));
+    } else if (operation == "setRangeDecimationFromPattern") {
+        args.expect(3);
+        project->setRangeDecimationFromPattern(args.getInt(0), args.getInt(1), args.getString(2));
+    } else if (operation == "resetRangeMatches") {
+        args.expect(2);
+        project->resetRangeMatches(args.getInt(0), args.getInt(1));
+    } else if (operation == "resetSectionMatches") {
+        args.expect(1);
+        project->resetSectionMatches(args.getInt(0));
+    } else if (operation == "addCustomList") {
+        args.expect(1);
+        project->addCustomList(args.getString(0));
+    } else if (operation == "renameCustomList") {
+        args.expect(2);
+        project->renameCustomList(args.getString(0), args.getString(1));
+    } else if (operation == "deleteCustomList") {
+        args.expect(1);
+        if (record[1].IsString())
+            project->deleteCustomList(args.getString(0));
+        else
+            project->deleteCustomList(args.getInt(0));
+    } else if (operation == "moveCustomListUp") {
+        args.expect(1);
+        project->moveCustomListUp(args.getInt(0));
+    } else if (operation == "moveCustomListDown") {
+        args.expect(1);
+        project->moveCustomListDown(args.getInt(0));
+    } else if (operation == "setCustomListPreset") {
+        args.expect(2);
+        project->setCustomListPreset(args.getInt(0), args.getString(1));
+    } else if (operation == "setCustomListPosition") {
+        args.expect(2);
+        project->setCustomListPosition(args.getInt(0), (PositionInFilterChain)args.getInt(1));
+    } else if (operation == "addCustomListRange") {
+        args.expect(3);
+        project->addCustomListRange(args.getInt(0), args.getInt(1), args.getInt(2));
+    } else if (operation == "deleteCustomListRange") {
+        args.expect(2);
+        project->deleteCustomListRange(args.getInt(0), args.getInt(1));
+    } else if (operation == "addDecimatedFrame") {
+        args.expect(1);
+        project->addDecimatedFrame(args.getInt(0));
+    } else if (operation == "addDecimatedFrames") {
+        args.expect(1);
+        project->addDecimatedFrames(args.getInts(0));
+    } else if (operation == "deleteDecimatedFrame") {
+        args.expect(1);
+        project->deleteDecimatedFrame(args.getInt(0));
+    } else if (operation == "clearDecimatedFramesFromCycle") {
+        args.expect(1);
+        project->clearDecimatedFramesFromCycle(args.getInt(0));
+    } else if (operation == "addCombedFrame") {
+        args.expect(1);
+        project->addCombedFrame(args.getInt(0));
+    } else if (operation == "addCombedFrames") {
+        args.expect(1);
+        project->addCombedFrames(args.getInts(0));
+    } else if (operation == "deleteCombedFrame") {
+        args.expect(1);
+        project->deleteCombedFrame(args.getInt(0));
+    } else if (operation == "clearCombedFrames") {
+        args.expect(0);
+        project->clearCombedFrames();
+    } else if (operation == "setResize") {
+        args.expect(3);
+        project->setResize(args.getInt(0), args.getInt(1), args.getString(2));
+    } else if (operation == "setResizeEnabled") {
+        args.expect(1);
+        project->setResizeEnabled(args.getBool(0));
+    } else if (operation == "setCrop") {
+        args.expect(4);
+        project->setCrop(args.getInt(0), args.getInt(1), args.getInt(2), args.getInt(3));
+    } else if (operation == "setCropEnabled") {
+        args.expect(1);
+        project->setCropEnabled(args.getBool(0));
+    } else if (operation == "setCropEarly") {
+        args.expect(1);
+        project->setCropEarly(args.getBool(0));
+    } else if (operation == "setBitDepth") {
+        args.expect(3);
+        project->setBitDepth(args.getInt(0), args.getBool(1), args.getString(2));
+    } else if (operation == "setBitDepthEnabled") {
+        args.expect(1);
+        project->setBitDepthEnabled(args.getBool(0));
+    } else if (operation == "setFreezeFramesWanted") {
+        args.expect(1);
+        project->setFreezeFramesWanted(args.getBool(0));
+    } else if (operation == "guessSectionPatternsFromMics") {
+        args.expect(4);
+        project->guessSectionPatternsFromMics(args.getInt(0), args.getInt(1), args.getInt(2), args.getInt(3));
+    } else if (operation == "guessProjectPatternsFromMics") {
+        args.expect(3);
+        project->guessProjectPatternsFromMics(args.getInt(0), args.getInt(1), args.getInt(2));
+    } else if (operation == "guessSectionPatternsFromMatches") {
+        args.expect(4);
+        project->guessSectionPatternsFromMatches(args.getInt(0), args.getInt(1), args.getInt(2), args.getInt(3));
+    } else if (operation == "guessProjectPatternsFromMatches") {
+        args.expect(3);
+        project->guessProjectPatternsFromMatches(args.getInt(0), args.getInt(1), args.getInt(2));
+    } else if (operation == "addBookmark") {
+        args.expect(2);
+        project->addBookmark(args.getInt(0), args.getString(1));
+    } else if (operation == "deleteBookmark") {
+        args.expect(1);
+        project->deleteBookmark(args.getInt(0));
+    } else if (operation == "setBookmarkDescription") {
+        args.expect(2);
+        project->deleteBookmark(args.getInt(0));
+        project->addBookmark(args.getInt(0), args.getString(1));
+    } else if (operation == "importFromOtherProject") {
+        args.expect(2);
+        project->importFromOtherProject(args.getString(0), args.getImports(1));
+    } else {
+        throw WobblyException("Unknown journal record '" + operation + "'.");
+    }
 }
 
 
@@ -166,12 +1452,27 @@ WobblyProject::WobblyProject(bool _is_wobbly)
     , sections(new SectionsModel(this))
     , bookmarks(new BookmarksModel(this))
 {
-    connect(bookmarks, &BookmarksModel::dataChanged, [this] () {
+    connect(bookmarks, &BookmarksModel::dataChanged, [this] (const QModelIndex &topLeft, const QModelIndex &bottomRight) {
+        // The descriptions are edited through the model, not through WobblyProject.
+        for (int row = topLeft.row(); row <= bottomRight.row(); row++) {
+            const Bookmark &bookmark = bookmarks->atRow(row)->second;
+
+            JournalScope journal_scope(this, "setBookmarkDescription", bookmark.frame, bookmark.description);
+        }
+
         setModified(true);
     });
 }
 
 
+WobblyProject::~WobblyProject() {
+    if (metrics_thread.joinable())
+        metrics_thread.join();
+
+    stopJournal();
+}
+
+
 WobblyProject::WobblyProject(bool _is_wobbly, const std::string &_input_file, const std::string &_source_filter, int64_t _fps_num, int64_t _fps_den, int _width, int _height, int _num_frames)
     : WobblyProject(_is_wobbly)
 {
@@ -186,7 +1487,7 @@ WobblyProject::WobblyProject(bool _is_wobbly, const std::string &_input_file, co
 
     // XXX What happens when the video happens to be bottom field first?
     vfm_parameters.insert({ "order", 1 });
-    decimated_frames.resize((_num_frames - 1) / 5 + 1);
+    resetDecimatedFrames((_num_frames - 1) / 5 + 1);
     addSection(0);
     resize.width = _width;
     resize.height = _height;
@@ -195,6 +1496,83 @@ WobblyProject::WobblyProject(bool _is_wobbly, const std::string &_input_file, co
 }
 
 
+WobblyProject *WobblyProject::createSnapshot() const {
+    if (!areMetricsLoaded())
+        throw WobblyException("Can't take a snapshot of the project while its metrics are still loading.");
+
+    WobblyProject *snapshot = new WobblyProject(is_wobbly);
+
+    snapshot->num_frames[0] = num_frames[0];
+    snapshot->num_frames[1] = num_frames[1];
+    snapshot->fps_num = fps_num;
+    snapshot->fps_den = fps_den;
+    snapshot->width = width;
+    snapshot->height = height;
+    snapshot->zoom = zoom;
+    snapshot->last_visited_frame = last_visited_frame;
+    snapshot->ui_state = ui_state;
+    snapshot->ui_geometry = ui_geometry;
+    snapshot->shown_frame_rates = shown_frame_rates;
+    snapshot->mic_search_minimum = mic_search_minimum;
+    snapshot->c_match_sequences_minimum = c_match_sequences_minimum;
+    snapshot->input_file = input_file;
+    snapshot->trims = trims;
+    snapshot->vfm_parameters = vfm_parameters;
+    snapshot->vdecimate_parameters = vdecimate_parameters;
+    snapshot->mics = mics;
+    snapshot->mmetrics = mmetrics;
+    snapshot->vmetrics = vmetrics;
+    snapshot->matches = matches;
+    snapshot->original_matches = original_matches;
+    snapshot->decimated_frames = decimated_frames;
+    snapshot->decimation_index = decimation_index;
+    snapshot->decimate_metrics = decimate_metrics;
+    snapshot->pattern_guessing = pattern_guessing;
+    snapshot->interlaced_fades = interlaced_fades;
+    snapshot->dmetrics = dmetrics;
+    snapshot->resize = resize;
+    snapshot->crop = crop;
+    snapshot->depth = depth;
+    snapshot->source_filter = source_filter;
+    snapshot->freeze_frames_wanted = freeze_frames_wanted;
+
+    snapshot->combed_frames->insert(std::vector<int>(combed_frames->cbegin(), combed_frames->cend()));
+
+    for (auto it = frozen_frames->cbegin(); it != frozen_frames->cend(); it++)
+        snapshot->frozen_frames->insert(*it);
+
+    for (auto it = presets->cbegin(); it != presets->cend(); it++)
+        snapshot->presets->insert(*it);
+
+    // The ranges are shared_ptrs, so each list needs its own copy.
+    for (auto it = custom_lists->cbegin(); it != custom_lists->cend(); it++) {
+        CustomList list(it->name, it->preset, it->position);
+
+        for (auto range = it->ranges->cbegin(); range != it->ranges->cend(); range++)
+            list.ranges->insert(*range);
+
+        snapshot->custom_lists->push_back(list);
+    }
+
+    snapshot->rebuildCustomListIndex();
+
+    for (auto it = sections->cbegin(); it != sections->cend(); it++)
+        snapshot->sections->insert(*it);
+
+    for (auto it = bookmarks->cbegin(); it != bookmarks->cend(); it++)
+        snapshot->bookmarks->insert(*it);
+
+    // The snapshot itself doesn't keep a journal, but the project file needs to know which edits it contains.
+    if (journal)
+        snapshot->journal_id = journal_id;
+    snapshot->journal_sequence = journal_sequence;
+
+    snapshot->is_modified = is_modified;
+
+    return snapshot;
+}
+
+
 int WobblyProject::getNumFrames(PositionInFilterChain position) const {
     if (position == PostSource)
         return num_frames[0];
@@ -220,71 +1598,201 @@ void WobblyProject::setNumFrames(PositionInFilterChain position, int frames) {
 }
 
 
-void WobblyProject::writeProject(const std::string &path, bool compact_project) {
-    QFile file(QString::fromStdString(path));
+// Collects rapidjson's output and writes it to a QFile in blocks.
+class ProjectFileWriteStream {
+public:
+    typedef char Ch;
+
+    explicit ProjectFileWriteStream(QFileDevice &_file, bool _compress)
+        : file(_file)
+        , buffer(1 << 16)
+        , current(buffer.data())
+        , end(buffer.data() + buffer.size())
+        , error(false)
+        , compress(_compress)
+    {
+        if (compress) {
+            output.resize(1 << 16);
+
+            zstream.zalloc = Z_NULL;
+            zstream.zfree = Z_NULL;
+            zstream.opaque = Z_NULL;
+
+            // 15 + 16: gzip header, largest window.
+            if (deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                compress = false;
+                error = true;
+                error_message = "zlib initialisation failed.";
+            }
+        }
+    }
 
-    if (!file.open(QIODevice::WriteOnly))
-        throw WobblyException("Couldn't open project file '" + path + "'. Error message: " + file.errorString().toStdString());
+    ~ProjectFileWriteStream() {
+        if (compress)
+            deflateEnd(&zstream);
+    }
 
-    rj::Document json_project(rj::kObjectType);
+    void Put(Ch c) {
+        if (current == end)
+            Flush();
 
-    rj::Document::AllocatorType &a = json_project.GetAllocator();
+        *current++ = c;
+    }
 
-    json_project.AddMember(Keys::wobbly_version, std::atoi(PACKAGE_VERSION), a);
+    void Flush() {
+        qint64 size = current - buffer.data();
 
+        if (size && !error) {
+            if (compress)
+                deflateBlock(buffer.data(), size, Z_NO_FLUSH);
+            else if (file.write(buffer.data(), size) != size)
+                error = true;
+        }
 
-    json_project.AddMember(Keys::project_format_version, PROJECT_FORMAT_VERSION, a);
+        current = buffer.data();
+    }
 
+    // Writes the end of the compressed stream. Must be called once the writer is done.
+    void Finish() {
+        Flush();
 
-    json_project.AddMember(Keys::input_file, input_file, a);
+        if (compress && !error)
+            deflateBlock(nullptr, 0, Z_FINISH);
+    }
 
+    // Only needed to satisfy the Stream concept.
+    Ch Peek() const { RAPIDJSON_ASSERT(false); return 0; }
+    Ch Take() { RAPIDJSON_ASSERT(false); return 0; }
+    size_t Tell() const { RAPIDJSON_ASSERT(false); return 0; }
+    Ch *PutBegin() { RAPIDJSON_ASSERT(false); return nullptr; }
+    size_t PutEnd(Ch *) { RAPIDJSON_ASSERT(false); return 0; }
 
-    rj::Value json_fps(rj::kArrayType);
-    json_fps.PushBack(fps_num, a);
-    json_fps.PushBack(fps_den, a);
-    json_project.AddMember(Keys::input_frame_rate, json_fps, a);
+    bool hasError() const {
+        return error;
+    }
 
+    std::string errorString() const {
+        return error_message.size() ? error_message : file.errorString().toStdString();
+    }
 
-    rj::Value json_resolution(rj::kArrayType);
-    json_resolution.PushBack(width, a);
-    json_resolution.PushBack(height, a);
-    json_project.AddMember(Keys::input_resolution, json_resolution, a);
+private:
+    QFileDevice &file;
+    std::vector<char> buffer;
+    char *current;
+    char *end;
+    bool error;
 
+    bool compress;
+    z_stream zstream;
+    std::vector<char> output;
+    std::string error_message;
 
-    if (is_wobbly) {
-        rj::Value json_ui(rj::kObjectType);
-        json_ui.AddMember(Keys::UserInterface::zoom, zoom, a);
-        json_ui.AddMember(Keys::UserInterface::last_visited_frame, last_visited_frame, a);
-        json_ui.AddMember(Keys::UserInterface::geometry, ui_geometry, a);
-        json_ui.AddMember(Keys::UserInterface::state, ui_state, a);
+    void deflateBlock(const char *data, qint64 size, int flush) {
+        zstream.next_in = (Bytef *)data;
+        zstream.avail_in = (uInt)size;
 
-        rj::Value json_rates(rj::kArrayType);
+        int ret;
+
+        do {
+            zstream.next_out = (Bytef *)output.data();
+            zstream.avail_out = (uInt)output.size();
+
+            ret = deflate(&zstream, flush);
+            if (ret == Z_STREAM_ERROR) {
+                error = true;
+                error_message = "zlib compression failed.";
+                return;
+            }
+
+            qint64 compressed_size = output.size() - zstream.avail_out;
+            if (compressed_size && file.write(output.data(), compressed_size) != compressed_size) {
+                error = true;
+                return;
+            }
+        } while (zstream.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+    }
+};
+
+
+template <typename Writer>
+void WobblyProject::writeJSON(Writer &writer, const std::string &columns_file, uint32_t columns_checksum) {
+    bool use_columns_file = !columns_file.empty();
+
+    writer.StartObject();
+
+    writer.Key(Keys::wobbly_version);
+    writer.Int(std::atoi(PACKAGE_VERSION));
+
+
+    writer.Key(Keys::project_format_version);
+    writer.Int(PROJECT_FORMAT_VERSION);
+
+
+    writer.Key(Keys::input_file);
+    writer.String(input_file);
+
+
+    writer.Key(Keys::input_frame_rate);
+    writer.StartArray();
+    writer.Int64(fps_num);
+    writer.Int64(fps_den);
+    writer.EndArray();
+
+
+    writer.Key(Keys::input_resolution);
+    writer.StartArray();
+    writer.Int(width);
+    writer.Int(height);
+    writer.EndArray();
+
+
+    if (is_wobbly) {
+        writer.Key(Keys::user_interface);
+        writer.StartObject();
+
+        writer.Key(Keys::UserInterface::zoom);
+        writer.Int(zoom);
+        writer.Key(Keys::UserInterface::last_visited_frame);
+        writer.Int(last_visited_frame);
+        writer.Key(Keys::UserInterface::geometry);
+        writer.String(ui_geometry);
+        writer.Key(Keys::UserInterface::state);
+        writer.String(ui_state);
+
+        writer.Key(Keys::UserInterface::show_frame_rates);
+        writer.StartArray();
         int rates[] = { 30, 24, 18, 12, 6 };
         for (int i = 0; i < 5; i++)
             if (shown_frame_rates[i])
-                json_rates.PushBack(rates[i], a);
-        json_ui.AddMember(Keys::UserInterface::show_frame_rates, json_rates, a);
+                writer.Int(rates[i]);
+        writer.EndArray();
 
-        json_ui.AddMember(Keys::UserInterface::mic_search_minimum, mic_search_minimum, a);
-        json_ui.AddMember(Keys::UserInterface::c_match_sequences_minimum, c_match_sequences_minimum, a);
+        writer.Key(Keys::UserInterface::mic_search_minimum);
+        writer.Int(mic_search_minimum);
+        writer.Key(Keys::UserInterface::c_match_sequences_minimum);
+        writer.Int(c_match_sequences_minimum);
 
         if (pattern_guessing.failures.size()) {
-            rj::Value json_pattern_guessing(rj::kObjectType);
+            writer.Key(Keys::UserInterface::pattern_guessing);
+            writer.StartObject();
 
             const char *guessing_methods[] = {
                 "from matches",
                 "from mics"
             };
-            json_pattern_guessing.AddMember(Keys::UserInterface::PatternGuessing::method, rj::Value(guessing_methods[pattern_guessing.method], a), a);
+            writer.Key(Keys::UserInterface::PatternGuessing::method);
+            writer.String(guessing_methods[pattern_guessing.method]);
 
-            json_pattern_guessing.AddMember(Keys::UserInterface::PatternGuessing::minimum_length, pattern_guessing.minimum_length, a);
+            writer.Key(Keys::UserInterface::PatternGuessing::minimum_length);
+            writer.Int(pattern_guessing.minimum_length);
 
             const char *third_n_match[] = {
                 "always",
                 "never",
                 "if it has lower mic"
             };
-            json_pattern_guessing.AddMember(Keys::UserInterface::PatternGuessing::use_third_n_match, rj::Value(third_n_match[pattern_guessing.third_n_match], a), a);
+            writer.Key(Keys::UserInterface::PatternGuessing::use_third_n_match);
+            writer.String(third_n_match[pattern_guessing.third_n_match]);
 
             const char *decimate[] = {
                 "first duplicate",
@@ -292,9 +1800,8 @@ void WobblyProject::writeProject(const std::string &path, bool compact_project)
                 "duplicate with higher mic per cycle",
                 "duplicate with higher mic per section"
             };
-            json_pattern_guessing.AddMember(Keys::UserInterface::PatternGuessing::decimate, rj::Value(decimate[pattern_guessing.decimation], a), a);
-
-            rj::Value json_use_patterns(rj::kArrayType);
+            writer.Key(Keys::UserInterface::PatternGuessing::decimate);
+            writer.String(decimate[pattern_guessing.decimation]);
 
             std::map<int, std::string> use_patterns = {
                 { PatternCCCNN, "cccnn" },
@@ -302,215 +1809,230 @@ void WobblyProject::writeProject(const std::string &path, bool compact_project)
                 { PatternCCCCC, "ccccc" }
             };
 
+            writer.Key(Keys::UserInterface::PatternGuessing::use_patterns);
+            writer.StartArray();
             for (auto it = use_patterns.cbegin(); it != use_patterns.cend(); it++)
                 if (pattern_guessing.use_patterns & it->first)
-                    json_use_patterns.PushBack(rj::Value(it->second, a), a);
-            json_pattern_guessing.AddMember(Keys::UserInterface::PatternGuessing::use_patterns, json_use_patterns, a);
-
-            rj::Value json_failures(rj::kArrayType);
+                    writer.String(it->second);
+            writer.EndArray();
 
             const char *reasons[] = {
                 "section too short",
                 "ambiguous pattern"
             };
+
+            writer.Key(Keys::UserInterface::PatternGuessing::failures);
+            writer.StartArray();
             for (auto it = pattern_guessing.failures.cbegin(); it != pattern_guessing.failures.cend(); it++) {
-                rj::Value json_failure(rj::kObjectType);
-                json_failure.AddMember(Keys::UserInterface::PatternGuessing::Failures::start, it->second.start, a);
-                json_failure.AddMember(Keys::UserInterface::PatternGuessing::Failures::reason, rj::Value(reasons[it->second.reason], a), a);
-                json_failures.PushBack(json_failure, a);
+                writer.StartObject();
+                writer.Key(Keys::UserInterface::PatternGuessing::Failures::start);
+                writer.Int(it->second.start);
+                writer.Key(Keys::UserInterface::PatternGuessing::Failures::reason);
+                writer.String(reasons[it->second.reason]);
+                writer.EndObject();
             }
-            json_pattern_guessing.AddMember(Keys::UserInterface::PatternGuessing::failures, json_failures, a);
+            writer.EndArray();
 
-            json_ui.AddMember(Keys::UserInterface::pattern_guessing, json_pattern_guessing, a);
+            writer.EndObject();
         }
 
         if (bookmarks->size()) {
-            rj::Value json_bookmarks(rj::kArrayType);
+            writer.Key(Keys::UserInterface::bookmarks);
+            writer.StartArray();
 
             for (auto it = bookmarks->cbegin(); it != bookmarks->cend(); it++) {
-                rj::Value json_bookmark(rj::kObjectType);
-                json_bookmark.AddMember(Keys::UserInterface::Bookmarks::frame, it->second.frame, a);
-                json_bookmark.AddMember(Keys::UserInterface::Bookmarks::description, rj::Value(it->second.description, a), a);
-                json_bookmarks.PushBack(json_bookmark, a);
+                writer.StartObject();
+                writer.Key(Keys::UserInterface::Bookmarks::frame);
+                writer.Int(it->second.frame);
+                writer.Key(Keys::UserInterface::Bookmarks::description);
+                writer.String(it->second.description);
+                writer.EndObject();
             }
 
-            json_ui.AddMember(Keys::UserInterface::bookmarks, json_bookmarks, a);
+            writer.EndArray();
         }
 
-        json_project.AddMember(Keys::user_interface, json_ui, a);
+        writer.EndObject();
     }
 
 
-    rj::Value json_trims(rj::kArrayType);
-
+    writer.Key(Keys::trim);
+    writer.StartArray();
     for (auto it = trims.cbegin(); it != trims.cend(); it++) {
-        rj::Value json_trim(rj::kArrayType);
-        json_trim.PushBack(it->second.first, a);
-        json_trim.PushBack(it->second.last, a);
-        json_trims.PushBack(json_trim, a);
+        writer.StartArray();
+        writer.Int(it->second.first);
+        writer.Int(it->second.last);
+        writer.EndArray();
     }
-    json_project.AddMember(Keys::trim, json_trims, a);
+    writer.EndArray();
 
     // FIXME, should probably save/load the DMetrics parameters here as well
-    rj::Value json_vfm_parameters(rj::kObjectType);
-
-    for (auto it = vfm_parameters.cbegin(); it != vfm_parameters.cend(); it++)
-        json_vfm_parameters.AddMember(rj::Value(it->first, a), rj::Value(it->second), a);
-
-    json_project.AddMember(Keys::vfm_parameters, json_vfm_parameters, a);
-
-
-    rj::Value json_vdecimate_parameters(rj::kObjectType);
-
-    for (auto it = vdecimate_parameters.cbegin(); it != vdecimate_parameters.cend(); it++)
-        json_vdecimate_parameters.AddMember(rj::Value(it->first, a), rj::Value(it->second), a);
-
-    json_project.AddMember(Keys::vdecimate_parameters, json_vdecimate_parameters, a);
-
-    if (mics.size()) {
-        rj::Value json_mics(rj::kArrayType);
-
-        for (size_t i = 0; i < mics.size(); i++) {
-            rj::Value json_mic(rj::kArrayType);
-            for (int j = 0; j < 5; j++)
-                json_mic.PushBack(mics[i][j], a);
-            json_mics.PushBack(json_mic, a);
-        }
-
-        json_project.AddMember(Keys::mics, json_mics, a);
+    writer.Key(Keys::vfm_parameters);
+    writer.StartObject();
+    for (auto it = vfm_parameters.cbegin(); it != vfm_parameters.cend(); it++) {
+        writer.Key(it->first.c_str(), (rj::SizeType)it->first.size());
+        writer.Double(it->second);
     }
+    writer.EndObject();
 
-    if (mmetrics.size()) {
-        rj::Value json_mmetrics(rj::kArrayType);
-
-        for (size_t i = 0; i < mmetrics.size(); i++) {
-            rj::Value json_mmetric(rj::kArrayType);
-            for (int j = 0; j < 2; j++)
-                json_mmetric.PushBack(mmetrics[i][j], a);
-            json_mmetrics.PushBack(json_mmetric, a);
-        }
 
-        json_project.AddMember(Keys::mmetrics, json_mmetrics, a);
+    writer.Key(Keys::vdecimate_parameters);
+    writer.StartObject();
+    for (auto it = vdecimate_parameters.cbegin(); it != vdecimate_parameters.cend(); it++) {
+        writer.Key(it->first.c_str(), (rj::SizeType)it->first.size());
+        writer.Double(it->second);
+    }
+    writer.EndObject();
+
+    if (use_columns_file) {
+        writer.Key(Keys::columns);
+        writer.StartObject();
+        writer.Key(Keys::Columns::file);
+        writer.String(columns_file);
+        writer.Key(Keys::Columns::checksum);
+        writer.Uint(columns_checksum);
+        writer.EndObject();
     }
 
-    if (vmetrics.size()) {
-        rj::Value json_vmetrics(rj::kArrayType);
-
-        for (size_t i = 0; i < vmetrics.size(); i++) {
-            rj::Value json_vmetric(rj::kArrayType);
-            for (int j = 0; j < 2; j++)
-                json_vmetric.PushBack(vmetrics[i][j], a);
-            json_vmetrics.PushBack(json_vmetric, a);
-        }
+    if (!use_columns_file && mics.size()) {
+        writer.Key(Keys::mics);
+        writer.String(encodeDeltas(mics[0].data(), mics.size(), 5));
+    }
 
-        json_project.AddMember(Keys::vmetrics, json_vmetrics, a);
+    if (!use_columns_file && mmetrics.size()) {
+        writer.Key(Keys::mmetrics);
+        writer.String(encodeDeltas(mmetrics[0].data(), mmetrics.size(), 2));
     }
 
-    if (matches.size()) {
-        rj::Value json_matches(rj::kArrayType);
+    if (!use_columns_file && vmetrics.size()) {
+        writer.Key(Keys::vmetrics);
+        writer.String(encodeDeltas(vmetrics[0].data(), vmetrics.size(), 2));
+    }
 
-        for (size_t i = 0; i < matches.size(); i++)
-            json_matches.PushBack(rj::Value(&matches[i], 1), a);
+    if (!use_columns_file && matches.size()) {
+        writer.Key(Keys::matches);
+        writer.String(matches.data(), (rj::SizeType)matches.size());
+    }
 
-        json_project.AddMember(Keys::matches, json_matches, a);
+    if (!use_columns_file && original_matches.size()) {
+        writer.Key(Keys::original_matches);
+        writer.String(original_matches.data(), (rj::SizeType)original_matches.size());
     }
 
-    if (original_matches.size()) {
-        rj::Value json_original_matches(rj::kArrayType);
+    if (!use_columns_file && combed_frames->cbegin() != combed_frames->cend()) {
+        writer.Key(Keys::combed_frames);
+        writer.StartArray();
 
-        for (size_t i = 0; i < original_matches.size(); i++)
-            json_original_matches.PushBack(rj::Value(&original_matches[i], 1), a);
+        // Stored as ranges of consecutive frames.
+        for (auto it = combed_frames->cbegin(); it != combed_frames->cend(); ) {
+            int first = *it;
+            int last = first;
 
-        json_project.AddMember(Keys::original_matches, json_original_matches, a);
-    }
+            for (it++; it != combed_frames->cend() && *it == last + 1; it++)
+                last++;
 
-    if (combed_frames->cbegin() != combed_frames->cend()) {
-        rj::Value json_combed_frames(rj::kArrayType);
-
-        for (auto it = combed_frames->cbegin(); it != combed_frames->cend(); it++)
-            json_combed_frames.PushBack(*it, a);
+            writer.StartArray();
+            writer.Int(first);
+            writer.Int(last);
+            writer.EndArray();
+        }
 
-        json_project.AddMember(Keys::combed_frames, json_combed_frames, a);
+        writer.EndArray();
     }
 
-    if (decimated_frames.size()) {
-        rj::Value json_decimated_frames(rj::kArrayType);
+    if (!use_columns_file && decimated_frames.size()) {
+        writer.Key(Keys::decimated_frames);
+        writer.StartArray();
 
-        for (size_t i = 0; i < decimated_frames.size(); i++)
-            for (auto it = decimated_frames[i].cbegin(); it != decimated_frames[i].cend(); it++)
-                json_decimated_frames.PushBack((int)i * 5 + *it, a);
+        // Stored as runs of cycles with the same pattern: [ first frame, pattern, number of frames ].
+        // Cycles with nothing to drop are left out.
+        for (size_t i = 0; i < decimated_frames.size(); ) {
+            size_t first = i;
 
-        json_project.AddMember(Keys::decimated_frames, json_decimated_frames, a);
-    }
+            for (i++; i < decimated_frames.size() && decimated_frames[i] == decimated_frames[first]; i++)
+                ;
 
-    if (decimate_metrics.size()) {
-        rj::Value json_decimate_metrics(rj::kArrayType);
+            if (!decimated_frames[first])
+                continue;
 
-        for (size_t i = 0; i < decimate_metrics.size(); i++)
-            json_decimate_metrics.PushBack(getDecimateMetric(i), a);
+            char pattern[6] = "kkkkk";
+            for (int offset = 0; offset < 5; offset++)
+                if (decimated_frames[first] & (1 << offset))
+                    pattern[offset] = 'd';
 
-        json_project.AddMember(Keys::decimate_metrics, json_decimate_metrics, a);
+            writer.StartArray();
+            writer.Int((int)first * 5);
+            writer.String(pattern, 5);
+            writer.Int((int)(i - first) * 5);
+            writer.EndArray();
+        }
+
+        writer.EndArray();
     }
 
+    if (!use_columns_file && decimate_metrics.size()) {
+        writer.Key(Keys::decimate_metrics);
+        writer.String(encodeDeltas(decimate_metrics.data(), decimate_metrics.size(), 1));
+    }
 
-    rj::Value json_sections(rj::kArrayType);
 
+    writer.Key(Keys::sections);
+    writer.StartArray();
     for (auto it = sections->cbegin(); it != sections->cend(); it++) {
-        rj::Value json_section(rj::kObjectType);
-        json_section.AddMember(Keys::Sections::start, it->second.start, a);
-        rj::Value json_presets(rj::kArrayType);
+        writer.StartObject();
+        writer.Key(Keys::Sections::start);
+        writer.Int(it->second.start);
+        writer.Key(Keys::Sections::presets);
+        writer.StartArray();
         for (size_t i = 0; i < it->second.presets.size(); i++)
-            json_presets.PushBack(rj::Value(it->second.presets[i], a), a);
-        json_section.AddMember(Keys::Sections::presets, json_presets, a);
-
-        json_sections.PushBack(json_section, a);
+            writer.String(it->second.presets[i]);
+        writer.EndArray();
+        writer.EndObject();
     }
+    writer.EndArray();
 
-    json_project.AddMember(Keys::sections, json_sections, a);
-
-
-    json_project.AddMember(Keys::source_filter, source_filter, a);
 
+    writer.Key(Keys::source_filter);
+    writer.String(source_filter);
 
-    rj::Value json_interlaced_fades(rj::kArrayType);
 
+    writer.Key(Keys::interlaced_fades);
+    writer.StartArray();
     for (auto it = interlaced_fades.cbegin(); it != interlaced_fades.cend(); it++) {
-        rj::Value json_interlaced_fade(rj::kObjectType);
-        json_interlaced_fade.AddMember(Keys::InterlacedFades::frame, it->second.frame, a);
-        json_interlaced_fade.AddMember(Keys::InterlacedFades::field_difference, it->second.field_difference, a);
-
-        json_interlaced_fades.PushBack(json_interlaced_fade, a);
+        writer.StartObject();
+        writer.Key(Keys::InterlacedFades::frame);
+        writer.Int(it->second.frame);
+        writer.Key(Keys::InterlacedFades::field_difference);
+        writer.Double(it->second.field_difference);
+        writer.EndObject();
     }
-
-    json_project.AddMember(Keys::interlaced_fades, json_interlaced_fades, a);
+    writer.EndArray();
 
 
     if (is_wobbly) {
-        rj::Value json_presets(rj::kArrayType);
-        rj::Value json_frozen_frames(rj::kArrayType);
-
+        writer.Key(Keys::presets);
+        writer.StartArray();
         for (auto it = presets->cbegin(); it != presets->cend(); it++) {
-            rj::Value json_preset(rj::kObjectType);
-            json_preset.AddMember(Keys::Presets::name, it->second.name, a);
-            json_preset.AddMember(Keys::Presets::contents, it->second.contents, a);
-
-            json_presets.PushBack(json_preset, a);
+            writer.StartObject();
+            writer.Key(Keys::Presets::name);
+            writer.String(it->second.name);
+            writer.Key(Keys::Presets::contents);
+            writer.String(it->second.contents);
+            writer.EndObject();
         }
+        writer.EndArray();
 
+        writer.Key(Keys::frozen_frames);
+        writer.StartArray();
         for (auto it = frozen_frames->cbegin(); it != frozen_frames->cend(); it++) {
-            rj::Value json_ff(rj::kArrayType);
-            json_ff.PushBack(it->second.first, a);
-            json_ff.PushBack(it->second.last, a);
-            json_ff.PushBack(it->second.replacement, a);
-
-            json_frozen_frames.PushBack(json_ff, a);
+            writer.StartArray();
+            writer.Int(it->second.first);
+            writer.Int(it->second.last);
+            writer.Int(it->second.replacement);
+            writer.EndArray();
         }
+        writer.EndArray();
 
-        json_project.AddMember(Keys::presets, json_presets, a);
-        json_project.AddMember(Keys::frozen_frames, json_frozen_frames, a);
-
-
-        rj::Value json_custom_lists(rj::kArrayType);
 
         const char *list_positions[] = {
             "post source",
@@ -518,86 +2040,225 @@ void WobblyProject::writeProject(const std::string &path, bool compact_project)
             "post decimate"
         };
 
+        writer.Key(Keys::custom_lists);
+        writer.StartArray();
         for (size_t i = 0; i < custom_lists->size(); i++) {
             const CustomList &cl = custom_lists->at(i);
 
-            rj::Value json_custom_list(rj::kObjectType);
-            json_custom_list.AddMember(Keys::CustomLists::name, cl.name, a);
-            json_custom_list.AddMember(Keys::CustomLists::preset, cl.preset, a);
-            json_custom_list.AddMember(Keys::CustomLists::position, rj::Value(list_positions[cl.position], a), a);
-            rj::Value json_frames(rj::kArrayType);
+            writer.StartObject();
+            writer.Key(Keys::CustomLists::name);
+            writer.String(cl.name);
+            writer.Key(Keys::CustomLists::preset);
+            writer.String(cl.preset);
+            writer.Key(Keys::CustomLists::position);
+            writer.String(list_positions[cl.position]);
+            writer.Key(Keys::CustomLists::frames);
+            writer.StartArray();
             for (auto it = cl.ranges->cbegin(); it != cl.ranges->cend(); it++) {
-                rj::Value json_pair(rj::kArrayType);
-                json_pair.PushBack(it->second.first, a);
-                json_pair.PushBack(it->second.last, a);
-                json_frames.PushBack(json_pair, a);
+                writer.StartArray();
+                writer.Int(it->second.first);
+                writer.Int(it->second.last);
+                writer.EndArray();
             }
-            json_custom_list.AddMember(Keys::CustomLists::frames, json_frames, a);
-
-            json_custom_lists.PushBack(json_custom_list, a);
+            writer.EndArray();
+            writer.EndObject();
         }
-
-        json_project.AddMember(Keys::custom_lists, json_custom_lists, a);
+        writer.EndArray();
 
 
         if (resize.enabled) {
-            rj::Value json_resize(rj::kObjectType);
-            json_resize.AddMember(Keys::Resize::width, resize.width, a);
-            json_resize.AddMember(Keys::Resize::height, resize.height, a);
-            json_resize.AddMember(Keys::Resize::filter, resize.filter, a);
-            json_project.AddMember(Keys::resize, json_resize, a);
+            writer.Key(Keys::resize);
+            writer.StartObject();
+            writer.Key(Keys::Resize::width);
+            writer.Int(resize.width);
+            writer.Key(Keys::Resize::height);
+            writer.Int(resize.height);
+            writer.Key(Keys::Resize::filter);
+            writer.String(resize.filter);
+            writer.EndObject();
         }
 
         if (crop.enabled) {
-            rj::Value json_crop(rj::kObjectType);
-            json_crop.AddMember(Keys::Crop::early, crop.early, a);
-            json_crop.AddMember(Keys::Crop::left, crop.left, a);
-            json_crop.AddMember(Keys::Crop::top, crop.top, a);
-            json_crop.AddMember(Keys::Crop::right, crop.right, a);
-            json_crop.AddMember(Keys::Crop::bottom, crop.bottom, a);
-            json_project.AddMember(Keys::crop, json_crop, a);
+            writer.Key(Keys::crop);
+            writer.StartObject();
+            writer.Key(Keys::Crop::early);
+            writer.Bool(crop.early);
+            writer.Key(Keys::Crop::left);
+            writer.Int(crop.left);
+            writer.Key(Keys::Crop::top);
+            writer.Int(crop.top);
+            writer.Key(Keys::Crop::right);
+            writer.Int(crop.right);
+            writer.Key(Keys::Crop::bottom);
+            writer.Int(crop.bottom);
+            writer.EndObject();
         }
 
         if (depth.enabled) {
-            rj::Value json_depth(rj::kObjectType);
-            json_depth.AddMember(Keys::Depth::bits, depth.bits, a);
-            json_depth.AddMember(Keys::Depth::float_samples, depth.float_samples, a);
-            json_depth.AddMember(Keys::Depth::dither, depth.dither, a);
-            json_project.AddMember(Keys::depth, json_depth, a);
+            writer.Key(Keys::depth);
+            writer.StartObject();
+            writer.Key(Keys::Depth::bits);
+            writer.Int(depth.bits);
+            writer.Key(Keys::Depth::float_samples);
+            writer.Bool(depth.float_samples);
+            writer.Key(Keys::Depth::dither);
+            writer.String(depth.dither);
+            writer.EndObject();
         }
     }
 
-    rj::StringBuffer buffer;
+    if (journal_id.size()) {
+        writer.Key(Keys::journal);
+        writer.StartObject();
+        writer.Key(Keys::Journal::id);
+        writer.String(journal_id);
+        writer.Key(Keys::Journal::sequence);
+        writer.Uint64(journal_sequence);
+        writer.EndObject();
+    }
+
+    writer.EndObject();
+}
+
+
+void WobblyProject::writeProject(const std::string &path, bool compact_project, bool use_columns_file) {
+    waitForMetrics();
+
+    std::string columns_file;
+    uint32_t columns_checksum = 0;
+    ProjectColumns columns;
+
+    if (use_columns_file) {
+        if (mics.size())
+            columns.addColumn(ProjectColumns::ColumnMics, mics[0].data(), mics.size(), 5);
+
+        if (mmetrics.size())
+            columns.addColumn(ProjectColumns::ColumnMMetrics, mmetrics[0].data(), mmetrics.size(), 2);
+
+        if (vmetrics.size())
+            columns.addColumn(ProjectColumns::ColumnVMetrics, vmetrics[0].data(), vmetrics.size(), 2);
+
+        if (matches.size())
+            columns.addColumn(ProjectColumns::ColumnMatches, (const int8_t *)matches.data(), matches.size());
+
+        if (original_matches.size())
+            columns.addColumn(ProjectColumns::ColumnOriginalMatches, (const int8_t *)original_matches.data(), original_matches.size());
+
+        if (decimate_metrics.size())
+            columns.addColumn(ProjectColumns::ColumnDecimateMetrics, decimate_metrics.data(), decimate_metrics.size());
+
+        std::vector<int> frames(combed_frames->cbegin(), combed_frames->cend());
+        columns.addColumn(ProjectColumns::ColumnCombedFrames, frames.data(), frames.size());
+
+        frames.clear();
+        for (size_t i = 0; i < decimated_frames.size(); i++)
+            for (int offset = 0; offset < 5; offset++)
+                if (decimated_frames[i] & (1 << offset))
+                    frames.push_back((int)i * 5 + offset);
+        columns.addColumn(ProjectColumns::ColumnDecimatedFrames, frames.data(), frames.size());
+
+        columns_checksum = columns.getChecksum(getNumFrames(PostSource));
+        columns_file = QFileInfo(QString::fromStdString(ProjectColumns::getSidecarPath(path, columns_checksum))).fileName().toStdString();
+    }
+
+    // QSaveFile writes to a temporary file and renames it over the old
+    // project in commit(), so a failed save leaves the old project intact.
+    QSaveFile file(QString::fromStdString(path));
+
+    if (!file.open(QIODevice::WriteOnly))
+        throw WobblyException("Couldn't open project file '" + path + "'. Error message: " + file.errorString().toStdString());
+
+    // The tokens go straight to the file, without building a document or a string first.
+    // Paths ending in ".gz" get a gzip compressed project. readProject recognises those by their contents.
+    ProjectFileWriteStream stream(file, QString::fromStdString(path).endsWith(QStringLiteral(".gz"), Qt::CaseInsensitive));
 
     if (compact_project) {
-        rj::Writer<rj::StringBuffer> writer(buffer);
-        json_project.Accept(writer);
+        rj::Writer<ProjectFileWriteStream> writer(stream);
+        writeJSON(writer, columns_file, columns_checksum);
     } else {
-        rj::PrettyWriter<rj::StringBuffer> writer(buffer);
-        json_project.Accept(writer);
+        rj::PrettyWriter<ProjectFileWriteStream> writer(stream);
+        writeJSON(writer, columns_file, columns_checksum);
+    }
+
+    stream.Finish();
+
+    if (stream.hasError())
+        throw WobblyException("Couldn't write the project to file '" + path + "'. Error message: " + stream.errorString());
+
+    // The column file is written before the project, so the project never refers to a column file that doesn't exist yet.
+    // It has a new name, so the old project keeps its own column file until the new project replaces it.
+    std::string columns_path;
+    if (use_columns_file) {
+        columns_path = ProjectColumns::getSidecarPath(path, columns_checksum);
+        columns.writeFile(columns_path, getNumFrames(PostSource));
     }
 
-    if (file.write(buffer.GetString(), buffer.GetSize()) < 0)
+    if (!file.commit())
         throw WobblyException("Couldn't write the project to file '" + path + "'. Error message: " + file.errorString().toStdString());
 
+    ProjectColumns::removeOldSidecars(path, columns_path);
+
     setModified(false);
 }
 
 
-void WobblyProject::readProject(const std::string &path) {
+void WobblyProject::readProject(const std::string &path, bool defer_metrics) {
+    parseProject(path, defer_metrics, std::vector<const char *>());
+}
+
+
+void WobblyProject::readProjectForImport(const std::string &path, const ImportedThings &imports) {
+    // None of the per-frame data can be imported. The column file isn't even opened.
+    std::vector<const char *> skipped_keys = {
+        Keys::mics,
+        Keys::mmetrics,
+        Keys::vmetrics,
+        Keys::matches,
+        Keys::original_matches,
+        Keys::combed_frames,
+        Keys::decimated_frames,
+        Keys::decimate_metrics,
+        Keys::columns,
+        Keys::sections,
+        Keys::frozen_frames,
+        Keys::interlaced_fades,
+        Keys::journal
+    };
+
+    // The custom lists can refer to presets.
+    if (!imports.presets && !imports.custom_lists)
+        skipped_keys.push_back(Keys::presets);
+
+    if (!imports.custom_lists)
+        skipped_keys.push_back(Keys::custom_lists);
+
+    parseProject(path, false, skipped_keys);
+}
+
+
+void WobblyProject::parseProject(const std::string &path, bool defer_metrics, const std::vector<const char *> &skipped_keys) {
     QFile file(QString::fromStdString(path));
 
     if (!file.open(QIODevice::ReadOnly))
         throw WobblyException("Couldn't open project file '" + path + "'. Error message: " + file.errorString().toStdString());
 
-    QByteArray file_contents = file.readAll();
-
     rj::Document json_project;
 
-    rj::ParseResult result = json_project.ParseInsitu(file_contents.data());
+    // The per-frame data is kept out of the DOM.
+    ProjectHandler handler(json_project);
+    for (const char *key : skipped_keys)
+        handler.skipKey(key);
+    ProjectFileStream stream(file);
+    rj::Reader reader;
+
+    rj::ParseResult result = reader.Parse(stream, handler);
+    if (stream.hasError())
+        throw WobblyException("Couldn't read project file '" + path + "'. Error message: " + stream.errorString());
     if (result.IsError())
         throw WobblyException("Failed to parse project file '" + path + "' at byte " + std::to_string(result.Offset()) + ": " + rj::GetParseError_En(result.Code()));
 
+    handler.finish();
+
     if (!json_project.IsObject())
         throw WobblyException("File '" + path + "' is not a valid Wobbly project: JSON document root is not an object.");
 
@@ -965,160 +2626,289 @@ void WobblyProject::readProject(const std::string &path) {
         }
     }
 
-    it = json_project.FindMember(Keys::mmetrics);
-    if (it != json_project.MemberEnd()) {
-        const rj::Value &json_mmetrics = it->value;
+    int source_frames = getNumFrames(PostSource);
 
-        if (!json_mmetrics.IsArray() || json_mmetrics.Size() != (rj::SizeType)getNumFrames(PostSource))
-            throw WobblyException(path + ": JSON key '" + Keys::mmetrics + "' must be an array with exactly " + std::to_string(getNumFrames(PostSource)) + " elements.");
+    // Decoding these is most of the work in format version 4, so it can be left for later.
+    std::unique_ptr<DeferredMetrics> metrics(new DeferredMetrics);
+    metrics->path = path;
 
-        mmetrics.resize(getNumFrames(PostSource), { 0 });
-        for (size_t i = 0; i < mmetrics.size(); i++) {
-            const rj::Value &json_mmetric = json_mmetrics[i];
+    ProjectHandler::Capture *capture = &handler.captures[ProjectHandler::MMetricsKey];
+    if (capture->type != ProjectHandler::CaptureMissing && project_format_version >= 4) {
+        if (capture->type != ProjectHandler::CaptureString)
+            throw WobblyException(path + ": JSON key '" + Keys::mmetrics + "' must be a string.");
 
-            if (!json_mmetric.IsArray() ||
-                json_mmetric.Size() != 2 ||
-                !json_mmetric[0].IsInt() ||
-                !json_mmetric[1].IsInt())
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::mmetrics + "' must be an array of exactly 2 integers.");
+        metrics->mmetrics.resize(source_frames);
+        metrics->mmetrics_text.swap(capture->text);
+    } else if (capture->type != ProjectHandler::CaptureMissing) {
+        if (capture->type != ProjectHandler::CaptureArray || capture->elements != (size_t)source_frames)
+            throw WobblyException(path + ": JSON key '" + Keys::mmetrics + "' must be an array with exactly " + std::to_string(source_frames) + " elements.");
 
-            for (rj::SizeType j = 0; j < json_mmetric.Size(); j++)
-                mmetrics[i][j] = json_mmetric[j].GetInt();
-        }
+        if (capture->bad_element >= 0)
+            throw WobblyException(path + ": element number " + std::to_string(capture->bad_element) + " of JSON key '" + Keys::mmetrics + "' must be an array of exactly 2 integers.");
+
+        mmetrics.swap(handler.mmetrics);
     }
 
-    it = json_project.FindMember(Keys::vmetrics);
-    if (it != json_project.MemberEnd()) {
-        const rj::Value &json_vmetrics = it->value;
+    capture = &handler.captures[ProjectHandler::VMetricsKey];
+    if (capture->type != ProjectHandler::CaptureMissing && project_format_version >= 4) {
+        if (capture->type != ProjectHandler::CaptureString)
+            throw WobblyException(path + ": JSON key '" + Keys::vmetrics + "' must be a string.");
 
-        if (!json_vmetrics.IsArray() || json_vmetrics.Size() != (rj::SizeType)getNumFrames(PostSource))
-            throw WobblyException(path + ": JSON key '" + Keys::vmetrics + "' must be an array with exactly " + std::to_string(getNumFrames(PostSource)) + " elements.");
+        metrics->vmetrics.resize(source_frames);
+        metrics->vmetrics_text.swap(capture->text);
+    } else if (capture->type != ProjectHandler::CaptureMissing) {
+        if (capture->type != ProjectHandler::CaptureArray || capture->elements != (size_t)source_frames)
+            throw WobblyException(path + ": JSON key '" + Keys::vmetrics + "' must be an array with exactly " + std::to_string(source_frames) + " elements.");
 
-        vmetrics.resize(getNumFrames(PostSource), { 0 });
-        for (size_t i = 0; i < vmetrics.size(); i++) {
-            const rj::Value &json_vmetric = json_vmetrics[i];
+        if (capture->bad_element >= 0)
+            throw WobblyException(path + ": element number " + std::to_string(capture->bad_element) + " of JSON key '" + Keys::vmetrics + "' must be an array of exactly 2 integers.");
 
-            if (!json_vmetric.IsArray() ||
-                json_vmetric.Size() != 2 ||
-                !json_vmetric[0].IsInt() ||
-                !json_vmetric[1].IsInt())
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::vmetrics + "' must be an array of exactly 2 integers.");
+        vmetrics.swap(handler.vmetrics);
+    }
 
-            for (rj::SizeType j = 0; j < json_vmetric.Size(); j++)
-                vmetrics[i][j] = json_vmetric[j].GetInt();
-        }
+    capture = &handler.captures[ProjectHandler::MicsKey];
+    if (capture->type != ProjectHandler::CaptureMissing && project_format_version >= 4) {
+        if (capture->type != ProjectHandler::CaptureString)
+            throw WobblyException(path + ": JSON key '" + Keys::mics + "' must be a string.");
+
+        metrics->mics.resize(source_frames);
+        metrics->mics_text.swap(capture->text);
+    } else if (capture->type != ProjectHandler::CaptureMissing) {
+        if (capture->type != ProjectHandler::CaptureArray || capture->elements != (size_t)source_frames)
+            throw WobblyException(path + ": JSON key '" + Keys::mics + "' must be an array with exactly " + std::to_string(source_frames) + " elements.");
+
+        if (capture->bad_element >= 0)
+            throw WobblyException(path + ": element number " + std::to_string(capture->bad_element) + " of JSON key '" + Keys::mics + "' must be an array of exactly 5 integers.");
+
+        mics.swap(handler.mics);
     }
 
-    it = json_project.FindMember(Keys::mics);
-    if (it != json_project.MemberEnd()) {
-        const rj::Value &json_mics = it->value;
 
-        if (!json_mics.IsArray() || json_mics.Size() != (rj::SizeType)getNumFrames(PostSource))
-            throw WobblyException(path + ": JSON key '" + Keys::mics + "' must be an array with exactly " + std::to_string(getNumFrames(PostSource)) + " elements.");
+    const char *match_keys[2] = { Keys::matches, Keys::original_matches };
+    ProjectHandler::PerFrameKey match_captures[2] = { ProjectHandler::MatchesKey, ProjectHandler::OriginalMatchesKey };
+    std::vector<char> *match_sources[2] = { &handler.matches, &handler.original_matches };
+    std::vector<char> *match_destinations[2] = { &matches, &original_matches };
 
-        mics.resize(getNumFrames(PostSource), { 0 });
-        for (size_t i = 0; i < mics.size(); i++) {
-            const rj::Value &json_mic = json_mics[i];
+    for (int m = 0; m < 2; m++) {
+        const char *key = match_keys[m];
+        std::vector<char> &destination = *match_destinations[m];
+
+        capture = &handler.captures[match_captures[m]];
+        if (capture->type != ProjectHandler::CaptureMissing && project_format_version >= 4) {
+            if (capture->type != ProjectHandler::CaptureString || capture->text.size() != (size_t)source_frames)
+                throw WobblyException(path + ": JSON key '" + key + "' must be a string with exactly " + std::to_string(source_frames) + " characters.");
 
-            if (!json_mic.IsArray() ||
-                    json_mic.Size() != 5 ||
-                    !json_mic[0].IsInt() ||
-                    !json_mic[1].IsInt() ||
-                    !json_mic[2].IsInt() ||
-                    !json_mic[3].IsInt() ||
-                    !json_mic[4].IsInt())
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::mics + "' must be an array of exactly 5 integers.");
+            destination.assign(capture->text.cbegin(), capture->text.cend());
+            for (size_t i = 0; i < destination.size(); i++)
+                if (!isValidMatchChar(destination[i]))
+                    throw WobblyException(path + ": character number " + std::to_string(i) + " of JSON key '" + key + "' must be one of 'p', 'c', 'n', 'b', or 'u'.");
+        } else if (capture->type != ProjectHandler::CaptureMissing) {
+            if (capture->type != ProjectHandler::CaptureArray || capture->elements != (size_t)source_frames)
+                throw WobblyException(path + ": JSON key '" + key + "' must be an array with exactly " + std::to_string(source_frames) + " elements.");
 
-            for (rj::SizeType j = 0; j < json_mic.Size(); j++)
-                mics[i][j] = json_mic[j].GetInt();
+            if (capture->bad_element >= 0)
+                throw WobblyException(path + ": element number " + std::to_string(capture->bad_element) + " of JSON key '" + key + "' must be a string with the length of 1.");
+
+            destination.swap(*match_sources[m]);
+            for (size_t i = 0; i < destination.size(); i++)
+                if (!isValidMatchChar(destination[i]))
+                    throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + key + "' must be one of 'p', 'c', 'n', 'b', or 'u'.");
         }
     }
 
 
-    it = json_project.FindMember(Keys::matches);
-    if (it != json_project.MemberEnd()) {
-        const rj::Value &json_matches = it->value;
+    capture = &handler.captures[ProjectHandler::CombedFramesKey];
+    if (capture->type != ProjectHandler::CaptureMissing && project_format_version >= 4) {
+        if (capture->type != ProjectHandler::CaptureArray)
+            throw WobblyException(path + ": JSON key '" + Keys::combed_frames + "' must be an array.");
 
-        if (!json_matches.IsArray() || json_matches.Size() != (rj::SizeType)getNumFrames(PostSource))
-            throw WobblyException(path + ": JSON key '" + Keys::matches + "' must be an array with exactly " + std::to_string(getNumFrames(PostSource)) + " elements.");
+        std::vector<int> &ranges = handler.combed_frames;
 
-        matches.resize(getNumFrames(PostSource), 'c');
-        for (size_t i = 0; i < matches.size(); i++) {
-            if (!json_matches[i].IsString() || json_matches[i].GetStringLength() != 1)
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::matches + "' must be a string with the length of 1.");
+        int64_t bad_element = capture->bad_element;
+        if (capture->elements && !capture->nested)
+            bad_element = 0;
 
-            matches[i] = json_matches[i].GetString()[0];
+        for (size_t i = 0; bad_element < 0 && i < ranges.size(); i += 2)
+            if (ranges[i] > ranges[i + 1] || ranges[i] < 0 || ranges[i + 1] >= source_frames)
+                bad_element = i / 2;
 
-            if (!isValidMatchChar(matches[i]))
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::matches + "' must be one of 'p', 'c', 'n', 'b', or 'u'.");
-        }
+        if (bad_element >= 0)
+            throw WobblyException(path + ": element number " + std::to_string(bad_element) + " of JSON key '" + Keys::combed_frames + "' must be an array of two integers, the first and last frames of a range, between 0 and " + std::to_string(source_frames - 1) + ".");
+
+        std::vector<int> frames;
+
+        for (size_t i = 0; i < ranges.size(); i += 2)
+            for (int frame = ranges[i]; frame <= ranges[i + 1]; frame++)
+                frames.push_back(frame);
+
+        addCombedFrames(frames);
+    } else if (capture->type != ProjectHandler::CaptureMissing) {
+        if (capture->type != ProjectHandler::CaptureArray || capture->elements > (size_t)source_frames)
+            throw WobblyException(path + ": JSON key '" + Keys::combed_frames + "' must be an array with at most " + std::to_string(source_frames) + " elements.");
+
+        if (capture->bad_element >= 0 || capture->nested)
+            throw WobblyException(path + ": element number " + std::to_string(std::max(capture->bad_element, (int64_t)0)) + " of JSON key '" + Keys::combed_frames + "' must be an integer.");
+
+        addCombedFrames(handler.combed_frames);
     }
 
 
-    it = json_project.FindMember(Keys::original_matches);
-    if (it != json_project.MemberEnd()) {
-        const rj::Value &json_original_matches = it->value;
+    resetDecimatedFrames((getNumFrames(PostSource) - 1) / 5 + 1);
+    capture = &handler.captures[ProjectHandler::DecimatedFramesKey];
+    if (capture->type != ProjectHandler::CaptureMissing && project_format_version >= 4) {
+        if (capture->type != ProjectHandler::CaptureArray)
+            throw WobblyException(path + ": JSON key '" + Keys::decimated_frames + "' must be an array.");
 
-        if (!json_original_matches.IsArray() || json_original_matches.Size() != (rj::SizeType)getNumFrames(PostSource))
-            throw WobblyException(path + ": JSON key '" + Keys::original_matches + "' must be an array with exactly " + std::to_string(getNumFrames(PostSource)) + " elements.");
+        const std::vector<int> &runs = handler.decimated_frames;
 
-        original_matches.resize(getNumFrames(PostSource), 'c');
-        for (size_t i = 0; i < original_matches.size(); i++) {
-            if (!json_original_matches[i].IsString() || json_original_matches[i].GetStringLength() != 1)
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::original_matches + "' must be a string with the length of 1.");
+        int64_t bad_element = capture->bad_element;
+        if (capture->elements && !capture->nested)
+            bad_element = 0;
+
+        for (size_t i = 0; bad_element < 0 && i < runs.size(); i += 2)
+            if (runs[i] < 0 || runs[i] % 5 || runs[i + 1] <= 0 || runs[i + 1] % 5 || runs[i + 1] > source_frames + 4 - runs[i])
+                bad_element = i / 2;
 
-            original_matches[i] = json_original_matches[i].GetString()[0];
+        if (bad_element >= 0)
+            throw WobblyException(path + ": element number " + std::to_string(bad_element) + " of JSON key '" + Keys::decimated_frames + "' must be an array containing the first frame of the run, the decimation pattern, and the number of frames in the run. The numbers must be multiples of 5.");
 
-            if (!isValidMatchChar(original_matches[i]))
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::original_matches + "' must be one of 'p', 'c', 'n', 'b', or 'u'.");
+        std::vector<int> frames;
+
+        for (size_t i = 0; i < runs.size(); i += 2) {
+            const char *pattern = handler.decimation_patterns.c_str() + i / 2 * 5;
+            int run_start = runs[i];
+            int run_end = std::min(run_start + runs[i + 1], source_frames);
+
+            for (int cycle = run_start; cycle < run_end; cycle += 5) {
+                for (int offset = 0; offset < 5; offset++) {
+                    if (pattern[offset] == 'd' && cycle + offset < source_frames)
+                        frames.push_back(cycle + offset);
+                    else if (pattern[offset] != 'd' && pattern[offset] != 'k')
+                        throw WobblyException(path + ": the decimation pattern in element number " + std::to_string(i / 2) + " of JSON key '" + Keys::decimated_frames + "' must contain only 'k' and 'd'.");
+                }
+            }
         }
+
+        addDecimatedFrames(frames);
+    } else if (capture->type != ProjectHandler::CaptureMissing) {
+        if (capture->type != ProjectHandler::CaptureArray || capture->elements > (size_t)source_frames)
+            throw WobblyException(path + ": JSON key '" + Keys::decimated_frames + "' must be an array with at most " + std::to_string(source_frames) + " elements.");
+
+        if (capture->bad_element >= 0 || capture->nested)
+            throw WobblyException(path + ": element number " + std::to_string(std::max(capture->bad_element, (int64_t)0)) + " of JSON key '" + Keys::decimated_frames + "' must be an integer.");
+
+        addDecimatedFrames(handler.decimated_frames);
     }
 
+    // getNumFrames(PostDecimate) is correct at this point.
+
+    capture = &handler.captures[ProjectHandler::DecimateMetricsKey];
+    if (capture->type != ProjectHandler::CaptureMissing && project_format_version >= 4) {
+        if (capture->type != ProjectHandler::CaptureString)
+            throw WobblyException(path + ": JSON key '" + Keys::decimate_metrics + "' must be a string.");
 
-    it = json_project.FindMember(Keys::combed_frames);
-    if (it != json_project.MemberEnd()) {
-        const rj::Value &json_combed_frames = it->value;
+        metrics->decimate_metrics.resize(source_frames);
+        metrics->decimate_metrics_text.swap(capture->text);
+    } else if (capture->type != ProjectHandler::CaptureMissing) {
+        if (capture->type != ProjectHandler::CaptureArray || capture->elements != (size_t)source_frames)
+            throw WobblyException(path + ": JSON key '" + Keys::decimate_metrics + "' must be an array with exactly " + std::to_string(source_frames) + " elements.");
+
+        if (capture->bad_element >= 0 || capture->nested)
+            throw WobblyException(path + ": element number " + std::to_string(std::max(capture->bad_element, (int64_t)0)) + " of JSON key '" + Keys::decimate_metrics + "' must be an integer.");
+
+        decimate_metrics.swap(handler.decimate_metrics);
+    }
 
-        if (!json_combed_frames.IsArray() || json_combed_frames.Size() > (rj::SizeType)getNumFrames(PostSource))
-            throw WobblyException(path + ": JSON key '" + Keys::combed_frames + "' must be an array with at most " + std::to_string(getNumFrames(PostSource)) + " elements.");
+    if (!metrics->isEmpty()) {
+        if (defer_metrics) {
+            deferred_metrics = std::move(metrics);
+        } else {
+            metrics->decode();
+            if (metrics->error.size())
+                throw WobblyException(metrics->error);
 
-        for (rj::SizeType i = 0; i < json_combed_frames.Size(); i++) {
-            if (!json_combed_frames[i].IsInt())
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::combed_frames + "' must be an integer.");
-            addCombedFrame(json_combed_frames[i].GetInt());
+            applyMetrics(*metrics);
         }
     }
 
 
-    decimated_frames.resize((getNumFrames(PostSource) - 1) / 5 + 1);
-    it = json_project.FindMember(Keys::decimated_frames);
+    it = json_project.FindMember(Keys::columns);
     if (it != json_project.MemberEnd()) {
-        const rj::Value &json_decimated_frames = it->value;
+        CHECK_OBJECT;
+
+        const rj::Value &json_columns = it->value;
 
-        if (!json_decimated_frames.IsArray() || json_decimated_frames.Size() > (rj::SizeType)getNumFrames(PostSource))
-            throw WobblyException(path + ": JSON key '" + Keys::decimated_frames + "' must be an array with at most " + std::to_string(getNumFrames(PostSource)) + " elements.");
+        it = json_columns.FindMember(Keys::Columns::file);
+        if (it == json_columns.MemberEnd() || !it->value.IsString())
+            throw WobblyException(path + ": JSON key '" + Keys::columns + "' must contain the key '" + Keys::Columns::file + "', which must be a string.");
 
-        for (rj::SizeType i = 0; i < json_decimated_frames.Size(); i++) {
-            if (!json_decimated_frames[i].IsInt())
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::decimated_frames + "' must be an integer.");
-            addDecimatedFrame(json_decimated_frames[i].GetInt());
+        // The column file lives next to the project.
+        std::string columns_path = QFileInfo(QString::fromStdString(path)).dir().filePath(QString::fromUtf8(it->value.GetString())).toStdString();
+
+        it = json_columns.FindMember(Keys::Columns::checksum);
+        if (it == json_columns.MemberEnd() || !it->value.IsUint())
+            throw WobblyException(path + ": JSON key '" + Keys::columns + "' must contain the key '" + Keys::Columns::checksum + "', which must be an unsigned integer.");
+
+        ProjectColumns columns;
+        columns.readFile(columns_path, it->value.GetUint());
+
+        size_t frames = getNumFrames(PostSource);
+
+        if (columns.hasColumn(ProjectColumns::ColumnMics)) {
+            mics.resize(frames);
+            columns.getColumn(ProjectColumns::ColumnMics, mics[0].data(), frames, 5);
         }
-    }
 
-    // getNumFrames(PostDecimate) is correct at this point.
+        if (columns.hasColumn(ProjectColumns::ColumnMMetrics)) {
+            mmetrics.resize(frames);
+            columns.getColumn(ProjectColumns::ColumnMMetrics, mmetrics[0].data(), frames, 2);
+        }
 
-    it = json_project.FindMember(Keys::decimate_metrics);
-    if (it != json_project.MemberEnd()) {
-        const rj::Value &json_decimate_metrics = it->value;
+        if (columns.hasColumn(ProjectColumns::ColumnVMetrics)) {
+            vmetrics.resize(frames);
+            columns.getColumn(ProjectColumns::ColumnVMetrics, vmetrics[0].data(), frames, 2);
+        }
 
-        if (!json_decimate_metrics.IsArray() || json_decimate_metrics.Size() != (rj::SizeType)getNumFrames(PostSource))
-            throw WobblyException(path + ": JSON key '" + Keys::decimate_metrics + "' must be an array with exactly " + std::to_string(getNumFrames(PostSource)) + " elements.");
+        if (columns.hasColumn(ProjectColumns::ColumnMatches)) {
+            matches.resize(frames);
+            columns.getColumn(ProjectColumns::ColumnMatches, (int8_t *)matches.data(), frames);
 
-        decimate_metrics.resize(getNumFrames(PostSource), 0);
-        for (size_t i = 0; i < decimate_metrics.size(); i++) {
-            if (!json_decimate_metrics[i].IsInt())
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::decimate_metrics + "' must be an integer.");
-            decimate_metrics[i] = json_decimate_metrics[i].GetInt();
+            for (size_t i = 0; i < frames; i++)
+                if (!isValidMatchChar(matches[i]))
+                    throw WobblyException(columns_path + ": element number " + std::to_string(i) + " of the matches must be one of 'p', 'c', 'n', 'b', or 'u'.");
+        }
+
+        if (columns.hasColumn(ProjectColumns::ColumnOriginalMatches)) {
+            original_matches.resize(frames);
+            columns.getColumn(ProjectColumns::ColumnOriginalMatches, (int8_t *)original_matches.data(), frames);
+
+            for (size_t i = 0; i < frames; i++)
+                if (!isValidMatchChar(original_matches[i]))
+                    throw WobblyException(columns_path + ": element number " + std::to_string(i) + " of the original matches must be one of 'p', 'c', 'n', 'b', or 'u'.");
+        }
+
+        if (columns.hasColumn(ProjectColumns::ColumnDecimateMetrics)) {
+            decimate_metrics.resize(frames);
+            columns.getColumn(ProjectColumns::ColumnDecimateMetrics, decimate_metrics.data(), frames);
+        }
+
+        const int list_columns[] = { ProjectColumns::ColumnCombedFrames, ProjectColumns::ColumnDecimatedFrames };
+
+        for (int column : list_columns) {
+            if (!columns.hasColumn(column))
+                continue;
+
+            size_t count = columns.getColumnCount(column);
+            if (count > frames)
+                throw WobblyException(columns_path + ": column " + std::to_string(column) + " must have at most " + std::to_string(frames) + " elements.");
+
+            std::vector<int> list(count);
+            columns.getColumn(column, list.data(), count);
+
+            if (column == ProjectColumns::ColumnCombedFrames)
+                addCombedFrames(list);
+            else
+                addDecimatedFrames(list);
         }
     }
 
@@ -1335,92 +3125,322 @@ void WobblyProject::readProject(const std::string &path) {
         if (it == json_crop.MemberEnd() || !it->value.IsInt())
             throw WobblyException(path + ": JSON key '" + Keys::crop + "' must contain the key '" + Keys::Crop::left + "', which must be an integer.");
 
-        crop.left = it->value.GetInt();
+        crop.left = it->value.GetInt();
+
+        it = json_crop.FindMember(Keys::Crop::top);
+        if (it == json_crop.MemberEnd() || !it->value.IsInt())
+            throw WobblyException(path + ": JSON key '" + Keys::crop + "' must contain the key '" + Keys::Crop::top + "', which must be an integer.");
+
+        crop.top = it->value.GetInt();
+
+        it = json_crop.FindMember(Keys::Crop::right);
+        if (it == json_crop.MemberEnd() || !it->value.IsInt())
+            throw WobblyException(path + ": JSON key '" + Keys::crop + "' must contain the key '" + Keys::Crop::right + "', which must be an integer.");
+
+        crop.right = it->value.GetInt();
+
+        it = json_crop.FindMember(Keys::Crop::bottom);
+        if (it == json_crop.MemberEnd() || !it->value.IsInt())
+            throw WobblyException(path + ": JSON key '" + Keys::crop + "' must contain the key '" + Keys::Crop::bottom + "', which must be an integer.");
+
+        crop.bottom = it->value.GetInt();
+    } else {
+        crop.enabled = false;
+    }
+
+    it = json_project.FindMember(Keys::depth);
+    if (it != json_project.MemberEnd()) {
+        CHECK_OBJECT;
+
+        const rj::Value &json_depth = it->value;
+
+        depth.enabled = true;
+
+        it = json_depth.FindMember(Keys::Depth::bits);
+        if (it == json_depth.MemberEnd() || !it->value.IsInt())
+            throw WobblyException(path + ": JSON key '" + Keys::depth + "' must contain the key '" + Keys::Depth::bits + "', which must be an integer.");
+
+        depth.bits = it->value.GetInt();
+
+        it = json_depth.FindMember(Keys::Depth::float_samples);
+        if (it == json_depth.MemberEnd() || !it->value.IsBool())
+            throw WobblyException(path + ": JSON key '" + Keys::depth + "' must contain the key '" + Keys::Depth::float_samples + "', which must be a boolean.");
+
+        depth.float_samples = it->value.GetBool();
+
+        it = json_depth.FindMember(Keys::Depth::dither);
+        if (it == json_depth.MemberEnd() || !it->value.IsString())
+            throw WobblyException(path + ": JSON key '" + Keys::depth + "' must contain the key '" + Keys::Depth::dither + "', which must be a string.");
+
+        depth.dither = it->value.GetString();
+    } else {
+        depth.enabled = false;
+    }
+
+
+    it = json_project.FindMember(Keys::interlaced_fades);
+    if (it != json_project.MemberEnd()) {
+        CHECK_ARRAY;
+
+        const rj::Value &json_interlaced_fades = it->value;
+
+        for (rj::SizeType i = 0; i < json_interlaced_fades.Size(); i++) {
+            const rj::Value &json_interlaced_fade = json_interlaced_fades[i];
+
+            if (!json_interlaced_fade.IsObject())
+                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::interlaced_fades + "' must be an object.");
+
+            it = json_interlaced_fade.FindMember(Keys::InterlacedFades::frame);
+            if (it == json_interlaced_fade.MemberEnd() || !it->value.IsInt())
+                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::interlaced_fades + "' must contain the key '" + Keys::InterlacedFades::frame + "', which must be an integer.");
+
+            int frame = it->value.GetInt();
+
+            it = json_interlaced_fade.FindMember(Keys::InterlacedFades::field_difference);
+            if (it == json_interlaced_fade.MemberEnd() || !it->value.IsNumber())
+                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::interlaced_fades + "' must contain the key '" + Keys::InterlacedFades::field_difference + "', which must be a number.");
+
+            double field_difference = it->value.GetDouble();
+
+            interlaced_fades.insert({ frame, { frame, field_difference } });
+        }
+    }
+
+
+    it = json_project.FindMember(Keys::journal);
+    if (it != json_project.MemberEnd()) {
+        CHECK_OBJECT;
+
+        const rj::Value &json_journal = it->value;
+
+        it = json_journal.FindMember(Keys::Journal::id);
+        if (it == json_journal.MemberEnd() || !it->value.IsString())
+            throw WobblyException(path + ": JSON key '" + Keys::journal + "' must contain the key '" + Keys::Journal::id + "', which must be a string.");
+
+        journal_id = it->value.GetString();
+
+        it = json_journal.FindMember(Keys::Journal::sequence);
+        if (it == json_journal.MemberEnd() || !it->value.IsUint64())
+            throw WobblyException(path + ": JSON key '" + Keys::journal + "' must contain the key '" + Keys::Journal::sequence + "', which must be an unsigned integer.");
+
+        journal_sequence = it->value.GetUint64();
+        journal_saved_sequence = journal_sequence;
+    }
+
+    setModified(false);
+}
+
+
+void WobblyProject::applyMetrics(DeferredMetrics &metrics) {
+    if (metrics.mics.size())
+        mics.swap(metrics.mics);
+    if (metrics.mmetrics.size())
+        mmetrics.swap(metrics.mmetrics);
+    if (metrics.vmetrics.size())
+        vmetrics.swap(metrics.vmetrics);
+    if (metrics.decimate_metrics.size())
+        decimate_metrics.swap(metrics.decimate_metrics);
+}
+
+
+bool WobblyProject::areMetricsLoaded() const {
+    return !deferred_metrics;
+}
+
+
+void WobblyProject::loadMetricsInBackground() {
+    if (!deferred_metrics || metrics_thread.joinable())
+        return;
+
+    // Only the thread touches the DeferredMetrics until it's joined.
+    DeferredMetrics *metrics = deferred_metrics.get();
+
+    metrics_thread = std::thread([this, metrics] () {
+        metrics->decode();
+
+        QMetaObject::invokeMethod(this, "finishLoadingMetrics", Qt::QueuedConnection);
+    });
+}
+
+
+void WobblyProject::waitForMetrics() {
+    if (!deferred_metrics)
+        return;
+
+    if (metrics_thread.joinable())
+        metrics_thread.join();
+    else
+        deferred_metrics->decode();
+
+    std::unique_ptr<DeferredMetrics> metrics(std::move(deferred_metrics));
+
+    // The project is already in use, so damaged metrics are left out instead of failing the whole thing.
+    if (metrics->error.size())
+        emit metricsFailed(QString::fromStdString(metrics->error));
+    else
+        applyMetrics(*metrics);
+
+    emit metricsLoaded();
+}
+
+
+void WobblyProject::finishLoadingMetrics() {
+    // Does nothing if something needed the metrics sooner.
+    waitForMetrics();
+}
+
+
+void WobblyProject::recordMutation(const std::string &record) {
+    try {
+        journal->append(++journal_sequence, record);
+    } catch (WobblyException &e) {
+        failJournal(e.what());
+        return;
+    }
+
+    if (!journal_timer->isActive())
+        journal_timer->start();
+
+    if (journal->wantsCompaction())
+        emit journalFull();
+}
+
+
+void WobblyProject::flushJournal() {
+    if (!journal)
+        return;
+
+    try {
+        journal->flush();
+    } catch (WobblyException &e) {
+        failJournal(e.what());
+    }
+}
+
+
+void WobblyProject::failJournal(const std::string &message) {
+    // The edits themselves went through. Only the crash recovery is gone.
+    stopJournal();
+
+    emit journalFailed(QString::fromStdString(message));
+}
+
+
+void WobblyProject::startJournal(const std::string &project_path) {
+    // When saved somewhere else, the journal stays next to the old project
+    // until the new one was written. compactJournal() moves it then.
+    if (journal)
+        return;
+
+    std::string journal_path = ProjectJournal::getJournalPath(project_path);
+
+    if (journal_id.empty())
+        journal_id = QUuid::createUuid().toString().toStdString();
+
+    journal = new ProjectJournal;
+
+    try {
+        journal->open(journal_path, journal_id);
+    } catch (WobblyException &) {
+        delete journal;
+        journal = nullptr;
 
-        it = json_crop.FindMember(Keys::Crop::top);
-        if (it == json_crop.MemberEnd() || !it->value.IsInt())
-            throw WobblyException(path + ": JSON key '" + Keys::crop + "' must contain the key '" + Keys::Crop::top + "', which must be an integer.");
+        throw;
+    }
 
-        crop.top = it->value.GetInt();
+    journal_timer = new QTimer(this);
+    journal_timer->setSingleShot(true);
+    journal_timer->setInterval(1000);
+    connect(journal_timer, &QTimer::timeout, this, &WobblyProject::flushJournal);
+}
 
-        it = json_crop.FindMember(Keys::Crop::right);
-        if (it == json_crop.MemberEnd() || !it->value.IsInt())
-            throw WobblyException(path + ": JSON key '" + Keys::crop + "' must contain the key '" + Keys::Crop::right + "', which must be an integer.");
 
-        crop.right = it->value.GetInt();
+void WobblyProject::stopJournal() {
+    if (!journal)
+        return;
 
-        it = json_crop.FindMember(Keys::Crop::bottom);
-        if (it == json_crop.MemberEnd() || !it->value.IsInt())
-            throw WobblyException(path + ": JSON key '" + Keys::crop + "' must contain the key '" + Keys::Crop::bottom + "', which must be an integer.");
+    delete journal_timer;
+    journal_timer = nullptr;
+
+    // Nothing is lost if the last batch can't be written, because the project is still in memory.
+    try {
+        journal->close();
+    } catch (WobblyException &) {
 
-        crop.bottom = it->value.GetInt();
-    } else {
-        crop.enabled = false;
     }
 
-    it = json_project.FindMember(Keys::depth);
-    if (it != json_project.MemberEnd()) {
-        CHECK_OBJECT;
+    delete journal;
+    journal = nullptr;
+}
 
-        const rj::Value &json_depth = it->value;
 
-        depth.enabled = true;
+int WobblyProject::replayJournal(const std::string &project_path) {
+    if (journal_id.empty())
+        return 0;
 
-        it = json_depth.FindMember(Keys::Depth::bits);
-        if (it == json_depth.MemberEnd() || !it->value.IsInt())
-            throw WobblyException(path + ": JSON key '" + Keys::depth + "' must contain the key '" + Keys::Depth::bits + "', which must be an integer.");
+    std::vector<ProjectJournal::Entry> entries = ProjectJournal::readFile(ProjectJournal::getJournalPath(project_path), journal_id);
 
-        depth.bits = it->value.GetInt();
+    int replayed = 0;
 
-        it = json_depth.FindMember(Keys::Depth::float_samples);
-        if (it == json_depth.MemberEnd() || !it->value.IsBool())
-            throw WobblyException(path + ": JSON key '" + Keys::depth + "' must contain the key '" + Keys::Depth::float_samples + "', which must be a boolean.");
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].sequence <= journal_sequence)
+            continue;
 
-        depth.float_samples = it->value.GetBool();
+        rj::Document json_entry;
+        json_entry.Parse(entries[i].line.c_str());
 
-        it = json_depth.FindMember(Keys::Depth::dither);
-        if (it == json_depth.MemberEnd() || !it->value.IsString())
-            throw WobblyException(path + ": JSON key '" + Keys::depth + "' must contain the key '" + Keys::Depth::dither + "', which must be a string.");
+        try {
+            applyJournalRecord(this, json_entry[1]);
+        } catch (WobblyException &) {
+            // Later edits may depend on this one.
+            break;
+        }
 
-        depth.dither = it->value.GetString();
-    } else {
-        depth.enabled = false;
+        journal_sequence = entries[i].sequence;
+        replayed++;
     }
 
+    // Whatever couldn't be applied must not be confused with the edits recorded from now on.
+    if (entries.size())
+        journal_sequence = std::max(journal_sequence, entries.back().sequence);
 
-    it = json_project.FindMember(Keys::interlaced_fades);
-    if (it != json_project.MemberEnd()) {
-        CHECK_ARRAY;
-
-        const rj::Value &json_interlaced_fades = it->value;
+    if (replayed)
+        setModified(true);
 
-        for (rj::SizeType i = 0; i < json_interlaced_fades.Size(); i++) {
-            const rj::Value &json_interlaced_fade = json_interlaced_fades[i];
+    return replayed;
+}
 
-            if (!json_interlaced_fade.IsObject())
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::interlaced_fades + "' must be an object.");
 
-            it = json_interlaced_fade.FindMember(Keys::InterlacedFades::frame);
-            if (it == json_interlaced_fade.MemberEnd() || !it->value.IsInt())
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::interlaced_fades + "' must contain the key '" + Keys::InterlacedFades::frame + "', which must be an integer.");
+void WobblyProject::discardJournal() {
+    compactJournal(journal_saved_sequence);
+}
 
-            int frame = it->value.GetInt();
 
-            it = json_interlaced_fade.FindMember(Keys::InterlacedFades::field_difference);
-            if (it == json_interlaced_fade.MemberEnd() || !it->value.IsNumber())
-                throw WobblyException(path + ": element number " + std::to_string(i) + " of JSON key '" + Keys::interlaced_fades + "' must contain the key '" + Keys::InterlacedFades::field_difference + "', which must be a number.");
+void WobblyProject::compactJournal(uint64_t saved_sequence, const std::string &project_path) {
+    journal_saved_sequence = saved_sequence;
 
-            double field_difference = it->value.GetDouble();
+    if (!journal)
+        return;
 
-            interlaced_fades.insert({ frame, { frame, field_difference } });
-        }
+    try {
+        if (project_path.empty())
+            journal->compact(saved_sequence);
+        else
+            journal->moveTo(ProjectJournal::getJournalPath(project_path), saved_sequence);
+    } catch (WobblyException &e) {
+        failJournal(e.what());
     }
+}
 
-    setModified(false);
+
+uint64_t WobblyProject::getJournalSequence() const {
+    return journal_sequence;
 }
 
 
 void WobblyProject::addFreezeFrame(int first, int last, int replacement) {
+    JournalScope journal_scope(this, "addFreezeFrame", first, last, replacement);
+
     if (first > last)
         std::swap(first, last);
 
@@ -1453,6 +3473,8 @@ void WobblyProject::addFreezeFrame(int first, int last, int replacement) {
 
 
 void WobblyProject::deleteFreezeFrame(int frame) {
+    JournalScope journal_scope(this, "deleteFreezeFrame", frame);
+
     frozen_frames->erase(frame);
 
     setModified(true);
@@ -1480,6 +3502,8 @@ FrozenFramesModel *WobblyProject::getFrozenFramesModel() {
 
 
 void WobblyProject::addPreset(const std::string &preset_name) {
+    JournalScope journal_scope(this, "addPreset", preset_name);
+
     addPreset(preset_name, "");
 }
 
@@ -1497,6 +3521,8 @@ bool WobblyProject::isNameSafeForPython(const std::string &name) const {
 
 
 void WobblyProject::addPreset(const std::string &preset_name, const std::string &preset_contents) {
+    JournalScope journal_scope(this, "addPreset", preset_name, preset_contents);
+
     if (!isNameSafeForPython(preset_name))
         throw WobblyException("Can't add preset '" + preset_name + "': name is invalid. Use only letters, numbers, and the underscore character. The first character cannot be a number.");
 
@@ -1513,6 +3539,8 @@ void WobblyProject::addPreset(const std::string &preset_name, const std::string
 
 
 void WobblyProject::renamePreset(const std::string &old_name, const std::string &new_name) {
+    JournalScope journal_scope(this, "renamePreset", old_name, new_name);
+
     if (old_name == new_name)
         return;
 
@@ -1546,6 +3574,8 @@ void WobblyProject::renamePreset(const std::string &old_name, const std::string
 
 
 void WobblyProject::deletePreset(const std::string &preset_name) {
+    JournalScope journal_scope(this, "deletePreset", preset_name);
+
     if (!presetExists(preset_name))
         throw WobblyException("Can't delete preset '" + preset_name + "': no such preset.");
 
@@ -1574,6 +3604,8 @@ const std::string &WobblyProject::getPresetContents(const std::string &preset_na
 
 
 void WobblyProject::setPresetContents(const std::string &preset_name, const std::string &preset_contents) {
+    JournalScope journal_scope(this, "setPresetContents", preset_name, preset_contents);
+
     if (!presets->count(preset_name))
         throw WobblyException("Can't modify the contents of preset '" + preset_name + "': no such preset.");
 
@@ -1672,6 +3704,8 @@ void WobblyProject::setMics(int frame, int16_t mic_p, int16_t mic_c, int16_t mic
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't set the mics for frame " + std::to_string(frame) + ": frame number out of range.");
 
+    waitForMetrics();
+
     if (!mics.size())
         mics.resize(getNumFrames(PostSource), { 0 });
 
@@ -1688,6 +3722,8 @@ void WobblyProject::setDMetrics(int frame, int32_t mmetric_p, int32_t mmetric_c,
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't set the mics for frame " + std::to_string(frame) + ": frame number out of range.");
 
+    waitForMetrics();
+
     if (!mmetrics.size())
         mmetrics.resize(getNumFrames(PostSource), { 0 });
 
@@ -1704,6 +3740,27 @@ void WobblyProject::setDMetrics(int frame, int32_t mmetric_p, int32_t mmetric_c,
 }
 
 
+void WobblyProject::setMics(const std::vector<std::array<int16_t, 5> > &new_mics) {
+    if (new_mics.size() != (size_t)getNumFrames(PostSource))
+        throw WobblyException("Can't set the mics: expected " + std::to_string(getNumFrames(PostSource)) + " frames, got " + std::to_string(new_mics.size()) + ".");
+
+    waitForMetrics();
+
+    mics = new_mics;
+}
+
+
+void WobblyProject::setDMetrics(const std::vector<std::array<int32_t, 2> > &new_mmetrics, const std::vector<std::array<int32_t, 2> > &new_vmetrics) {
+    if (new_mmetrics.size() != (size_t)getNumFrames(PostSource) || new_vmetrics.size() != (size_t)getNumFrames(PostSource))
+        throw WobblyException("Can't set the mmetrics and vmetrics: expected " + std::to_string(getNumFrames(PostSource)) + " frames, got " + std::to_string(new_mmetrics.size()) + " and " + std::to_string(new_vmetrics.size()) + ".");
+
+    waitForMetrics();
+
+    mmetrics = new_mmetrics;
+    vmetrics = new_vmetrics;
+}
+
+
 int WobblyProject::getPreviousFrameWithMic(int minimum, int start_frame) const {
     if (start_frame < 0 || start_frame >= getNumFrames(PostSource))
         throw WobblyException("Can't get the previous frame with mic " + std::to_string(minimum) + " or greater: frame " + std::to_string(start_frame) + " is out of range.");
@@ -1761,6 +3818,18 @@ void WobblyProject::setOriginalMatch(int frame, char match) {
 }
 
 
+void WobblyProject::setOriginalMatches(const std::vector<char> &new_matches) {
+    if (new_matches.size() != (size_t)getNumFrames(PostSource))
+        throw WobblyException("Can't set the original matches: expected " + std::to_string(getNumFrames(PostSource)) + " frames, got " + std::to_string(new_matches.size()) + ".");
+
+    for (size_t i = 0; i < new_matches.size(); i++)
+        if (!isValidMatchChar(new_matches[i]))
+            throw WobblyException("Can't set the original match for frame " + std::to_string(i) + ": '" + new_matches[i] + "' is not a valid match character.");
+
+    original_matches = new_matches;
+}
+
+
 char WobblyProject::getMatch(int frame) const {
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't get the match for frame " + std::to_string(frame) + ": frame number out of range.");
@@ -1775,6 +3844,8 @@ char WobblyProject::getMatch(int frame) const {
 
 
 void WobblyProject::setMatch(int frame, char match) {
+    JournalScope journal_scope(this, "setMatch", frame, match);
+
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't set the match for frame " + std::to_string(frame) + ": frame number out of range.");
 
@@ -1795,6 +3866,8 @@ void WobblyProject::setMatch(int frame, char match) {
 
 
 void WobblyProject::cycleMatchBCN(int frame) {
+    JournalScope journal_scope(this, "cycleMatchBCN", frame);
+
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't cycle the match for frame " + std::to_string(frame) + ": frame number out of range.");
 
@@ -1823,6 +3896,8 @@ void WobblyProject::cycleMatchBCN(int frame) {
 
 
 void WobblyProject::cycleMatch(int frame) {
+    JournalScope journal_scope(this, "cycleMatch", frame);
+
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't cycle the match for frame " + std::to_string(frame) + ": frame number out of range.");
 
@@ -1861,6 +3936,8 @@ void WobblyProject::cycleMatch(int frame) {
 
 
 void WobblyProject::addSection(int section_start) {
+    JournalScope journal_scope(this, "addSection", section_start);
+
     Section section(section_start);
     addSection(section);
 }
@@ -1876,7 +3953,31 @@ void WobblyProject::addSection(const Section &section) {
 }
 
 
+void WobblyProject::addSections(const std::vector<int> &section_starts) {
+    JournalScope journal_scope(this, "addSections", section_starts);
+
+    if (!section_starts.size())
+        return;
+
+    std::vector<Section> new_sections;
+    new_sections.reserve(section_starts.size());
+
+    for (auto it = section_starts.cbegin(); it != section_starts.cend(); it++) {
+        if (*it < 0 || *it >= getNumFrames(PostSource))
+            throw WobblyException("Can't add section starting at " + std::to_string(*it) + ": value out of range.");
+
+        new_sections.push_back(Section(*it));
+    }
+
+    sections->insert(new_sections);
+
+    setModified(true);
+}
+
+
 void WobblyProject::deleteSection(int section_start) {
+    JournalScope journal_scope(this, "deleteSection", section_start);
+
     if (section_start < 0 || section_start >= getNumFrames(PostSource))
         throw WobblyException("Can't delete section starting at " + std::to_string(section_start) + ": value out of range.");
 
@@ -1927,6 +4028,8 @@ int WobblyProject::getSectionEnd(int frame) const {
 
 
 void WobblyProject::setSectionPreset(int section_start, const std::string &preset_name) {
+    JournalScope journal_scope(this, "setSectionPreset", section_start, preset_name);
+
     if (section_start < 0 || section_start >= getNumFrames(PostSource))
         throw WobblyException("Can't add preset '" + preset_name + "' to section starting at " + std::to_string(section_start) + ": frame number out of range.");
 
@@ -1944,6 +4047,8 @@ void WobblyProject::setSectionPreset(int section_start, const std::string &prese
 
 
 void WobblyProject::deleteSectionPreset(int section_start, size_t preset_index) {
+    JournalScope journal_scope(this, "deleteSectionPreset", section_start, preset_index);
+
     if (section_start < 0 || section_start >= getNumFrames(PostSource))
         throw WobblyException("Can't delete preset number " + std::to_string(preset_index) + " from section starting at " + std::to_string(section_start) + ": frame number out of range.");
 
@@ -1957,6 +4062,8 @@ void WobblyProject::deleteSectionPreset(int section_start, size_t preset_index)
 
 
 void WobblyProject::moveSectionPresetUp(int section_start, size_t preset_index) {
+    JournalScope journal_scope(this, "moveSectionPresetUp", section_start, preset_index);
+
     if (section_start < 0 || section_start >= getNumFrames(PostSource))
         throw WobblyException("Can't move up preset number " + std::to_string(preset_index) + " from section starting at " + std::to_string(section_start) + ": frame number out of range.");
 
@@ -1970,6 +4077,8 @@ void WobblyProject::moveSectionPresetUp(int section_start, size_t preset_index)
 
 
 void WobblyProject::moveSectionPresetDown(int section_start, size_t preset_index) {
+    JournalScope journal_scope(this, "moveSectionPresetDown", section_start, preset_index);
+
     if (section_start < 0 || section_start >= getNumFrames(PostSource))
         throw WobblyException("Can't move down preset number " + std::to_string(preset_index) + " from section starting at " + std::to_string(section_start) + ": frame number out of range.");
 
@@ -1983,6 +4092,8 @@ void WobblyProject::moveSectionPresetDown(int section_start, size_t preset_index
 
 
 void WobblyProject::setSectionMatchesFromPattern(int section_start, const std::string &pattern) {
+    JournalScope journal_scope(this, "setSectionMatchesFromPattern", section_start, pattern);
+
     if (section_start < 0 || section_start >= getNumFrames(PostSource))
         throw WobblyException("Can't apply match pattern to section starting at " + std::to_string(section_start) + ": frame number out of range.");
 
@@ -1998,6 +4109,8 @@ void WobblyProject::setSectionMatchesFromPattern(int section_start, const std::s
 
 
 void WobblyProject::setSectionDecimationFromPattern(int section_start, const std::string &pattern) {
+    JournalScope journal_scope(this, "setSectionDecimationFromPattern", section_start, pattern);
+
     if (section_start < 0 || section_start >= getNumFrames(PostSource))
         throw WobblyException("Can't apply decimation pattern to section starting at " + std::to_string(section_start) + ": frame number out of range.");
 
@@ -2018,6 +4131,8 @@ SectionsModel *WobblyProject::getSectionsModel() {
 
 
 void WobblyProject::setRangeMatchesFromPattern(int range_start, int range_end, const std::string &pattern) {
+    JournalScope journal_scope(this, "setRangeMatchesFromPattern", range_start, range_end, pattern);
+
     if (range_start > range_end)
         std::swap(range_start, range_end);
 
@@ -2038,6 +4153,8 @@ void WobblyProject::setRangeMatchesFromPattern(int range_start, int range_end, c
 
 
 void WobblyProject::setRangeDecimationFromPattern(int range_start, int range_end, const std::string &pattern) {
+    JournalScope journal_scope(this, "setRangeDecimationFromPattern", range_start, range_end, pattern);
+
     if (range_start > range_end)
         std::swap(range_start, range_end);
 
@@ -2056,6 +4173,8 @@ void WobblyProject::setRangeDecimationFromPattern(int range_start, int range_end
 
 
 void WobblyProject::resetRangeMatches(int start, int end) {
+    JournalScope journal_scope(this, "resetRangeMatches", start, end);
+
     if (start > end)
         std::swap(start, end);
 
@@ -2075,6 +4194,8 @@ void WobblyProject::resetRangeMatches(int start, int end) {
 
 
 void WobblyProject::resetSectionMatches(int section_start) {
+    JournalScope journal_scope(this, "resetSectionMatches", section_start);
+
     if (section_start < 0 || section_start >= getNumFrames(PostSource))
         throw WobblyException("Can't reset the matches for section starting at " + std::to_string(section_start) + ": frame number out of range.");
 
@@ -2090,6 +4211,8 @@ void WobblyProject::resetSectionMatches(int section_start) {
 
 
 void WobblyProject::addCustomList(const std::string &list_name) {
+    JournalScope journal_scope(this, "addCustomList", list_name);
+
     CustomList list(list_name);
     addCustomList(list);
 }
@@ -2111,11 +4234,20 @@ void WobblyProject::addCustomList(const CustomList &list) {
 
     custom_lists->push_back(list);
 
+    // The list may come with ranges, e.g. when imported from another project.
+    int list_index = custom_lists->size() - 1;
+    const auto &ranges = custom_lists->at(list_index).ranges;
+
+    for (auto it = ranges->cbegin(); it != ranges->cend(); it++)
+        custom_list_index.insert(it->second.first, it->second.last, { list_index, &it->second });
+
     setModified(true);
 }
 
 
 void WobblyProject::renameCustomList(const std::string &old_name, const std::string &new_name) {
+    JournalScope journal_scope(this, "renameCustomList", old_name, new_name);
+
     if (old_name == new_name)
         return;
 
@@ -2144,6 +4276,8 @@ void WobblyProject::renameCustomList(const std::string &old_name, const std::str
 
 
 void WobblyProject::deleteCustomList(const std::string &list_name) {
+    JournalScope journal_scope(this, "deleteCustomList", list_name);
+
     for (size_t i = 0; i < custom_lists->size(); i++)
         if (custom_lists->at(i).name == list_name) {
             deleteCustomList(i);
@@ -2155,16 +4289,22 @@ void WobblyProject::deleteCustomList(const std::string &list_name) {
 
 
 void WobblyProject::deleteCustomList(int list_index) {
+    JournalScope journal_scope(this, "deleteCustomList", list_index);
+
     if (list_index < 0 || list_index >= (int)custom_lists->size())
         throw WobblyException("Can't delete custom list with index " + std::to_string(list_index) + ": index out of range.");
 
     custom_lists->erase(list_index);
 
+    rebuildCustomListIndex();
+
     setModified(true);
 }
 
 
 void WobblyProject::moveCustomListUp(int list_index) {
+    JournalScope journal_scope(this, "moveCustomListUp", list_index);
+
     if (list_index < 0 || list_index >= (int)custom_lists->size())
         throw WobblyException("Can't move up custom list with index " + std::to_string(list_index) + ": index out of range.");
 
@@ -2173,11 +4313,15 @@ void WobblyProject::moveCustomListUp(int list_index) {
 
     custom_lists->moveCustomListUp(list_index);
 
+    rebuildCustomListIndex();
+
     setModified(true);
 }
 
 
 void WobblyProject::moveCustomListDown(int list_index) {
+    JournalScope journal_scope(this, "moveCustomListDown", list_index);
+
     if (list_index < 0 || list_index >= (int)custom_lists->size())
         throw WobblyException("Can't move down custom list with index " + std::to_string(list_index) + ": index out of range.");
 
@@ -2186,6 +4330,8 @@ void WobblyProject::moveCustomListDown(int list_index) {
 
     custom_lists->moveCustomListDown(list_index);
 
+    rebuildCustomListIndex();
+
     setModified(true);
 }
 
@@ -2199,6 +4345,8 @@ const std::string &WobblyProject::getCustomListPreset(int list_index) const {
 
 
 void WobblyProject::setCustomListPreset(int list_index, const std::string &preset_name) {
+    JournalScope journal_scope(this, "setCustomListPreset", list_index, preset_name);
+
     if (list_index < 0 || list_index >= (int)custom_lists->size())
         throw WobblyException("Can't assign preset '" + preset_name + "' to custom list with index " + std::to_string(list_index) + ": index out of range.");
 
@@ -2222,6 +4370,8 @@ PositionInFilterChain WobblyProject::getCustomListPosition(int list_index) const
 
 
 void WobblyProject::setCustomListPosition(int list_index, PositionInFilterChain position) {
+    JournalScope journal_scope(this, "setCustomListPosition", list_index, position);
+
     if (list_index < 0 || list_index >= (int)custom_lists->size())
         throw WobblyException("Can't set the position of the custom list with index " + std::to_string(list_index) + ": index out of range.");
 
@@ -2237,6 +4387,8 @@ void WobblyProject::setCustomListPosition(int list_index, PositionInFilterChain
 
 
 void WobblyProject::addCustomListRange(int list_index, int first, int last) {
+    JournalScope journal_scope(this, "addCustomListRange", list_index, first, last);
+
     if (list_index < 0 || list_index >= (int)custom_lists->size())
         throw WobblyException("Can't add a new range to custom list with index " + std::to_string(list_index) + ": index out of range.");
 
@@ -2251,9 +4403,16 @@ void WobblyProject::addCustomListRange(int list_index, int first, int last) {
     if (first > last)
         std::swap(first, last);
 
-    const FrameRange *overlap = findCustomListRange(list_index, first);
-    if (!overlap)
-        overlap = findCustomListRange(list_index, last);
+    // The index finds this list's ranges containing first or last.
+    // Only a range lying entirely between them needs the list itself.
+    std::vector<std::pair<int, const FrameRange *> > covering;
+    custom_list_index.find(first, covering);
+    custom_list_index.find(last, covering);
+
+    const FrameRange *overlap = nullptr;
+    for (size_t i = 0; i < covering.size() && !overlap; i++)
+        if (covering[i].first == list_index)
+            overlap = covering[i].second;
     if (!overlap) {
         auto it = ranges->upper_bound(first);
         if (it != ranges->cend() && it->second.first < last)
@@ -2265,11 +4424,15 @@ void WobblyProject::addCustomListRange(int list_index, int first, int last) {
 
     ranges->insert({ first, { first, last } });
 
+    custom_list_index.insert(first, last, { list_index, findCustomListRange(list_index, first) });
+
     setModified(true);
 }
 
 
 void WobblyProject::deleteCustomListRange(int list_index, int first) {
+    JournalScope journal_scope(this, "deleteCustomListRange", list_index, first);
+
     if (list_index < 0 || list_index >= (int)custom_lists->size())
         throw WobblyException("Can't delete a range from custom list with index " + std::to_string(list_index) + ": index out of range.");
 
@@ -2280,6 +4443,10 @@ void WobblyProject::deleteCustomListRange(int list_index, int first) {
     if (!ranges->count(first))
         throw WobblyException("Can't delete range starting at frame " + std::to_string(first) + " from custom list '" + cl.name + "': no such range.");
 
+    const FrameRange *range = findCustomListRange(list_index, first);
+
+    custom_list_index.erase(range->first, range->last, { list_index, range });
+
     ranges->erase(first);
 
     setModified(true);
@@ -2309,6 +4476,32 @@ const FrameRange *WobblyProject::findCustomListRange(int list_index, int frame)
 }
 
 
+std::vector<std::pair<int, const FrameRange *> > WobblyProject::findCustomListRanges(int frame) const {
+    std::vector<std::pair<int, const FrameRange *> > found;
+
+    if (frame < 0)
+        return found;
+
+    custom_list_index.find(frame, found);
+
+    std::sort(found.begin(), found.end());
+
+    return found;
+}
+
+
+void WobblyProject::rebuildCustomListIndex() {
+    custom_list_index.clear();
+
+    for (size_t i = 0; i < custom_lists->size(); i++) {
+        const auto &ranges = custom_lists->at(i).ranges;
+
+        for (auto it = ranges->cbegin(); it != ranges->cend(); it++)
+            custom_list_index.insert(it->second.first, it->second.last, { (int)i, &it->second });
+    }
+}
+
+
 bool WobblyProject::customListExists(const std::string &list_name) const {
     for (size_t i = 0; i < custom_lists->size(); i++)
         if (custom_lists->at(i).name == list_name)
@@ -2348,6 +4541,8 @@ void WobblyProject::setDecimateMetric(int frame, int decimate_metric) {
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't set the decimation metric for frame " + std::to_string(frame) + ": frame number out of range.");
 
+    waitForMetrics();
+
     if (!decimate_metrics.size())
         decimate_metrics.resize(getNumFrames(PostSource), 0);
 
@@ -2355,17 +4550,33 @@ void WobblyProject::setDecimateMetric(int frame, int decimate_metric) {
 }
 
 
+void WobblyProject::setDecimateMetrics(const std::vector<int> &new_metrics) {
+    if (new_metrics.size() != (size_t)getNumFrames(PostSource))
+        throw WobblyException("Can't set the decimation metrics: expected " + std::to_string(getNumFrames(PostSource)) + " frames, got " + std::to_string(new_metrics.size()) + ".");
+
+    waitForMetrics();
+
+    decimate_metrics = new_metrics;
+}
+
+
 void WobblyProject::addDecimatedFrame(int frame) {
+    JournalScope journal_scope(this, "addDecimatedFrame", frame);
+
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't mark frame " + std::to_string(frame) + " for decimation: value out of range.");
 
+    uint8_t &cycle = decimated_frames[frame / 5];
+    uint8_t bit = 1 << (frame % 5);
+
     // Don't allow decimating all the frames in a cycle.
-    if (decimated_frames[frame / 5].size() == 5 - 1)
+    if (countDecimatedFrames(cycle) == 5 - 1)
         return;
 
-    auto result = decimated_frames[frame / 5].insert(frame % 5);
+    if (!(cycle & bit)) {
+        cycle |= bit;
+        updateDecimationIndex(frame / 5, 1);
 
-    if (result.second) {
         setNumFrames(PostDecimate, getNumFrames(PostDecimate) - 1);
 
         setModified(true);
@@ -2373,13 +4584,50 @@ void WobblyProject::addDecimatedFrame(int frame) {
 }
 
 
+void WobblyProject::addDecimatedFrames(const std::vector<int> &frames) {
+    JournalScope journal_scope(this, "addDecimatedFrames", frames);
+
+    int decimated = 0;
+
+    for (auto it = frames.cbegin(); it != frames.cend(); it++) {
+        if (*it < 0 || *it >= getNumFrames(PostSource))
+            throw WobblyException("Can't mark frame " + std::to_string(*it) + " for decimation: value out of range.");
+
+        uint8_t &cycle = decimated_frames[*it / 5];
+        uint8_t bit = 1 << (*it % 5);
+
+        // Don't allow decimating all the frames in a cycle.
+        if (countDecimatedFrames(cycle) == 5 - 1)
+            continue;
+
+        if (!(cycle & bit)) {
+            cycle |= bit;
+            updateDecimationIndex(*it / 5, 1);
+            decimated++;
+        }
+    }
+
+    if (decimated) {
+        setNumFrames(PostDecimate, getNumFrames(PostDecimate) - decimated);
+
+        setModified(true);
+    }
+}
+
+
 void WobblyProject::deleteDecimatedFrame(int frame) {
+    JournalScope journal_scope(this, "deleteDecimatedFrame", frame);
+
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't delete decimated frame " + std::to_string(frame) + ": value out of range.");
 
-    size_t result = decimated_frames[frame / 5].erase(frame % 5);
+    uint8_t &cycle = decimated_frames[frame / 5];
+    uint8_t bit = 1 << (frame % 5);
+
+    if (cycle & bit) {
+        cycle &= ~bit;
+        updateDecimationIndex(frame / 5, -1);
 
-    if (result) {
         setNumFrames(PostDecimate, getNumFrames(PostDecimate) + 1);
 
         setModified(true);
@@ -2391,24 +4639,51 @@ bool WobblyProject::isDecimatedFrame(int frame) const {
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't check if frame " + std::to_string(frame) + " is decimated: value out of range.");
 
-    return (bool)decimated_frames[frame / 5].count(frame % 5);
+    return decimated_frames[frame / 5] & (1 << (frame % 5));
 }
 
 
 void WobblyProject::clearDecimatedFramesFromCycle(int frame) {
+    JournalScope journal_scope(this, "clearDecimatedFramesFromCycle", frame);
+
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't clear decimated frames from cycle containing frame " + std::to_string(frame) + ": value out of range.");
 
     int cycle = frame / 5;
 
-    size_t new_frames = decimated_frames[cycle].size();
+    int new_frames = countDecimatedFrames(decimated_frames[cycle]);
 
-    decimated_frames[cycle].clear();
+    decimated_frames[cycle] = 0;
+    updateDecimationIndex(cycle, -new_frames);
 
     setNumFrames(PostDecimate, getNumFrames(PostDecimate) + new_frames);
 }
 
 
+void WobblyProject::resetDecimatedFrames(int cycles) {
+    decimated_frames.assign(cycles, 0);
+    decimation_index.assign(cycles + 1, 0);
+}
+
+
+// decimation_index is a Fenwick tree: element i holds the number of
+// frames dropped from cycles i - (i & -i) to i - 1.
+void WobblyProject::updateDecimationIndex(int cycle, int change) {
+    for (size_t i = cycle + 1; i < decimation_index.size(); i += i & -i)
+        decimation_index[i] += change;
+}
+
+
+int WobblyProject::countDroppedFramesBefore(int cycle) const {
+    int dropped = 0;
+
+    for (size_t i = cycle; i > 0; i -= i & -i)
+        dropped += decimation_index[i];
+
+    return dropped;
+}
+
+
 DecimationRangeVector WobblyProject::getDecimationRanges() const {
     DecimationRangeVector ranges;
 
@@ -2416,9 +4691,11 @@ DecimationRangeVector WobblyProject::getDecimationRanges() const {
     current_range.num_dropped = -1;
 
     for (size_t i = 0; i < decimated_frames.size(); i++) {
-        if ((int)decimated_frames[i].size() != current_range.num_dropped) {
+        int num_dropped = countDecimatedFrames(decimated_frames[i]);
+
+        if (num_dropped != current_range.num_dropped) {
             current_range.start = i * 5;
-            current_range.num_dropped = decimated_frames[i].size();
+            current_range.num_dropped = num_dropped;
             ranges.push_back(current_range);
         }
     }
@@ -2427,31 +4704,12 @@ DecimationRangeVector WobblyProject::getDecimationRanges() const {
 }
 
 
-static bool areDecimationPatternsEqual(const std::set<int8_t> &a, const std::set<int8_t> &b) {
-    if (a.size() != b.size())
-        return false;
-
-    for (auto it1 = a.cbegin(), it2 = b.cbegin(); it1 != a.cend(); it1++, it2++)
-        if (*it1 != *it2)
-            return false;
-
-    return true;
-}
-
-
 DecimationPatternRangeVector WobblyProject::getDecimationPatternRanges() const {
     DecimationPatternRangeVector ranges;
 
-    DecimationPatternRange current_range;
-    current_range.dropped_offsets.insert(-1);
-
-    for (size_t i = 0; i < decimated_frames.size(); i++) {
-        if (!areDecimationPatternsEqual(decimated_frames[i], current_range.dropped_offsets)) {
-            current_range.start = i * 5;
-            current_range.dropped_offsets = decimated_frames[i];
-            ranges.push_back(current_range);
-        }
-    }
+    for (size_t i = 0; i < decimated_frames.size(); i++)
+        if (ranges.empty() || decimated_frames[i] != ranges.back().dropped_offsets)
+            ranges.push_back({ (int)i * 5, decimated_frames[i] });
 
     return ranges;
 }
@@ -2499,6 +4757,8 @@ CombedFramesModel *WobblyProject::getCombedFramesModel() {
 
 
 void WobblyProject::addCombedFrame(int frame) {
+    JournalScope journal_scope(this, "addCombedFrame", frame);
+
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't mark frame " + std::to_string(frame) + " as combed: value out of range.");
 
@@ -2508,7 +4768,25 @@ void WobblyProject::addCombedFrame(int frame) {
 }
 
 
+void WobblyProject::addCombedFrames(const std::vector<int> &frames) {
+    JournalScope journal_scope(this, "addCombedFrames", frames);
+
+    if (!frames.size())
+        return;
+
+    for (auto it = frames.cbegin(); it != frames.cend(); it++)
+        if (*it < 0 || *it >= getNumFrames(PostSource))
+            throw WobblyException("Can't mark frame " + std::to_string(*it) + " as combed: value out of range.");
+
+    combed_frames->insert(frames);
+
+    setModified(true);
+}
+
+
 void WobblyProject::deleteCombedFrame(int frame) {
+    JournalScope journal_scope(this, "deleteCombedFrame", frame);
+
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't mark frame " + std::to_string(frame) + " as not combed: value out of range.");
 
@@ -2527,6 +4805,8 @@ bool WobblyProject::isCombedFrame(int frame) const {
 
 
 void WobblyProject::clearCombedFrames() {
+    JournalScope journal_scope(this, "clearCombedFrames");
+
     combed_frames->clear();
 }
 
@@ -2537,6 +4817,8 @@ const Resize &WobblyProject::getResize() const {
 
 
 void WobblyProject::setResize(int new_width, int new_height, const std::string &filter) {
+    JournalScope journal_scope(this, "setResize", new_width, new_height, filter);
+
     if (new_width <= 0 || new_height <= 0)
         throw WobblyException("Can't resize to " + std::to_string(new_width) + "x" + std::to_string(new_height) + ": dimensions must be positive.");
 
@@ -2549,6 +4831,8 @@ void WobblyProject::setResize(int new_width, int new_height, const std::string &
 
 
 void WobblyProject::setResizeEnabled(bool enabled) {
+    JournalScope journal_scope(this, "setResizeEnabled", enabled);
+
     resize.enabled = enabled;
 
     setModified(true);
@@ -2566,6 +4850,8 @@ const Crop &WobblyProject::getCrop() const {
 
 
 void WobblyProject::setCrop(int left, int top, int right, int bottom) {
+    JournalScope journal_scope(this, "setCrop", left, top, right, bottom);
+
     if (left < 0 || top < 0 || right < 0 || bottom < 0)
         throw WobblyException("Can't crop (" + std::to_string(left) + "," + std::to_string(top) + "," + std::to_string(right) + "," + std::to_string(bottom) + "): negative values.");
 
@@ -2579,6 +4865,8 @@ void WobblyProject::setCrop(int left, int top, int right, int bottom) {
 
 
 void WobblyProject::setCropEnabled(bool enabled) {
+    JournalScope journal_scope(this, "setCropEnabled", enabled);
+
     crop.enabled = enabled;
 
     setModified(true);
@@ -2591,6 +4879,8 @@ bool WobblyProject::isCropEnabled() const {
 
 
 void WobblyProject::setCropEarly(bool early) {
+    JournalScope journal_scope(this, "setCropEarly", early);
+
     crop.early = early;
 
     setModified(true);
@@ -2608,6 +4898,8 @@ const Depth &WobblyProject::getBitDepth() const {
 
 
 void WobblyProject::setBitDepth(int bits, bool float_samples, const std::string &dither) {
+    JournalScope journal_scope(this, "setBitDepth", bits, float_samples, dither);
+
     depth.bits = bits;
     depth.float_samples = float_samples;
     depth.dither = dither;
@@ -2617,6 +4909,8 @@ void WobblyProject::setBitDepth(int bits, bool float_samples, const std::string
 
 
 void WobblyProject::setBitDepthEnabled(bool enabled) {
+    JournalScope journal_scope(this, "setBitDepthEnabled", enabled);
+
     depth.enabled = enabled;
 
     setModified(true);
@@ -2644,6 +4938,8 @@ bool WobblyProject::getFreezeFramesWanted() const {
 
 
 void WobblyProject::setFreezeFramesWanted(bool wanted) {
+    JournalScope journal_scope(this, "setFreezeFramesWanted", wanted);
+
     freeze_frames_wanted = wanted;
 }
 
@@ -2769,14 +5065,10 @@ int WobblyProject::frameNumberAfterDecimation(int frame) const {
 
     int position_in_cycle = frame % 5;
 
-    int out_frame = cycle_number * 5;
-
-    for (int i = 0; i < cycle_number; i++)
-        out_frame -= decimated_frames[i].size();
+    int out_frame = cycle_number * 5 - countDroppedFramesBefore(cycle_number);
 
-    for (int8_t i = 0; i < position_in_cycle; i++)
-        if (!decimated_frames[cycle_number].count(i))
-            out_frame++;
+    // The frames kept before this one in its cycle.
+    out_frame += position_in_cycle - countDecimatedFrames(decimated_frames[cycle_number] & ((1 << position_in_cycle) - 1));
 
     if (frame == getNumFrames(PostSource) - 1 && isDecimatedFrame(frame))
         out_frame--;
@@ -2794,13 +5086,33 @@ int WobblyProject::frameNumberBeforeDecimation(int frame) const {
     if (frame >= getNumFrames(PostDecimate))
         frame = getNumFrames(PostDecimate) - 1;
 
-    for (size_t i = 0; i < decimated_frames.size(); i++) {
+    // Find the last cycle before which at most frame frames are kept, by walking down the Fenwick tree.
+    size_t cycle = 0;
+    size_t cycles = decimated_frames.size();
+
+    size_t step = 1;
+    while (step * 2 <= cycles)
+        step *= 2;
+
+    for (; step; step /= 2) {
+        if (cycle + step > cycles)
+            continue;
+
+        int kept = (int)step * 5 - decimation_index[cycle + step];
+
+        if (kept <= frame) {
+            cycle += step;
+            frame -= kept;
+        }
+    }
+
+    if (cycle < cycles) {
         for (int j = 0; j < 5; j++) {
-            if (!decimated_frames[i].count(j))
+            if (!(decimated_frames[cycle] & (1 << j)))
                 frame--;
 
             if (frame == -1)
-                return i * 5 + j;
+                return (int)cycle * 5 + j;
         }
     }
 
@@ -2809,6 +5121,8 @@ int WobblyProject::frameNumberBeforeDecimation(int frame) const {
 
 
 void WobblyProject::applyPatternGuessingDecimation(const int section_start, const int section_end, const int first_duplicate, int drop_duplicate) {
+    waitForMetrics();
+
     // If the first duplicate is the last frame in the cycle, we have to drop the same duplicate in the entire section.
     if (drop_duplicate == DropUglierDuplicatePerCycle && first_duplicate == 4)
         drop_duplicate = DropUglierDuplicatePerSection;
@@ -2911,6 +5225,10 @@ void WobblyProject::applyPatternGuessingDecimation(const int section_start, cons
 
 
 bool WobblyProject::guessSectionPatternsFromMics(int section_start, int minimum_length, int use_patterns, int drop_duplicate) {
+    JournalScope journal_scope(this, "guessSectionPatternsFromMics", section_start, minimum_length, use_patterns, drop_duplicate);
+
+    waitForMetrics();
+
     if (!mics.size())
         throw WobblyException("Can't guess patterns from mics because there are no mics in the project.");
 
@@ -3029,6 +5347,8 @@ bool WobblyProject::guessSectionPatternsFromMics(int section_start, int minimum_
 
 
 void WobblyProject::guessProjectPatternsFromMics(int minimum_length, int use_patterns, int drop_duplicate) {
+    JournalScope journal_scope(this, "guessProjectPatternsFromMics", minimum_length, use_patterns, drop_duplicate);
+
     pattern_guessing.failures.clear();
 
     for (auto it = sections->cbegin(); it != sections->cend(); it++)
@@ -3044,6 +5364,11 @@ void WobblyProject::guessProjectPatternsFromMics(int minimum_length, int use_pat
 
 
 bool WobblyProject::guessSectionPatternsFromMatches(int section_start, int minimum_length, int use_third_n_match, int drop_duplicate) {
+    JournalScope journal_scope(this, "guessSectionPatternsFromMatches", section_start, minimum_length, use_third_n_match, drop_duplicate);
+
+    // The mics decide between candidates, so they must not be read as zeros while they're still being decoded.
+    waitForMetrics();
+
     if (section_start < 0 || section_start >= getNumFrames(PostSource))
         throw WobblyException("Can't guess patterns from matches for section starting at " + std::to_string(section_start) + ": frame number out of range.");
 
@@ -3162,6 +5487,8 @@ bool WobblyProject::guessSectionPatternsFromMatches(int section_start, int minim
 
 
 void WobblyProject::guessProjectPatternsFromMatches(int minimum_length, int use_third_n_match, int drop_duplicate) {
+    JournalScope journal_scope(this, "guessProjectPatternsFromMatches", minimum_length, use_third_n_match, drop_duplicate);
+
     pattern_guessing.failures.clear();
 
     for (auto it = sections->cbegin(); it != sections->cend(); it++)
@@ -3195,6 +5522,8 @@ const InterlacedFadeMap &WobblyProject::getInterlacedFades() const {
 
 
 void WobblyProject::addBookmark(int frame, const std::string &description) {
+    JournalScope journal_scope(this, "addBookmark", frame, description);
+
     if (frame < 0 || frame >= getNumFrames(PostSource))
         throw WobblyException("Can't add bookmark at frame " + std::to_string(frame) + ": frame number out of range.");
 
@@ -3205,6 +5534,8 @@ void WobblyProject::addBookmark(int frame, const std::string &description) {
 
 
 void WobblyProject::deleteBookmark(int frame) {
+    JournalScope journal_scope(this, "deleteBookmark", frame);
+
     if (!bookmarks->count(frame))
         throw WobblyException("Can't delete bookmark at frame " + std::to_string(frame) + ": no such bookmark.");
 
@@ -3561,8 +5892,9 @@ void WobblyProject::decimatedFramesToScript(std::string &script) const {
     delete_frames += "src = c.std.DeleteFrames(clip=src, frames=[";
 
     for (size_t i = 0; i < decimated_frames.size(); i++)
-        for (auto it = decimated_frames[i].cbegin(); it != decimated_frames[i].cend(); it++)
-            delete_frames += std::to_string(i * 5 + *it) + ",";
+        for (int offset = 0; offset < 5; offset++)
+            if (decimated_frames[i] & (1 << offset))
+                delete_frames += std::to_string(i * 5 + offset) + ",";
 
     delete_frames +=
             "])\n"
@@ -3582,24 +5914,22 @@ void WobblyProject::decimatedFramesToScript(std::string &script) const {
         else
             range_end = decimation_pattern_ranges[i + 1].start;
 
-        if (decimation_pattern_ranges[i].dropped_offsets.size()) {
+        uint8_t dropped_offsets = decimation_pattern_ranges[i].dropped_offsets;
+
+        if (dropped_offsets) {
             // The last range could contain fewer than five frames.
             // If they're all decimated, don't generate a SelectEvery
             // because clips with no frames are not allowed.
-            if (range_end - decimation_pattern_ranges[i].start <= (int)decimation_pattern_ranges[i].dropped_offsets.size())
+            if (range_end - decimation_pattern_ranges[i].start <= countDecimatedFrames(dropped_offsets))
                 break;
 
-            std::set<int8_t> offsets = { 0, 1, 2, 3, 4 };
-
-            for (auto it = decimation_pattern_ranges[i].dropped_offsets.cbegin(); it != decimation_pattern_ranges[i].dropped_offsets.cend(); it++)
-                offsets.erase(*it);
-
             std::string range_name = "dec" + std::to_string(decimation_pattern_ranges[i].start);
 
             select_every += range_name + " = c.std.SelectEvery(clip=src[" + std::to_string(decimation_pattern_ranges[i].start) + ":" + std::to_string(range_end) + "], cycle=5, offsets=[";
 
-            for (auto it = offsets.cbegin(); it != offsets.cend(); it++)
-                select_every += std::to_string(*it) + ",";
+            for (int offset = 0; offset < 5; offset++)
+                if (!(dropped_offsets & (1 << offset)))
+                    select_every += std::to_string(offset) + ",";
 
             select_every += "])\n";
 
@@ -3685,7 +6015,7 @@ std::string WobblyProject::generateFinalScript(bool save_source_node) const {
 
     bool decimation_needed = false;
     for (size_t i = 0; i < decimated_frames.size(); i++)
-        if (decimated_frames[i].size()) {
+        if (decimated_frames[i]) {
             decimation_needed = true;
             break;
         }
@@ -3776,9 +6106,11 @@ std::string WobblyProject::generateKeyframesV1() const {
 
 
 void WobblyProject::importFromOtherProject(const std::string &path, const ImportedThings &imports) {
+    JournalScope journal_scope(this, "importFromOtherProject", path, imports);
+
     std::unique_ptr<WobblyProject> other(new WobblyProject(true));
 
-    other->readProject(path);
+    other->readProjectForImport(path, imports);
 
     if (imports.geometry) {
         setUIState(other->getUIState());
@@ -37,16 +37,21 @@ SOFTWARE.
 #include <set>
 
 #include <array>
+#include <memory>
 #include <vector>
 #include <string>
+#include <thread>
 
 #include <QObject>
+#include <QTimer>
 
 #include "BookmarksModel.h"
 #include "CombedFramesModel.h"
 #include "CustomListsModel.h"
+#include "FrameRangeIndex.h"
 #include "FrozenFramesModel.h"
 #include "PresetsModel.h"
+#include "ProjectJournal.h"
 #include "SectionsModel.h"
 #include "WobblyException.h"
 #include "WobblyTypes.h"
@@ -111,7 +116,8 @@ class WobblyProject : public QObject {
         std::vector<std::array<int32_t, 2> > vmetrics;
         std::vector<char> matches;
         std::vector<char> original_matches;
-        std::vector<std::set<int8_t> > decimated_frames; // unordered_set may be sufficient.
+        std::vector<uint8_t> decimated_frames; // One mask per cycle. Bit n is frame n of the cycle.
+        std::vector<int> decimation_index; // Frames dropped per cycle, as a Fenwick tree.
         std::vector<int> decimate_metrics;
 
         bool is_wobbly; // XXX Maybe only the json writing function needs to know.
@@ -124,6 +130,7 @@ class WobblyProject : public QObject {
         FrozenFramesModel *frozen_frames;
         PresetsModel *presets;
         CustomListsModel *custom_lists;
+        FrameRangeIndex<std::pair<int, const FrameRange *> > custom_list_index; // List index and range, from every custom list.
         SectionsModel *sections;
         BookmarksModel *bookmarks;
 
@@ -138,24 +145,88 @@ class WobblyProject : public QObject {
 
         bool is_modified = false;
 
+        // Edits made since the last save, for crash recovery.
+        ProjectJournal *journal = nullptr;
+        QTimer *journal_timer = nullptr;
+        std::string journal_id;
+        uint64_t journal_sequence = 0; // Last edit recorded.
+        uint64_t journal_saved_sequence = 0; // Last edit included in the project file.
+        int journal_depth = 0; // Only the outermost mutator gets recorded.
+
+        // Mics and metrics from the project file that haven't been decoded yet.
+        struct DeferredMetrics;
+        std::unique_ptr<DeferredMetrics> deferred_metrics;
+        std::thread metrics_thread;
+
         // Only functions below.
 
+        class JournalScope;
+        void recordMutation(const std::string &record);
+        void flushJournal();
+        void failJournal(const std::string &message);
+
+        void applyMetrics(DeferredMetrics &metrics);
+
+        // The values of skipped_keys are thrown away unread, as if they weren't in the file.
+        void parseProject(const std::string &path, bool defer_metrics, const std::vector<const char *> &skipped_keys);
+
         static bool isValidMatchChar(char match);
         void setNumFrames(PositionInFilterChain position, int frames);
 
         bool isNameSafeForPython(const std::string &name) const;
         int maybeTranslate(int frame, bool is_end, PositionInFilterChain position) const;
 
+        void resetDecimatedFrames(int cycles);
+        void updateDecimationIndex(int cycle, int change);
+        int countDroppedFramesBefore(int cycle) const;
+
+        // For when the lists' indices change.
+        void rebuildCustomListIndex();
+
         void applyPatternGuessingDecimation(const int section_start, const int section_end, const int first_duplicate, int drop_duplicate);
 
+        // The writer is a rapidjson Writer or PrettyWriter. columns_file is empty if the per-frame data goes in the project.
+        template <typename Writer>
+        void writeJSON(Writer &writer, const std::string &columns_file, uint32_t columns_checksum);
+
     public:
         WobblyProject(bool _is_wobbly);
         WobblyProject(bool _is_wobbly, const std::string &_input_file, const std::string &_source_filter, int64_t _fps_num, int64_t _fps_den, int _width, int _height, int _num_frames);
 
+        // Deep copy with no parent, for writing the project from another thread while this one keeps changing.
+        WobblyProject *createSnapshot() const;
+
+        ~WobblyProject();
+
         int getNumFrames(PositionInFilterChain position) const;
 
-        void writeProject(const std::string &path, bool compact_project);
-        void readProject(const std::string &path);
+        void writeProject(const std::string &path, bool compact_project, bool use_columns_file);
+        // With defer_metrics, the delta coded mics and metrics are left for
+        // loadMetricsInBackground() or waitForMetrics(), so the project can be shown sooner.
+        void readProject(const std::string &path, bool defer_metrics = false);
+        // Reads only the parts of the project that importFromOtherProject() needs.
+        void readProjectForImport(const std::string &path, const ImportedThings &imports);
+
+        bool areMetricsLoaded() const;
+        // Emits metricsLoaded() when done.
+        void loadMetricsInBackground();
+        // The functions that change the metrics call this themselves.
+        void waitForMetrics();
+
+
+        // The journal lives next to the project file. startJournal() keeps
+        // the entries already in it if they belong to this project, and does
+        // nothing if the journal was already started somewhere else.
+        void startJournal(const std::string &project_path);
+        void stopJournal();
+        // Returns the number of edits applied. Stops at the first one that fails.
+        int replayJournal(const std::string &project_path);
+        // Forgets the edits made after the last save.
+        void discardJournal();
+        // Drops the edits up to saved_sequence. Given a project_path, the
+        // journal also moves next to that project, e.g. after Save As.
+        void compactJournal(uint64_t saved_sequence, const std::string &project_path = std::string());
+        uint64_t getJournalSequence() const;
 
 
         void addFreezeFrame(int first, int last, int replacement);
@@ -181,17 +252,22 @@ class WobblyProject : public QObject {
         void setVFMParameter(const std::string &name, double value);
         void setVDecimateParameter(const std::string &name, double value);
 
+        // The const readers of the metrics can't wait for them, and return zeros
+        // until areMetricsLoaded(). Call waitForMetrics() first where that matters.
         std::array<int32_t, 3> getMMetrics(int frame) const;
         std::array<int32_t, 3> getVMetrics(int frame) const;
         std::array<int16_t, 5> getMics(int frame) const;
         void setMics(int frame, int16_t mic_p, int16_t mic_c, int16_t mic_n, int16_t mic_b, int16_t mic_u);
         void setDMetrics(int frame, int32_t mmetric_p, int32_t mmetric_c, int32_t vmetric_p, int32_t vmetric_c);
+        void setMics(const std::vector<std::array<int16_t, 5> > &new_mics);
+        void setDMetrics(const std::vector<std::array<int32_t, 2> > &new_mmetrics, const std::vector<std::array<int32_t, 2> > &new_vmetrics);
         int getPreviousFrameWithMic(int minimum, int start_frame) const;
         int getNextFrameWithMic(int minimum, int start_frame) const;
 
 
         char getOriginalMatch(int frame) const;
         void setOriginalMatch(int frame, char match);
+        void setOriginalMatches(const std::vector<char> &new_matches);
 
 
         char getMatch(int frame) const;
@@ -202,6 +278,7 @@ class WobblyProject : public QObject {
 
         void addSection(int section_start);
         void addSection(const Section &section);
+        void addSections(const std::vector<int> &section_starts);
         void deleteSection(int section_start);
         const Section *findSection(int frame) const;
         const Section *findNextSection(int frame) const;
@@ -237,6 +314,8 @@ class WobblyProject : public QObject {
         void addCustomListRange(int list_index, int first, int last);
         void deleteCustomListRange(int list_index, int first);
         const FrameRange *findCustomListRange(int list_index, int frame) const;
+        // The list index and range of every custom list which contains frame, sorted by list index.
+        std::vector<std::pair<int, const FrameRange *> > findCustomListRanges(int frame) const;
         bool customListExists(const std::string &list_name) const;
         bool isCustomListInUse(int list_index);
         CustomListsModel *getCustomListsModel();
@@ -244,9 +323,11 @@ class WobblyProject : public QObject {
 
         int getDecimateMetric(int frame) const;
         void setDecimateMetric(int frame, int decimate_metric);
+        void setDecimateMetrics(const std::vector<int> &new_metrics);
 
 
         void addDecimatedFrame(int frame);
+        void addDecimatedFrames(const std::vector<int> &frames);
         void deleteDecimatedFrame(int frame);
         bool isDecimatedFrame(int frame) const;
         void clearDecimatedFramesFromCycle(int frame);
@@ -261,6 +342,7 @@ class WobblyProject : public QObject {
 
         CombedFramesModel *getCombedFramesModel();
         void addCombedFrame(int frame);
+        void addCombedFrames(const std::vector<int> &frames);
         void deleteCombedFrame(int frame);
         bool isCombedFrame(int frame) const;
         void clearCombedFrames();
@@ -381,6 +463,13 @@ class WobblyProject : public QObject {
 
     signals:
         void modifiedChanged(bool modified);
+        void journalFull();
+        void journalFailed(const QString &message);
+        void metricsLoaded();
+        void metricsFailed(const QString &message);
+
+    private slots:
+        void finishLoadingMetrics();
 };
 
 #endif // WOBBLYPROJECT_H
@@ -118,7 +118,7 @@ typedef std::vector<DecimationRange> DecimationRangeVector;
 
 struct DecimationPatternRange {
     int start;
-    std::set<int8_t> dropped_offsets;
+    uint8_t dropped_offsets; // Bit n means frame n of each cycle is dropped.
 };
 
 typedef std::vector<DecimationPatternRange> DecimationPatternRangeVector;
@@ -0,0 +1,194 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WIBBLY_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "FieldDifference.h"
+
+
+struct FieldDifferenceData {
+    VSNode *node;
+    const VSVideoInfo *vi;
+};
+
+
+static uint64_t sumRow8(const uint8_t *row, int width) {
+    uint64_t sum = 0;
+    int x = 0;
+
+#ifdef WIBBLY_SSE2
+    __m128i zeroes = _mm_setzero_si128();
+    __m128i sums = zeroes;
+
+    // psadbw against zero adds up 8 bytes at a time into each 64 bit half.
+    for (; x + 16 <= width; x += 16)
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(row + x)), zeroes));
+
+    uint64_t halves[2];
+    _mm_storeu_si128((__m128i *)halves, sums);
+    sum = halves[0] + halves[1];
+#endif
+
+    for (; x < width; x++)
+        sum += row[x];
+
+    return sum;
+}
+
+
+static uint64_t sumRow16(const uint16_t *row, int width) {
+    uint64_t sum = 0;
+
+    for (int x = 0; x < width; x++)
+        sum += row[x];
+
+    return sum;
+}
+
+
+static double sumRowFloat(const float *row, int width) {
+    double sum = 0;
+
+    for (int x = 0; x < width; x++)
+        sum += row[x];
+
+    return sum;
+}
+
+
+// Both fields in a single pass over the luma plane.
+static double fieldDifference(const VSFrame *frame, const VSVideoFormat *format, const VSAPI *vsapi) {
+    const uint8_t *ptr = vsapi->getReadPtr(frame, 0);
+    ptrdiff_t stride = vsapi->getStride(frame, 0);
+    int width = vsapi->getFrameWidth(frame, 0);
+    int height = vsapi->getFrameHeight(frame, 0);
+
+    double sums[2] = { 0, 0 };
+
+    if (format->sampleType == stInteger) {
+        uint64_t integer_sums[2] = { 0, 0 };
+
+        for (int y = 0; y < height; y++) {
+            if (format->bytesPerSample == 1)
+                integer_sums[y & 1] += sumRow8(ptr, width);
+            else
+                integer_sums[y & 1] += sumRow16((const uint16_t *)ptr, width);
+
+            ptr += stride;
+        }
+
+        double maximum = (double)((1 << format->bitsPerSample) - 1);
+
+        sums[0] = integer_sums[0] / maximum;
+        sums[1] = integer_sums[1] / maximum;
+    } else {
+        for (int y = 0; y < height; y++) {
+            sums[y & 1] += sumRowFloat((const float *)ptr, width);
+
+            ptr += stride;
+        }
+    }
+
+    int even_lines = (height + 1) / 2;
+    int odd_lines = height / 2;
+
+    double even_average = sums[0] / ((double)width * even_lines);
+    double odd_average = odd_lines ? sums[1] / ((double)width * odd_lines) : even_average;
+
+    return std::fabs(even_average - odd_average);
+}
+
+
+static const VSFrame *VS_CC fieldDifferenceGetFrame(int n, int activationReason, void *instanceData, void **, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    FieldDifferenceData *d = (FieldDifferenceData *)instanceData;
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
+
+        double difference = fieldDifference(src, &d->vi->format, vsapi);
+
+        VSFrame *dst = vsapi->copyFrame(src, core);
+        vsapi->freeFrame(src);
+
+        vsapi->mapSetFloat(vsapi->getFramePropertiesRW(dst), "WibblyFieldDifference", difference, maReplace);
+
+        return dst;
+    }
+
+    return nullptr;
+}
+
+
+static void VS_CC fieldDifferenceFree(void *instanceData, VSCore *, const VSAPI *vsapi) {
+    FieldDifferenceData *d = (FieldDifferenceData *)instanceData;
+
+    vsapi->freeNode(d->node);
+
+    delete d;
+}
+
+
+static void VS_CC fieldDifferenceCreate(const VSMap *in, VSMap *out, void *, VSCore *core, const VSAPI *vsapi) {
+    int err;
+
+    VSNode *node = vsapi->mapGetNode(in, "clip", 0, &err);
+    if (err) {
+        vsapi->mapSetError(out, "wibbly_field_difference: argument 'clip' is required.");
+        return;
+    }
+
+    const VSVideoInfo *vi = vsapi->getVideoInfo(node);
+
+    if (vi->format.colorFamily == cfUndefined ||
+        vi->format.colorFamily == cfRGB ||
+        (vi->format.sampleType == stInteger && vi->format.bitsPerSample > 16) ||
+        (vi->format.sampleType == stFloat && vi->format.bitsPerSample != 32)) {
+        vsapi->freeNode(node);
+        vsapi->mapSetError(out, "wibbly_field_difference: only constant format Gray and YUV clips with 8..16 bit integer or 32 bit float samples are supported.");
+        return;
+    }
+
+    FieldDifferenceData *d = new FieldDifferenceData;
+    d->node = node;
+    d->vi = vi;
+
+    VSFilterDependency dependencies[] = { { node, rpStrictSpatial } };
+
+    VSNode *filter = vsapi->createVideoFilter2("FieldDifference", vi, fieldDifferenceGetFrame, fieldDifferenceFree, fmParallel, dependencies, 1, d, core);
+
+    // A function called from Python returns whatever is stored under "val".
+    vsapi->mapConsumeNode(out, "val", filter, maReplace);
+}
+
+
+void addFieldDifferenceFunction(VSMap *variables, VSCore *core, const VSAPI *vsapi) {
+    VSFunction *function = vsapi->createFunction(fieldDifferenceCreate, nullptr, nullptr, core);
+
+    vsapi->mapConsumeFunction(variables, "wibbly_field_difference", function, maReplace);
+}
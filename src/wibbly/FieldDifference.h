@@ -0,0 +1,34 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#ifndef FIELDDIFFERENCE_H
+#define FIELDDIFFERENCE_H
+
+#include <VapourSynth4.h>
+
+
+// Adds the function wibbly_field_difference(clip) to a map of script variables.
+// It returns the clip with the frame property WibblyFieldDifference attached to every frame:
+// the absolute difference between the average luma of the even lines and that of the odd lines,
+// normalised to 0..1 like std.PlaneStats.
+void addFieldDifferenceFunction(VSMap *variables, VSCore *core, const VSAPI *vsapi);
+
+#endif // FIELDDIFFERENCE_H
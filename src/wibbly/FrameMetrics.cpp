@@ -0,0 +1,310 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#include <cstring>
+
+#include <QFile>
+#include <QSaveFile>
+
+#include "FrameMetrics.h"
+#include "WibblyJob.h"
+#include "WobblyException.h"
+
+
+// Checkpoint file layout, in native byte order:
+//   magic, version, number of frames, job hash, column mask, first frame not yet collected,
+//   followed by every column present in the mask, in the order of the Columns enum.
+static const char checkpoint_magic[8] = { 'W', 'I', 'B', 'B', 'L', 'Y', 'C', 'P' };
+static const uint32_t checkpoint_version = 1;
+
+enum Columns {
+    ColumnFlags = 1 << 0,
+    ColumnOriginalMatches = 1 << 1,
+    ColumnMics = 1 << 2,
+    ColumnMMetrics = 1 << 3,
+    ColumnVMetrics = 1 << 4,
+    ColumnDecimateMetrics = 1 << 5,
+    ColumnFieldDifferences = 1 << 6
+};
+
+
+void FrameMetrics::allocate(int num_frames, int steps, bool dmetrics) {
+    clear();
+
+    // std::atomic can't be moved, so resize() is out.
+    std::vector<std::atomic<uint8_t> >(num_frames).swap(flags);
+
+    if (steps & StepFieldMatch) {
+        original_matches.resize(num_frames, 'c');
+        mics.resize(num_frames, { 0 });
+
+        if (dmetrics) {
+            mmetrics.resize(num_frames, { 0 });
+            vmetrics.resize(num_frames, { 0 });
+        }
+    }
+
+    if (steps & StepDecimation)
+        decimate_metrics.resize(num_frames, 0);
+
+    if (steps & StepInterlacedFades)
+        field_differences.resize(num_frames, 0.0);
+}
+
+
+void FrameMetrics::clear() {
+    std::vector<std::atomic<uint8_t> >().swap(flags);
+    original_matches.clear();
+    mics.clear();
+    mmetrics.clear();
+    vmetrics.clear();
+    decimate_metrics.clear();
+    field_differences.clear();
+}
+
+
+void FrameMetrics::setFlags(int frame, uint8_t frame_flags) {
+    flags[frame].store(frame_flags | FlagCollected, std::memory_order_release);
+}
+
+
+bool FrameMetrics::isCollected(int frame) const {
+    return flags[frame].load(std::memory_order_acquire) & FlagCollected;
+}
+
+
+bool FrameMetrics::isSceneChange(int frame) const {
+    return flags[frame].load(std::memory_order_acquire) & FlagSceneChange;
+}
+
+
+int FrameMetrics::countCollected() const {
+    int collected = 0;
+
+    for (size_t i = 0; i < flags.size(); i++)
+        if (isCollected((int)i))
+            collected++;
+
+    return collected;
+}
+
+
+void FrameMetrics::commit(WobblyProject *project, double fades_threshold) const {
+    if (original_matches.size())
+        project->setOriginalMatches(original_matches);
+
+    if (mics.size())
+        project->setMics(mics);
+
+    if (mmetrics.size())
+        project->setDMetrics(mmetrics, vmetrics);
+
+    if (decimate_metrics.size())
+        project->setDecimateMetrics(decimate_metrics);
+
+    std::vector<int> combed_frames;
+    std::vector<int> section_starts;
+    std::vector<int> decimated_frames;
+
+    for (size_t i = 0; i < flags.size(); i++) {
+        uint8_t frame_flags = flags[i].load(std::memory_order_acquire);
+
+        if (frame_flags & FlagCombed)
+            combed_frames.push_back((int)i);
+
+        if (frame_flags & FlagSceneChange)
+            section_starts.push_back((int)i);
+
+        if (frame_flags & FlagDecimated)
+            decimated_frames.push_back((int)i);
+    }
+
+    project->addCombedFrames(combed_frames);
+    project->addSections(section_starts);
+    project->addDecimatedFrames(decimated_frames);
+
+    for (size_t i = 0; i < field_differences.size(); i++)
+        if (field_differences[i] > fades_threshold)
+            project->addInterlacedFade((int)i, field_differences[i]);
+}
+
+
+// Frames that are still being stored by other threads must not be read,
+// so every column is copied with only the collected frames filled in.
+template <typename T>
+static void writeColumn(QSaveFile &file, const std::vector<T> &column, const std::vector<uint8_t> &collected, const T &empty) {
+    std::vector<T> copy(collected.size(), empty);
+
+    for (size_t i = 0; i < collected.size(); i++)
+        if (collected[i])
+            copy[i] = column[i];
+
+    file.write((const char *)copy.data(), copy.size() * sizeof(T));
+}
+
+
+template <typename T>
+static bool readColumn(QFile &file, std::vector<T> &column) {
+    qint64 size = column.size() * sizeof(T);
+
+    return file.read((char *)column.data(), size) == size;
+}
+
+
+void FrameMetrics::writeCheckpoint(const std::string &path, uint64_t job_hash) const {
+    uint32_t num_frames = (uint32_t)flags.size();
+
+    std::vector<uint8_t> flags_copy(num_frames);
+    std::vector<uint8_t> collected(num_frames);
+
+    uint32_t watermark = num_frames;
+
+    for (uint32_t i = 0; i < num_frames; i++) {
+        flags_copy[i] = flags[i].load(std::memory_order_acquire);
+        collected[i] = flags_copy[i] & FlagCollected;
+
+        if (!collected[i] && watermark == num_frames)
+            watermark = i;
+    }
+
+    uint32_t mask = ColumnFlags;
+    if (original_matches.size())
+        mask |= ColumnOriginalMatches;
+    if (mics.size())
+        mask |= ColumnMics;
+    if (mmetrics.size())
+        mask |= ColumnMMetrics | ColumnVMetrics;
+    if (decimate_metrics.size())
+        mask |= ColumnDecimateMetrics;
+    if (field_differences.size())
+        mask |= ColumnFieldDifferences;
+
+    QSaveFile file(QString::fromStdString(path));
+
+    if (!file.open(QIODevice::WriteOnly))
+        throw WobblyException("Couldn't open checkpoint file '" + path + "'. Error message: " + file.errorString().toStdString());
+
+    file.write(checkpoint_magic, sizeof(checkpoint_magic));
+    file.write((const char *)&checkpoint_version, sizeof(checkpoint_version));
+    file.write((const char *)&num_frames, sizeof(num_frames));
+    file.write((const char *)&job_hash, sizeof(job_hash));
+    file.write((const char *)&mask, sizeof(mask));
+    file.write((const char *)&watermark, sizeof(watermark));
+
+    file.write((const char *)flags_copy.data(), flags_copy.size());
+
+    if (mask & ColumnOriginalMatches)
+        writeColumn(file, original_matches, collected, 'c');
+    if (mask & ColumnMics)
+        writeColumn(file, mics, collected, { 0 });
+    if (mask & ColumnMMetrics)
+        writeColumn(file, mmetrics, collected, { 0 });
+    if (mask & ColumnVMetrics)
+        writeColumn(file, vmetrics, collected, { 0 });
+    if (mask & ColumnDecimateMetrics)
+        writeColumn(file, decimate_metrics, collected, 0);
+    if (mask & ColumnFieldDifferences)
+        writeColumn(file, field_differences, collected, 0.0);
+
+    // QSaveFile only replaces the old checkpoint if everything was written.
+    if (!file.commit())
+        throw WobblyException("Couldn't write checkpoint file '" + path + "'. Error message: " + file.errorString().toStdString());
+}
+
+
+bool FrameMetrics::readCheckpoint(const std::string &path, uint64_t job_hash, int &watermark) {
+    watermark = 0;
+
+    QFile file(QString::fromStdString(path));
+
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    char magic[sizeof(checkpoint_magic)];
+    uint32_t version;
+    uint32_t num_frames;
+    uint64_t hash;
+    uint32_t mask;
+    uint32_t first_missing;
+
+    if (file.read(magic, sizeof(magic)) != sizeof(magic) ||
+        file.read((char *)&version, sizeof(version)) != sizeof(version) ||
+        file.read((char *)&num_frames, sizeof(num_frames)) != sizeof(num_frames) ||
+        file.read((char *)&hash, sizeof(hash)) != sizeof(hash) ||
+        file.read((char *)&mask, sizeof(mask)) != sizeof(mask) ||
+        file.read((char *)&first_missing, sizeof(first_missing)) != sizeof(first_missing))
+        return false;
+
+    uint32_t expected_mask = ColumnFlags;
+    if (original_matches.size())
+        expected_mask |= ColumnOriginalMatches;
+    if (mics.size())
+        expected_mask |= ColumnMics;
+    if (mmetrics.size())
+        expected_mask |= ColumnMMetrics | ColumnVMetrics;
+    if (decimate_metrics.size())
+        expected_mask |= ColumnDecimateMetrics;
+    if (field_differences.size())
+        expected_mask |= ColumnFieldDifferences;
+
+    if (memcmp(magic, checkpoint_magic, sizeof(magic)) ||
+        version != checkpoint_version ||
+        num_frames != flags.size() ||
+        hash != job_hash ||
+        mask != expected_mask ||
+        first_missing > num_frames)
+        return false;
+
+    std::vector<uint8_t> flags_copy(num_frames);
+
+    bool ok = readColumn(file, flags_copy);
+    if (ok && (mask & ColumnOriginalMatches))
+        ok = readColumn(file, original_matches);
+    if (ok && (mask & ColumnMics))
+        ok = readColumn(file, mics);
+    if (ok && (mask & ColumnMMetrics))
+        ok = readColumn(file, mmetrics);
+    if (ok && (mask & ColumnVMetrics))
+        ok = readColumn(file, vmetrics);
+    if (ok && (mask & ColumnDecimateMetrics))
+        ok = readColumn(file, decimate_metrics);
+    if (ok && (mask & ColumnFieldDifferences))
+        ok = readColumn(file, field_differences);
+
+    for (uint32_t i = 0; ok && i < first_missing; i++)
+        ok = flags_copy[i] & FlagCollected;
+
+    if (!ok) {
+        // Start from scratch rather than from half a checkpoint.
+        int steps = (mask & ColumnOriginalMatches ? StepFieldMatch : 0) |
+                    (mask & ColumnDecimateMetrics ? StepDecimation : 0) |
+                    (mask & ColumnFieldDifferences ? StepInterlacedFades : 0);
+        allocate(num_frames, steps, mask & ColumnMMetrics);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < num_frames; i++)
+        flags[i].store(flags_copy[i], std::memory_order_relaxed);
+
+    watermark = (int)first_missing;
+
+    return true;
+}
@@ -0,0 +1,80 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#ifndef FRAMEMETRICS_H
+#define FRAMEMETRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "WobblyProject.h"
+
+
+// Everything Wibbly collects from the frame properties, one array per metric, indexed by frame number.
+// The arrays are allocated up front and never resized during collection,
+// so the worker threads can store their frames without any locking,
+// as long as each frame is stored by only one thread.
+// A frame's flags are stored last, so once FlagCollected is visible, so are its metrics.
+struct FrameMetrics {
+    enum Flags {
+        FlagCollected = 1 << 0,
+        FlagCombed = 1 << 1,
+        FlagSceneChange = 1 << 2,
+        FlagDecimated = 1 << 3
+    };
+
+    std::vector<std::atomic<uint8_t> > flags;
+
+    // Empty unless the corresponding step is enabled.
+    std::vector<char> original_matches;
+    std::vector<std::array<int16_t, 5> > mics;
+    std::vector<std::array<int32_t, 2> > mmetrics;
+    std::vector<std::array<int32_t, 2> > vmetrics;
+    std::vector<int> decimate_metrics;
+    std::vector<double> field_differences;
+
+    void allocate(int num_frames, int steps, bool dmetrics);
+
+    void clear();
+
+    void setFlags(int frame, uint8_t frame_flags);
+
+    bool isCollected(int frame) const;
+
+    bool isSceneChange(int frame) const;
+
+    int countCollected() const;
+
+    // Not thread safe. Call after all the frames were stored.
+    void commit(WobblyProject *project, double fades_threshold) const;
+
+    // Safe to call while the frames are being stored. Only the frames already collected are written.
+    void writeCheckpoint(const std::string &path, uint64_t job_hash) const;
+
+    // Call after allocate(). Returns false if the file doesn't exist or belongs to a different job.
+    // watermark receives the first frame that wasn't collected, or 0 when false is returned.
+    bool readCheckpoint(const std::string &path, uint64_t job_hash, int &watermark);
+};
+
+#endif // FRAMEMETRICS_H
@@ -0,0 +1,292 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#include <algorithm>
+
+#include <QThread>
+
+#include "JobScheduler.h"
+
+
+// Below this, the caches are too small to be of much use
+// and running more jobs at once only makes everything slower.
+#define MINIMUM_CACHE_PER_JOB 256
+
+
+JobScheduler::JobScheduler(const VSSCRIPTAPI *_vssapi, const VSAPI *_vsapi, QObject *parent)
+    : QObject(parent)
+    , vssapi(_vssapi)
+    , vsapi(_vsapi)
+{
+
+}
+
+
+// An indexing thread can't be interrupted, so wait for it.
+JobScheduler::~JobScheduler() {
+    for (auto it = indexing.begin(); it != indexing.end(); it++)
+        it->second.join();
+}
+
+
+// 0 means one job per core.
+void JobScheduler::setMaximumJobs(int max_jobs) {
+    maximum_jobs = max_jobs;
+}
+
+
+// 0 means no limit.
+void JobScheduler::setMemoryBudget(int mebibytes) {
+    memory_budget = mebibytes;
+}
+
+
+void JobScheduler::setProjectOptions(bool _compact_project, bool _use_relative_paths, bool _use_columns_file) {
+    compact_project = _compact_project;
+    use_relative_paths = _use_relative_paths;
+    use_columns_file = _use_columns_file;
+}
+
+
+void JobScheduler::setStopOnError(bool stop) {
+    stop_on_error = stop;
+}
+
+
+// Each job is split into count segments, collected at the same time.
+void JobScheduler::setSegments(int count, int overlap) {
+    segment_count = count;
+    segment_overlap = overlap;
+}
+
+
+void JobScheduler::setCheckpointInterval(int seconds) {
+    checkpoint_interval = seconds;
+}
+
+
+void JobScheduler::setProfiling(bool enabled) {
+    profiling = enabled;
+}
+
+
+// Before any metrics are collected, up to this many input files are opened at once,
+// so that the source filters build their indexes in parallel instead of one job at a time.
+// 0 disables pre-indexing.
+void JobScheduler::setIndexingConcurrency(int files) {
+    indexing_concurrency = files;
+}
+
+
+int JobScheduler::getConcurrency() const {
+    return concurrency;
+}
+
+
+void JobScheduler::planConcurrency() {
+    int cores = std::max(1, QThread::idealThreadCount());
+
+    concurrency = maximum_jobs > 0 ? maximum_jobs : cores;
+    concurrency = std::min(concurrency, cores);
+    concurrency = std::min(concurrency, (int)jobs.size());
+
+    if (memory_budget > 0)
+        concurrency = std::min(concurrency, std::max(1, memory_budget / MINIMUM_CACHE_PER_JOB));
+
+    concurrency = std::max(1, concurrency);
+
+    // A single job keeps VapourSynth's defaults.
+    if (concurrency > 1) {
+        threads_per_job = std::max(1, cores / concurrency);
+    } else {
+        threads_per_job = 0;
+    }
+
+    if (memory_budget > 0)
+        cache_per_job = memory_budget / concurrency;
+    else
+        cache_per_job = 0;
+}
+
+
+void JobScheduler::planIndexing() {
+    index_jobs.clear();
+    next_index = 0;
+
+    if (indexing_concurrency <= 0)
+        return;
+
+    for (int i = 0; i < (int)jobs.size(); i++) {
+        bool seen = false;
+
+        for (size_t j = 0; j < index_jobs.size() && !seen; j++) {
+            const WibblyJob &other = jobs[index_jobs[j]];
+
+            seen = other.getInputFile() == jobs[i].getInputFile() && other.getSourceFilter() == jobs[i].getSourceFilter();
+        }
+
+        if (!seen)
+            index_jobs.push_back(i);
+    }
+}
+
+
+void JobScheduler::start(const std::vector<WibblyJob> &_jobs) {
+    jobs = _jobs;
+    next_job = 0;
+    failed_jobs = 0;
+    stopped = false;
+
+    planConcurrency();
+
+    planIndexing();
+
+    startIndexing();
+}
+
+
+// Starts the jobs once every file has been indexed.
+void JobScheduler::startIndexing() {
+    while (!stopped && next_index < (int)index_jobs.size() && (int)indexing.size() < indexing_concurrency) {
+        int file = next_index++;
+
+        emit indexingStarted(file, (int)index_jobs.size(), QString::fromStdString(jobs[index_jobs[file]].getInputFile()));
+
+        indexing.insert({ file, std::thread(&JobScheduler::indexSource, this, file) });
+    }
+
+    if (indexing.empty())
+        startJobs();
+}
+
+
+// Runs in its own thread. Failures are only reported, because the job itself will fail with a better error message.
+void JobScheduler::indexSource(int file) {
+    const WibblyJob &job = jobs[index_jobs[file]];
+
+    QString error;
+
+    VSCore *vscore = vsapi->createCore(0);
+    VSScript *vsscript = vscore ? vssapi->createScript(vscore) : nullptr;
+
+    if (vsscript) {
+        std::string script = job.generateIndexScript();
+
+        vssapi->evalSetWorkingDir(vsscript, 1);
+        if (vssapi->evaluateBuffer(vsscript, script.c_str(), job.getInputFile().c_str()))
+            error = QString::fromUtf8(vssapi->getError(vsscript));
+
+        // The script owns the core.
+        vssapi->freeScript(vsscript);
+    } else {
+        error = QStringLiteral("Failed to create VSScript object.");
+
+        if (vscore)
+            vsapi->freeCore(vscore);
+    }
+
+    QMetaObject::invokeMethod(this, "sourceIndexed", Qt::QueuedConnection, Q_ARG(int, file), Q_ARG(QString, error));
+}
+
+
+void JobScheduler::sourceIndexed(int file, QString error) {
+    indexing[file].join();
+    indexing.erase(file);
+
+    emit indexingFinished(file, (int)index_jobs.size(), error.isEmpty());
+
+    startIndexing();
+}
+
+
+void JobScheduler::stop() {
+    stopped = true;
+
+    for (auto it = running.cbegin(); it != running.cend(); it++)
+        it->second->stop();
+}
+
+
+void JobScheduler::startJobs() {
+    while (!stopped && next_job < (int)jobs.size() && (int)running.size() < concurrency)
+        startJob(next_job++);
+
+    if (running.empty())
+        emit workFinished(failed_jobs);
+}
+
+
+void JobScheduler::startJob(int index) {
+    MetricsCollector *collector = new MetricsCollector(vssapi, vsapi);
+
+    collector->setThreadCount(threads_per_job);
+    collector->setMaxCacheSize(cache_per_job);
+    collector->setSegments(segment_count, segment_overlap);
+    collector->setCheckpointInterval(checkpoint_interval);
+    collector->setProfiling(profiling);
+
+    running.insert({ index, collector });
+
+    connect(collector, &MetricsCollector::errorMessage, this, [this, index] (QString text) {
+        emit errorMessage(QStringLiteral("Job number %1: %2").arg(index + 1).arg(text));
+    });
+
+    connect(collector, &MetricsCollector::vsLogMessage, this, &JobScheduler::vsLogMessage);
+
+    connect(collector, &MetricsCollector::progressUpdate, this, [this, index] (int frame, int total) {
+        emit progressUpdate(index, frame, total);
+    });
+
+    connect(collector, &MetricsCollector::speedUpdate, this, [this, index] (double fps, QString time_left) {
+        emit speedUpdate(index, fps, time_left);
+    });
+
+    connect(collector, &MetricsCollector::requestWindowUpdate, this, [this, index] (int requests, double fps) {
+        emit requestWindowUpdate(index, requests, fps);
+    });
+
+    connect(collector, &MetricsCollector::profileReport, this, [this, index] (QString summary) {
+        emit profileReport(index, summary);
+    });
+
+    // Queued even when the collector finishes right away in start(),
+    // so that startJobs is never reentered.
+    connect(collector, &MetricsCollector::workFinished, this, [this, index, collector] (bool success) {
+        collector->deleteLater();
+
+        running.erase(index);
+
+        if (!success) {
+            failed_jobs++;
+
+            if (stop_on_error)
+                stop();
+        }
+
+        emit jobFinished(index, success);
+
+        startJobs();
+    }, Qt::QueuedConnection);
+
+    emit jobStarted(index, threads_per_job);
+
+    collector->start(jobs[index], compact_project, use_relative_paths, use_columns_file);
+}
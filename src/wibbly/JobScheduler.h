@@ -0,0 +1,116 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#ifndef JOBSCHEDULER_H
+#define JOBSCHEDULER_H
+
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <QObject>
+
+#include "MetricsCollector.h"
+#include "WibblyJob.h"
+
+
+class JobScheduler : public QObject {
+    Q_OBJECT
+
+    const VSSCRIPTAPI *vssapi;
+    const VSAPI *vsapi;
+
+    std::vector<WibblyJob> jobs;
+
+    // Job index -> collector.
+    std::map<int, MetricsCollector *> running;
+
+    int next_job = 0;
+    int failed_jobs = 0;
+    bool stopped = false;
+
+    int maximum_jobs = 1;
+    int memory_budget = 0;
+    bool compact_project = false;
+    bool use_relative_paths = false;
+    bool use_columns_file = false;
+    bool stop_on_error = true;
+    int segment_count = 1;
+    int segment_overlap = 100;
+    int checkpoint_interval = 0;
+    bool profiling = false;
+
+    int concurrency = 1;
+    int threads_per_job = 0;
+    int cache_per_job = 0;
+
+    // Pre-indexing. One job for every distinct input file and source filter.
+    int indexing_concurrency = 0;
+    std::vector<int> index_jobs;
+    int next_index = 0;
+    // File number -> thread.
+    std::map<int, std::thread> indexing;
+
+    void planConcurrency();
+    void planIndexing();
+    void startIndexing();
+    void indexSource(int file);
+    void startJobs();
+    void startJob(int index);
+
+public:
+    JobScheduler(const VSSCRIPTAPI *_vssapi, const VSAPI *_vsapi, QObject *parent = nullptr);
+    ~JobScheduler();
+
+    void setMaximumJobs(int max_jobs);
+    void setMemoryBudget(int mebibytes);
+    void setProjectOptions(bool _compact_project, bool _use_relative_paths, bool _use_columns_file);
+    void setStopOnError(bool stop);
+    void setSegments(int count, int overlap);
+    void setCheckpointInterval(int seconds);
+    void setProfiling(bool enabled);
+    void setIndexingConcurrency(int files);
+
+    int getConcurrency() const;
+
+    void start(const std::vector<WibblyJob> &_jobs);
+
+signals:
+    void indexingStarted(int file, int total, QString path);
+    void indexingFinished(int file, int total, bool success);
+    void jobStarted(int job, int threads);
+    void progressUpdate(int job, int frame, int total);
+    void speedUpdate(int job, double fps, QString time_left);
+    void requestWindowUpdate(int job, int requests, double fps);
+    void profileReport(int job, QString summary);
+    void jobFinished(int job, bool success);
+    void errorMessage(QString text);
+    void vsLogMessage(int msgType, QString text);
+    void workFinished(int failed_jobs);
+
+public slots:
+    void stop();
+
+private slots:
+    void sourceIndexed(int file, QString error);
+};
+
+#endif // JOBSCHEDULER_H
@@ -0,0 +1,700 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#include <algorithm>
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+
+#include "FieldDifference.h"
+#include "MetricsCollector.h"
+#include "WobblyException.h"
+
+
+MetricsCollector::MetricsCollector(const VSSCRIPTAPI *_vssapi, const VSAPI *_vsapi)
+    : vssapi(_vssapi)
+    , vsapi(_vsapi)
+    , aborted(false)
+    , request_count(0)
+    , frames_collected(0)
+    , next_speed_update(0)
+{
+    checkpoint_timer = new QTimer(this);
+
+    connect(checkpoint_timer, &QTimer::timeout, this, &MetricsCollector::writeCheckpoint);
+}
+
+
+MetricsCollector::~MetricsCollector() {
+    freeProjects();
+
+    freeSegments();
+}
+
+
+// 0 means VapourSynth's default. Must be called before start().
+void MetricsCollector::setThreadCount(int threads) {
+    thread_count = threads;
+}
+
+
+void MetricsCollector::setMaxCacheSize(int mebibytes) {
+    max_cache_size = mebibytes;
+}
+
+
+// The overlap is rounded up to a multiple of 5 frames, so that VDecimate's cycles stay aligned.
+void MetricsCollector::setSegments(int count, int overlap) {
+    segment_count = std::max(1, count);
+    segment_overlap = (std::max(5, overlap) + 4) / 5 * 5;
+}
+
+
+// 0 disables checkpoints. With checkpoints enabled, a job that was interrupted resumes from its last checkpoint.
+void MetricsCollector::setCheckpointInterval(int seconds) {
+    checkpoint_interval = std::max(0, seconds);
+}
+
+
+// Inserts a probe after every stage of the script, and writes a report next to the project. See StageProfiler.h.
+void MetricsCollector::setProfiling(bool enabled) {
+    profiling = enabled;
+}
+
+
+std::string MetricsCollector::getCheckpointPath(const std::string &output_file) {
+    return output_file + ".checkpoint";
+}
+
+
+// FNV-1a. The final script contains every setting that affects the metrics.
+static uint64_t hashString(const std::string &str) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < str.size(); i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+
+void VS_CC MetricsCollector::messageHandler(int msgType, const char *msg, void *userData) {
+    MetricsCollector *collector = (MetricsCollector *)userData;
+
+    emit collector->vsLogMessage(msgType, QString(msg));
+}
+
+
+void MetricsCollector::createScript(Segment &segment, int threads, int cache_size) {
+    segment.vscore = vsapi->createCore(0);
+    if (!segment.vscore)
+        throw WobblyException("Failed to create VapourSynth core object.");
+
+    vsapi->addLogHandler(messageHandler, nullptr, (void *)this, segment.vscore);
+
+    if (threads > 0)
+        vsapi->setThreadCount(threads, segment.vscore);
+
+    if (cache_size > 0)
+        vsapi->setMaxCacheSize((int64_t)cache_size * 1024 * 1024, segment.vscore);
+
+    segment.vsscript = vssapi->createScript(segment.vscore);
+    if (!segment.vsscript)
+        throw WobblyException("Failed to create VSScript object.");
+
+    // The source filter is only reused by the display script.
+    VSMap *m = vsapi->createMap();
+    vsapi->mapSetData(m, "wibbly_last_input_file", "", -1, dtUtf8, maReplace);
+    addFieldDifferenceFunction(m, segment.vscore, vsapi);
+    if (profiling)
+        profiler.addProbeFunction(m, segment.vscore, vsapi);
+    vssapi->setVariables(segment.vsscript, m);
+    vsapi->freeMap(m);
+}
+
+
+void MetricsCollector::evaluateFinalScript(Segment &segment, int first_frame, int last_frame) {
+    std::string script = job.generateFinalScript(first_frame, last_frame, profiling);
+
+    vssapi->evalSetWorkingDir(segment.vsscript, 1);
+    if (vssapi->evaluateBuffer(segment.vsscript, script.c_str(), job.getInputFile().c_str())) {
+        std::string error = vssapi->getError(segment.vsscript);
+        // The traceback is mostly unnecessary noise.
+        size_t traceback = error.find("Traceback");
+        if (traceback != std::string::npos)
+            error.insert(traceback, 1, '\n');
+
+        throw WobblyException("Failed to evaluate final script for '" + job.getInputFile() + "'. Error message:\n" + error);
+    }
+
+    segment.vsnode = vssapi->getOutputNode(segment.vsscript, 0);
+    if (!segment.vsnode)
+        throw WobblyException("Final script for '" + job.getInputFile() + "' evaluated successfully, but no node found at output index 0.");
+}
+
+
+void MetricsCollector::freeSegments() {
+    for (auto it = segments.begin(); it != segments.end(); it++) {
+        vsapi->freeNode(it->vsnode);
+
+        // The script owns the core.
+        if (it->vsscript)
+            vssapi->freeScript(it->vsscript);
+        else if (it->vscore)
+            vsapi->freeCore(it->vscore);
+    }
+
+    segments.clear();
+}
+
+
+void MetricsCollector::freeProjects() {
+    for (size_t i = 0; i < projects.size(); i++)
+        delete projects[i];
+
+    projects.clear();
+}
+
+
+// With a sweep, the node interleaves the configurations, so it has configuration_count times more frames than the video.
+void MetricsCollector::createProjects(const VSVideoInfo *vsvi, bool use_relative_paths) {
+    std::string input_file = job.getInputFile();
+    if (use_relative_paths) {
+        size_t last_slash = input_file.find_last_of("/\\");
+        if (last_slash != std::string::npos)
+            input_file.erase(0, last_slash + 1);
+    }
+
+    int steps = job.getSteps();
+
+    for (int c = 0; c < configuration_count; c++) {
+        WobblyProject *project = new WobblyProject(false, input_file, job.getSourceFilter(), vsvi->fpsNum, vsvi->fpsDen, vsvi->width, vsvi->height, num_frames);
+
+        projects.push_back(project);
+
+        const auto &trims = job.getTrims();
+        for (auto it = trims.cbegin(); it != trims.cend(); it++)
+            project->addTrim(it->second.first, it->second.last);
+
+        if (!trims.size())
+            project->addTrim(0, num_frames - 1);
+
+        if (steps & StepFieldMatch) {
+            const VIVTCParameters &vfm = job.getVFMParameters(c);
+
+            for (auto it = vfm.int_params.cbegin(); it != vfm.int_params.cend(); it++)
+                project->setVFMParameter(it->first, it->second);
+            for (auto it = vfm.double_params.cbegin(); it != vfm.double_params.cend(); it++)
+                project->setVFMParameter(it->first, it->second);
+            for (auto it = vfm.bool_params.cbegin(); it != vfm.bool_params.cend(); it++)
+                project->setVFMParameter(it->first, (int)it->second);
+        }
+
+        if (steps & StepDecimation) {
+            const VIVTCParameters &vdecimate = job.getVDecimateParameters(c);
+
+            for (auto it = vdecimate.int_params.cbegin(); it != vdecimate.int_params.cend(); it++)
+                project->setVDecimateParameter(it->first, it->second);
+            for (auto it = vdecimate.double_params.cbegin(); it != vdecimate.double_params.cend(); it++)
+                project->setVDecimateParameter(it->first, it->second);
+            for (auto it = vdecimate.bool_params.cbegin(); it != vdecimate.bool_params.cend(); it++)
+                project->setVDecimateParameter(it->first, (int)it->second);
+        }
+    }
+}
+
+
+// Splits the video into segment_count parts, each a multiple of 5 frames long, except the last one.
+// Every segment starts segment_overlap frames early and ends segment_overlap frames late (where possible),
+// so that the filters see the same neighbouring frames they would see in a single script.
+// The metrics of the extra frames at the start are discarded. The extra frames at the end are never requested.
+// Not used when the scene changes are detected.
+void MetricsCollector::createSegments() {
+    int count = std::max(1, std::min(segment_count, num_frames / 5));
+
+    int segment_length = ((num_frames + count - 1) / count + 4) / 5 * 5;
+
+    int threads = thread_count > 0 ? thread_count : std::max(1, QThread::idealThreadCount());
+    threads = std::max(1, threads / count);
+
+    int cache_size = max_cache_size > 0 ? std::max(1, max_cache_size / count) : 0;
+
+    for (int owned_first = 0; owned_first < num_frames; owned_first += segment_length) {
+        int owned_last = std::min(owned_first + segment_length, num_frames) - 1;
+
+        segments.emplace_back();
+
+        Segment &segment = segments.back();
+        segment.collector = this;
+        segment.owned_first = owned_first;
+        segment.first = std::max(0, owned_first - segment_overlap);
+        segment.num_frames = owned_last - segment.first + 1;
+        segment.next_frame = 0;
+
+        createScript(segment, threads, cache_size);
+
+        evaluateFinalScript(segment, segment.first, std::min(owned_last + segment_overlap, num_frames - 1));
+    }
+}
+
+
+void MetricsCollector::finishProject() {
+    for (int c = 0; c < configuration_count; c++) {
+        metrics[c].commit(projects[c], job.getFadesThreshold());
+
+        projects[c]->resetRangeMatches(0, num_frames - 1);
+
+        projects[c]->writeProject(job.getOutputFile(c), compact_project, use_columns_file);
+    }
+
+    if (profiling)
+        writeProfile();
+}
+
+
+// A profile that can't be written isn't worth failing the job over.
+void MetricsCollector::writeProfile() {
+    try {
+        profiler.writeReport(StageProfiler::getReportPath(job.getOutputFile()), job.getInputFile(), num_frames, configuration_count, (int)segments.size(), elapsed_timer.elapsed());
+    } catch (WobblyException &e) {
+        emit vsLogMessage(mtWarning, QString(e.what()));
+    }
+
+    emit profileReport(QString::fromStdString(profiler.getSummary()));
+}
+
+
+void MetricsCollector::start(const WibblyJob &_job, bool _compact_project, bool use_relative_paths, bool _use_columns_file) {
+    job = _job;
+    compact_project = _compact_project;
+    use_columns_file = _use_columns_file;
+    configuration_count = job.getConfigurationCount();
+
+    int steps = job.getSteps();
+
+    // Before any script is evaluated, because the probes keep pointers to the stages.
+    profiler.clear();
+
+    bool collect_metrics = steps & StepFieldMatch || steps & StepInterlacedFades || steps & StepDecimation || steps & StepSceneChanges;
+
+    try {
+        segments.emplace_back();
+
+        Segment &segment = segments.back();
+        segment.collector = this;
+        segment.first = 0;
+        segment.owned_first = 0;
+        segment.next_frame = 0;
+
+        createScript(segment, thread_count, max_cache_size);
+
+        evaluateFinalScript(segment, -1, -1);
+
+        const VSVideoInfo *vsvi = vsapi->getVideoInfo(segment.vsnode);
+
+        segment.num_frames = num_frames = vsvi->numFrames / configuration_count;
+
+        createProjects(vsvi, use_relative_paths);
+
+        // Scxvid remembers every frame it was given, so no amount of overlap
+        // would make a segment's scene changes match the single script's.
+        if (collect_metrics && segment_count > 1 && !(steps & StepSceneChanges)) {
+            freeSegments();
+
+            createSegments();
+        }
+    } catch (WobblyException &e) {
+        emit errorMessage(e.what());
+        emit workFinished(false);
+        return;
+    }
+
+    if (!collect_metrics) {
+        // No metrics to collect. Just create the project file and move on.
+        bool success = true;
+
+        try {
+            for (int c = 0; c < configuration_count; c++)
+                projects[c]->writeProject(job.getOutputFile(c), compact_project, use_columns_file);
+        } catch (WobblyException &e) {
+            emit errorMessage(e.what());
+            success = false;
+        }
+
+        freeProjects();
+
+        emit workFinished(success);
+        return;
+    }
+
+    metrics.resize(configuration_count);
+    for (int c = 0; c < configuration_count; c++)
+        metrics[c].allocate(num_frames, steps, job.getDMetrics().enabled);
+
+    resumed_frames = 0;
+
+    // Every frame before this one was collected for all the configurations.
+    int resume_frame = 0;
+
+    if (checkpoint_interval > 0) {
+        // The input file's size and modification time tell a re-encoded or replaced source apart from the old one.
+        QFileInfo input_info(QString::fromStdString(job.getInputFile()));
+
+        job_hash = hashString(job.getInputFile() + job.generateFinalScript() +
+                              std::to_string(input_info.size()) + ":" + std::to_string(input_info.lastModified().toMSecsSinceEpoch()));
+
+        resume_frame = num_frames;
+
+        for (int c = 0; c < configuration_count; c++) {
+            int watermark;
+            if (metrics[c].readCheckpoint(getCheckpointPath(job.getOutputFile(c)), job_hash, watermark))
+                resumed_frames += metrics[c].countCollected();
+
+            resume_frame = std::min(resume_frame, watermark);
+        }
+    }
+
+    // Scxvid can't just skip the frames already collected, because the frames
+    // it wasn't given would change the scene changes it finds after them.
+    // Its encoder starts over at every keyframe, which is what it reports as
+    // a scene change, so it is restarted from the last one before the first
+    // missing frame, and given every frame from there on. There is only one
+    // segment when scene changes are detected.
+    if ((steps & StepSceneChanges) && resume_frame > 0) {
+        int restart_frame = resume_frame;
+
+        if (resume_frame < num_frames) {
+            restart_frame = 0;
+
+            for (int n = resume_frame - 1; n > 0 && !restart_frame; n--) {
+                bool keyframe = true;
+                for (int c = 0; c < configuration_count; c++)
+                    keyframe = keyframe && metrics[c].isSceneChange(n);
+
+                if (keyframe)
+                    restart_frame = n;
+            }
+        }
+
+        segments[0].next_frame = restart_frame * configuration_count;
+    }
+
+    if (profiling) {
+        for (size_t i = 0; i < segments.size(); i++)
+            segments[i].request_times.resize(segments[i].num_frames * configuration_count);
+    }
+
+    aborted = false;
+    frames_collected = resumed_frames;
+    elapsed_timer.start();
+    next_speed_update = 5000;
+
+    // Decide which frames to request first before requesting any of them,
+    // so that the first frames to come back can't bring request_count to 0.
+    std::vector<std::vector<int> > requests(segments.size());
+
+    int total_requests = 0;
+
+    for (size_t i = 0; i < segments.size(); i++) {
+        VSCoreInfo core_info;
+        vsapi->getCoreInfo(segments[i].vscore, &core_info);
+
+        for (int j = 0; j < core_info.numThreads; j++) {
+            int n = nextFrame(segments[i]);
+            if (n >= segments[i].num_frames * configuration_count)
+                break;
+
+            requests[i].push_back(n);
+        }
+
+        total_requests += (int)requests[i].size();
+    }
+
+    request_count = total_requests;
+
+    // Starts where the old fixed number of requests was, and can go up to four times that.
+    request_window.start(total_requests, total_requests * 4);
+
+    if (resumed_frames)
+        emit progressUpdate(resumed_frames / configuration_count, num_frames);
+
+    if (!total_requests) {
+        // Everything was in the checkpoint already.
+        finishWork();
+        return;
+    }
+
+    if (checkpoint_interval > 0)
+        checkpoint_timer->start(checkpoint_interval * 1000);
+
+    for (size_t i = 0; i < segments.size(); i++) {
+        for (size_t j = 0; j < requests[i].size(); j++)
+            getFrameAsync(segments[i], requests[i][j]);
+    }
+}
+
+
+void MetricsCollector::stop() {
+    aborted = true;
+}
+
+
+void VS_CC MetricsCollector::frameDoneCallback(void *userData, const VSFrame *f, int n, VSNode *, const char *errorMsg) {
+    Segment *segment = (Segment *)userData;
+
+    // Runs in the worker threads.
+    segment->collector->frameDone(*segment, f, n, errorMsg);
+}
+
+
+// Each frame number is stored by exactly one thread, and the arrays are never resized, so no locking is needed.
+void MetricsCollector::saveFrameProperties(const VSFrame *frame, FrameMetrics &frame_metrics, int n) {
+    const VSMap *props = vsapi->getFramePropertiesRO(frame);
+
+    int err;
+
+    uint8_t flags = 0;
+
+    const char match_chars[] = { 'p', 'c', 'n', 'b', 'u' };
+    int64_t match = vsapi->mapGetInt(props, "VFMMatch", 0, &err);
+    if (!err && frame_metrics.original_matches.size())
+        frame_metrics.original_matches[n] = match_chars[match];
+
+    if (vsapi->mapGetInt(props, "_Combed", 0, &err))
+        flags |= FrameMetrics::FlagCombed;
+
+    if (vsapi->mapNumElements(props, "VFMMics") == 5 && frame_metrics.mics.size()) {
+        const int64_t *mics = vsapi->mapGetIntArray(props, "VFMMics", &err);
+        auto &mic = frame_metrics.mics[n];
+        for (int i = 0; i < 5; i++)
+            mic[i] = (int16_t)mics[i];
+    }
+
+    if (vsapi->mapNumElements(props, "MMetrics") == 2 && vsapi->mapNumElements(props, "VMetrics") == 2 && frame_metrics.mmetrics.size()) {
+        const int64_t *mmetrics = vsapi->mapGetIntArray(props, "MMetrics", &err);
+        const int64_t *vmetrics = vsapi->mapGetIntArray(props, "VMetrics", &err);
+        frame_metrics.mmetrics[n] = { (int32_t)mmetrics[0], (int32_t)mmetrics[1] };
+        frame_metrics.vmetrics[n] = { (int32_t)vmetrics[0], (int32_t)vmetrics[1] };
+    }
+
+    if (vsapi->mapGetInt(props, "_SceneChangePrev", 0, &err))
+        flags |= FrameMetrics::FlagSceneChange;
+
+    int64_t decimate_metric = vsapi->mapGetInt(props, "VDecimateMaxBlockDiff", 0, &err);
+    if (!err && frame_metrics.decimate_metrics.size())
+        frame_metrics.decimate_metrics[n] = (int)decimate_metric;
+
+    if (vsapi->mapGetInt(props, "VDecimateDrop", 0, &err))
+        flags |= FrameMetrics::FlagDecimated;
+
+    double field_difference = vsapi->mapGetFloat(props, "WibblyFieldDifference", 0, &err);
+    if (!err && frame_metrics.field_differences.size())
+        frame_metrics.field_differences[n] = field_difference;
+
+    // Last, so the checkpoint never sees a frame with half its frame_metrics.
+    frame_metrics.setFlags(n, flags);
+}
+
+
+// Runs in the worker threads, so don't touch the GUI directly.
+void MetricsCollector::frameDone(Segment &segment, const VSFrame *frame, int n, const char *error_msg) {
+    if (profiling)
+        profiler.addRequestLatency(profiler.now() - segment.request_times[n]);
+
+    if (aborted) {
+        vsapi->freeFrame(frame);
+    } else {
+        if (frame) {
+            int frame_number = segment.first + n / configuration_count;
+
+            // With scene changes, frames from the checkpoint are requested again, but only for Scxvid's sake.
+            if (frame_number >= segment.owned_first && !metrics[n % configuration_count].isCollected(frame_number)) {
+                saveFrameProperties(frame, metrics[n % configuration_count], frame_number);
+
+                // Counted per configuration. Progress and speed are reported in frames of the video.
+                int collected = ++frames_collected;
+
+                // Speed and time remaining updated every five seconds,
+                // or as long as it takes to process a frames, whichever is larger.
+                // Only the thread that wins the exchange sends the update.
+                int64_t elapsed_milliseconds = elapsed_timer.elapsed();
+                int64_t next_update = next_speed_update;
+                if (elapsed_milliseconds >= next_update && next_speed_update.compare_exchange_strong(next_update, elapsed_milliseconds + 5000)) {
+                    int frames_left = num_frames - collected / configuration_count;
+                    double frames_per_second = (double)(collected - resumed_frames) / configuration_count * 1000 / elapsed_milliseconds;
+                    int seconds_left = (int)(frames_left / frames_per_second);
+                    int minutes_left = seconds_left / 60;
+                    seconds_left = seconds_left % 60;
+                    int hours_left = minutes_left / 60;
+                    minutes_left = minutes_left % 60;
+
+                    emit speedUpdate(frames_per_second,
+                                     QStringLiteral("%1:%2:%3")
+                                     .arg(hours_left, 2, 10, QLatin1Char('0'))
+                                     .arg(minutes_left, 2, 10, QLatin1Char('0'))
+                                     .arg(seconds_left, 2, 10, QLatin1Char('0')));
+                }
+
+                emit progressUpdate(collected / configuration_count, num_frames);
+            }
+
+            vsapi->freeFrame(frame);
+
+            if (request_window.frameDone(elapsed_timer.elapsed()))
+                emit requestWindowUpdate(request_window.getSize(), request_window.getThroughput());
+
+            // This frame's request still counts, hence the - 1.
+            // The window can shrink by simply not requesting anything.
+            while (!aborted && request_count - 1 < request_window.getSize() && requestFrame(segment))
+                ;
+        } else {
+            aborted = true;
+
+            emit errorMessage(QStringLiteral("Failed to retrieve frame number %1 from '%2'. Error message:\n\n%3").arg(segment.first + n / configuration_count).arg(QString::fromStdString(job.getInputFile())).arg(error_msg));
+        }
+    }
+
+    if (--request_count == 0) {
+        // Other threads may have decided not to request anything because this request was still in flight.
+        if (!aborted && requestFrame(segment))
+            return;
+
+        // All frames processed, or there was an error.
+        // Either way we're done. This function isn't getting called again.
+        // The nodes can't be freed from their own callback, and the projects belong to the GUI thread.
+        QMetaObject::invokeMethod(this, "finishWork", Qt::QueuedConnection);
+    }
+}
+
+
+// Requests the next frame from the given segment, or from any other segment that has frames left,
+// so that a segment can't be left without requests when the window shrinks.
+// Returns false if there was nothing left to request.
+bool MetricsCollector::requestFrame(Segment &preferred) {
+    size_t first = 0;
+    while (&segments[first] != &preferred)
+        first++;
+
+    for (size_t i = 0; i < segments.size(); i++) {
+        Segment &segment = segments[(first + i) % segments.size()];
+
+        int n = nextFrame(segment);
+        if (n < segment.num_frames * configuration_count) {
+            ++request_count;
+            getFrameAsync(segment, n);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void MetricsCollector::getFrameAsync(Segment &segment, int n) {
+    if (profiling)
+        segment.request_times[n] = profiler.now();
+
+    vsapi->getFrameAsync(n, segment.vsnode, MetricsCollector::frameDoneCallback, (void *)&segment);
+}
+
+
+// Returns the number of the node's frame to request next, or segment.num_frames * configuration_count
+// when there is nothing left to request. All the configurations of a frame are requested one after another,
+// so the source frame is still in the cache when the other branches need it.
+// Frames already loaded from a checkpoint are skipped, but not the ones before owned_first,
+// because those are only requested for the sake of the frames that follow them.
+// When scene changes are detected, nothing is skipped, because Scxvid must see every frame.
+int MetricsCollector::nextFrame(Segment &segment) {
+    int num_requests = segment.num_frames * configuration_count;
+
+    bool skip_collected = !(job.getSteps() & StepSceneChanges);
+
+    int n = segment.next_frame++;
+
+    while (skip_collected && n < num_requests && segment.first + n / configuration_count >= segment.owned_first && metrics[n % configuration_count].isCollected(segment.first + n / configuration_count))
+        n = segment.next_frame++;
+
+    return std::min(n, num_requests);
+}
+
+
+// Called once, after the last frame came back. Runs in the GUI thread.
+void MetricsCollector::finishWork() {
+    for (auto it = segments.begin(); it != segments.end(); it++) {
+        vsapi->freeNode(it->vsnode);
+        it->vsnode = nullptr;
+    }
+
+    // The projects and their models belong to this thread, so they are only written here.
+    if (!aborted) {
+        try {
+            finishProject();
+        } catch (WobblyException &e) {
+            aborted = true;
+
+            emit errorMessage(e.what());
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(checkpoint_mutex);
+
+        if (checkpoint_interval > 0) {
+            if (aborted) {
+                // Keep what was collected so far, so the job can resume.
+                writeCheckpoints();
+            } else {
+                for (int c = 0; c < configuration_count; c++)
+                    QFile::remove(QString::fromStdString(getCheckpointPath(job.getOutputFile(c))));
+            }
+        }
+
+        metrics.clear();
+    }
+
+    freeProjects();
+
+    emit workFinished(!aborted);
+}
+
+
+// One checkpoint file per configuration. Call with checkpoint_mutex locked.
+void MetricsCollector::writeCheckpoints() {
+    for (int c = 0; c < (int)metrics.size(); c++) {
+        try {
+            metrics[c].writeCheckpoint(getCheckpointPath(job.getOutputFile(c)), job_hash);
+        } catch (WobblyException &e) {
+            emit vsLogMessage(mtWarning, QString(e.what()));
+        }
+    }
+}
+
+
+// Runs in the GUI thread, while the worker threads keep storing frames.
+void MetricsCollector::writeCheckpoint() {
+    std::lock_guard<std::mutex> lock(checkpoint_mutex);
+
+    writeCheckpoints();
+}
@@ -0,0 +1,159 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#ifndef METRICSCOLLECTOR_H
+#define METRICSCOLLECTOR_H
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <VapourSynth4.h>
+#include <VSScript4.h>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+#include "FrameMetrics.h"
+#include "RequestWindow.h"
+#include "StageProfiler.h"
+#include "WibblyJob.h"
+
+
+class MetricsCollector : public QObject {
+    Q_OBJECT
+
+    // A part of the video, collected from its own script.
+    struct Segment {
+        MetricsCollector *collector;
+
+        VSCore *vscore = nullptr;
+        VSScript *vsscript = nullptr;
+        VSNode *vsnode = nullptr;
+
+        // Frame number of the node's first frame.
+        int first;
+        // Frames before this one are only there for context. Their metrics are discarded.
+        int owned_first;
+        int num_frames;
+        // Counts requests, not frames. With a sweep, each frame is requested once per configuration.
+        std::atomic<int> next_frame;
+        // When each request was sent, only when profiling.
+        std::vector<int64_t> request_times;
+    };
+
+    const VSSCRIPTAPI *vssapi;
+    const VSAPI *vsapi;
+
+    // A deque, because Segments can't be moved.
+    std::deque<Segment> segments;
+
+    WibblyJob job;
+    // One per configuration.
+    std::vector<WobblyProject *> projects;
+    bool compact_project = false;
+    bool use_columns_file = false;
+    int configuration_count = 1;
+
+    int thread_count = 0;
+    int max_cache_size = 0;
+    int segment_count = 1;
+    int segment_overlap = 100;
+    int checkpoint_interval = 0;
+    bool profiling = false;
+
+    // Written by the worker threads, committed to the projects once all the frames are in.
+    // One per configuration.
+    std::vector<FrameMetrics> metrics;
+
+    RequestWindow request_window;
+
+    StageProfiler profiler;
+
+    std::atomic<bool> aborted;
+    std::atomic<int> request_count;
+    std::atomic<int> frames_collected;
+    int num_frames;
+    // Frames loaded from the checkpoint.
+    int resumed_frames = 0;
+
+    uint64_t job_hash = 0;
+    QTimer *checkpoint_timer;
+    // Keeps the checkpoint from being written while the metrics are freed.
+    std::mutex checkpoint_mutex;
+
+    QElapsedTimer elapsed_timer;
+    // In milliseconds since elapsed_timer was started.
+    std::atomic<int64_t> next_speed_update;
+
+    void createScript(Segment &segment, int threads, int cache_size);
+    void evaluateFinalScript(Segment &segment, int first_frame, int last_frame);
+    void freeSegments();
+    void freeProjects();
+    void createProjects(const VSVideoInfo *vsvi, bool use_relative_paths);
+    void createSegments();
+    void finishProject();
+    int nextFrame(Segment &segment);
+    bool requestFrame(Segment &preferred);
+    void getFrameAsync(Segment &segment, int n);
+    void writeProfile();
+
+    static void VS_CC messageHandler(int msgType, const char *msg, void *userData);
+    static void VS_CC frameDoneCallback(void *userData, const VSFrame *f, int n, VSNode *, const char *errorMsg);
+
+    void frameDone(Segment &segment, const VSFrame *frame, int n, const char *error_msg);
+    void saveFrameProperties(const VSFrame *frame, FrameMetrics &frame_metrics, int n);
+    void writeCheckpoints();
+
+public:
+    MetricsCollector(const VSSCRIPTAPI *_vssapi, const VSAPI *_vsapi);
+    ~MetricsCollector();
+
+    void setThreadCount(int threads);
+    void setMaxCacheSize(int mebibytes);
+    void setSegments(int count, int overlap);
+    void setCheckpointInterval(int seconds);
+    void setProfiling(bool enabled);
+
+    static std::string getCheckpointPath(const std::string &output_file);
+
+    void start(const WibblyJob &_job, bool _compact_project, bool use_relative_paths, bool _use_columns_file);
+
+signals:
+    void workFinished(bool success);
+    void progressUpdate(int frame, int total);
+    void speedUpdate(double fps, QString time_left);
+    void requestWindowUpdate(int requests, double fps);
+    void profileReport(QString summary);
+    void errorMessage(QString text);
+    void vsLogMessage(int msgType, QString text);
+
+public slots:
+    void stop();
+
+private slots:
+    void writeCheckpoint();
+    void finishWork();
+};
+
+#endif // METRICSCOLLECTOR_H
@@ -0,0 +1,315 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#include <algorithm>
+#include <cstdio>
+
+#include <QFile>
+
+#define RAPIDJSON_NAMESPACE rj
+#define RAPIDJSON_HAS_STDSTRING 1
+#include "rapidjson/document.h"
+#include "rapidjson/prettywriter.h"
+
+#include "StageProfiler.h"
+#include "WobblyException.h"
+
+
+struct ProbeData {
+    VSNode *node;
+    StageProfiler *profiler;
+    StageProfiler::Stage *stage;
+};
+
+
+StageProfiler::StageProfiler() {
+    clear();
+}
+
+
+void StageProfiler::clear() {
+    stages.clear();
+
+    for (size_t i = 0; i < request_histogram.size(); i++)
+        request_histogram[i] = 0;
+    requests = 0;
+    request_latency = 0;
+
+    timer.start();
+}
+
+
+StageProfiler::Stage *StageProfiler::getStage(const std::string &name, const std::string &previous) {
+    std::lock_guard<std::mutex> lock(stages_mutex);
+
+    for (auto it = stages.begin(); it != stages.end(); it++) {
+        if (it->name == name)
+            return &*it;
+    }
+
+    stages.emplace_back();
+
+    Stage &stage = stages.back();
+    stage.name = name;
+    stage.previous = previous;
+    stage.frames = 0;
+    stage.latency = 0;
+
+    return &stage;
+}
+
+
+int64_t StageProfiler::now() const {
+    return timer.nsecsElapsed() / 1000;
+}
+
+
+void StageProfiler::addRequestLatency(int64_t microseconds) {
+    int bucket = 0;
+    while (bucket < (int)request_histogram.size() - 1 && microseconds >= ((int64_t)2 << bucket))
+        bucket++;
+
+    request_histogram[bucket]++;
+    requests++;
+    request_latency += microseconds;
+}
+
+
+// In milliseconds. Only as precise as the histogram: the upper bound of the bucket is returned.
+double StageProfiler::getPercentile(double fraction) const {
+    int64_t total = requests;
+    if (!total)
+        return 0.0;
+
+    int64_t count = 0;
+    for (size_t i = 0; i < request_histogram.size(); i++) {
+        count += request_histogram[i];
+        if (count >= total * fraction)
+            return ((int64_t)2 << i) / 1000.0;
+    }
+
+    return ((int64_t)2 << (request_histogram.size() - 1)) / 1000.0;
+}
+
+
+static double getAverageLatency(const StageProfiler::Stage &stage) {
+    int64_t frames = stage.frames;
+
+    return frames ? stage.latency / 1000.0 / frames : 0.0;
+}
+
+
+// Can come out a bit negative, because of the cache, so it's clamped.
+static double getAddedLatency(const StageProfiler::Stage &stage, const std::deque<StageProfiler::Stage> &stages) {
+    double added = getAverageLatency(stage);
+
+    for (auto it = stages.cbegin(); it != stages.cend(); it++) {
+        if (it->name == stage.previous) {
+            added -= getAverageLatency(*it);
+            break;
+        }
+    }
+
+    return std::max(0.0, added);
+}
+
+
+std::string StageProfiler::getSummary() const {
+    std::string summary;
+
+    const Stage *slowest = nullptr;
+    double slowest_latency = 0.0;
+
+    for (auto it = stages.cbegin(); it != stages.cend(); it++) {
+        if (!it->frames)
+            continue;
+
+        double added = getAddedLatency(*it, stages);
+        if (!slowest || added > slowest_latency) {
+            slowest = &*it;
+            slowest_latency = added;
+        }
+    }
+
+    char buffer[200];
+
+    if (slowest) {
+        snprintf(buffer, sizeof(buffer), "Slowest stage: %s (+%.2f ms per frame). ", slowest->name.c_str(), slowest_latency);
+        summary += buffer;
+    }
+
+    int64_t total = requests;
+
+    snprintf(buffer, sizeof(buffer), "Request latency: %.2f ms on average, median below %.2f ms, 99th percentile below %.2f ms.",
+             total ? request_latency / 1000.0 / total : 0.0,
+             getPercentile(0.5),
+             getPercentile(0.99));
+    summary += buffer;
+
+    return summary;
+}
+
+
+std::string StageProfiler::getReportPath(const std::string &output_file) {
+    return output_file + ".profile.json";
+}
+
+
+void StageProfiler::writeReport(const std::string &path, const std::string &input_file, int num_frames, int configurations, int segments, int64_t elapsed_milliseconds) const {
+    QFile file(QString::fromStdString(path));
+
+    if (!file.open(QIODevice::WriteOnly))
+        throw WobblyException("Couldn't open profile '" + path + "'. Error message: " + file.errorString().toStdString());
+
+    rj::Document json_report(rj::kObjectType);
+
+    rj::Document::AllocatorType &a = json_report.GetAllocator();
+
+    json_report.AddMember("input file", rj::Value(input_file, a), a);
+    json_report.AddMember("frames", num_frames, a);
+    json_report.AddMember("configurations", configurations, a);
+    json_report.AddMember("segments", segments, a);
+    json_report.AddMember("seconds", elapsed_milliseconds / 1000.0, a);
+    json_report.AddMember("fps", elapsed_milliseconds ? num_frames * 1000.0 / elapsed_milliseconds : 0.0, a);
+
+    rj::Value json_stages(rj::kArrayType);
+
+    for (auto it = stages.cbegin(); it != stages.cend(); it++) {
+        rj::Value json_stage(rj::kObjectType);
+
+        json_stage.AddMember("name", rj::Value(it->name, a), a);
+        json_stage.AddMember("previous", rj::Value(it->previous, a), a);
+        json_stage.AddMember("frames", (int64_t)it->frames, a);
+        json_stage.AddMember("average latency ms", getAverageLatency(*it), a);
+        json_stage.AddMember("added latency ms", getAddedLatency(*it, stages), a);
+
+        json_stages.PushBack(json_stage, a);
+    }
+
+    json_report.AddMember("stages", json_stages, a);
+
+    rj::Value json_requests(rj::kObjectType);
+
+    int64_t total = requests;
+
+    json_requests.AddMember("requests", total, a);
+    json_requests.AddMember("average ms", total ? request_latency / 1000.0 / total : 0.0, a);
+    json_requests.AddMember("median ms", getPercentile(0.5), a);
+    json_requests.AddMember("90th percentile ms", getPercentile(0.9), a);
+    json_requests.AddMember("99th percentile ms", getPercentile(0.99), a);
+
+    rj::Value json_histogram(rj::kArrayType);
+
+    for (size_t i = 0; i < request_histogram.size(); i++) {
+        if (!request_histogram[i])
+            continue;
+
+        rj::Value json_bucket(rj::kObjectType);
+        json_bucket.AddMember("below ms", ((int64_t)2 << i) / 1000.0, a);
+        json_bucket.AddMember("requests", (int64_t)request_histogram[i], a);
+
+        json_histogram.PushBack(json_bucket, a);
+    }
+
+    json_requests.AddMember("histogram", json_histogram, a);
+
+    json_report.AddMember("request latency", json_requests, a);
+
+    rj::StringBuffer buffer;
+    rj::PrettyWriter<rj::StringBuffer> writer(buffer);
+    json_report.Accept(writer);
+
+    if (file.write(buffer.GetString(), buffer.GetSize()) < 0)
+        throw WobblyException("Couldn't write the profile to file '" + path + "'. Error message: " + file.errorString().toStdString());
+}
+
+
+// The request time is kept in frameData until the frame arrives.
+static const VSFrame *VS_CC probeGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *, const VSAPI *vsapi) {
+    ProbeData *d = (ProbeData *)instanceData;
+
+    if (activationReason == arInitial) {
+        *frameData = new int64_t(d->profiler->now());
+
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        int64_t *request_time = (int64_t *)*frameData;
+
+        d->stage->latency += d->profiler->now() - *request_time;
+        d->stage->frames++;
+
+        delete request_time;
+
+        return vsapi->getFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arError) {
+        delete (int64_t *)*frameData;
+    }
+
+    return nullptr;
+}
+
+
+static void VS_CC probeFree(void *instanceData, VSCore *, const VSAPI *vsapi) {
+    ProbeData *d = (ProbeData *)instanceData;
+
+    vsapi->freeNode(d->node);
+
+    delete d;
+}
+
+
+static void VS_CC probeCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    StageProfiler *profiler = (StageProfiler *)userData;
+
+    int err;
+
+    VSNode *node = vsapi->mapGetNode(in, "clip", 0, &err);
+    if (err) {
+        vsapi->mapSetError(out, "wibbly_probe: argument 'clip' is required.");
+        return;
+    }
+
+    const char *stage = vsapi->mapGetData(in, "stage", 0, &err);
+    if (err)
+        stage = "unnamed";
+
+    const char *previous = vsapi->mapGetData(in, "previous", 0, &err);
+    if (err)
+        previous = "";
+
+    ProbeData *d = new ProbeData;
+    d->node = node;
+    d->profiler = profiler;
+    d->stage = profiler->getStage(stage, previous);
+
+    VSFilterDependency dependencies[] = { { node, rpStrictSpatial } };
+
+    VSNode *filter = vsapi->createVideoFilter2("WibblyProbe", vsapi->getVideoInfo(node), probeGetFrame, probeFree, fmParallel, dependencies, 1, d, core);
+
+    vsapi->mapConsumeNode(out, "val", filter, maReplace);
+}
+
+
+void StageProfiler::addProbeFunction(VSMap *variables, VSCore *core, const VSAPI *vsapi) {
+    VSFunction *function = vsapi->createFunction(probeCreate, this, nullptr, core);
+
+    vsapi->mapConsumeFunction(variables, "wibbly_probe", function, maReplace);
+}
@@ -0,0 +1,90 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#ifndef STAGEPROFILER_H
+#define STAGEPROFILER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include <VapourSynth4.h>
+
+#include <QElapsedTimer>
+
+
+// Measures where the time goes in the final script.
+// WibblyJob inserts a probe filter after every stage. A probe passes its frames through untouched,
+// noting how long each frame took to arrive after it was requested. Since that includes all the stages
+// before it, a stage's own cost is its average latency minus that of the stage before it.
+class StageProfiler {
+public:
+    struct Stage {
+        std::string name;
+        std::string previous;
+
+        std::atomic<int64_t> frames;
+        // Microseconds, summed over all the frames.
+        std::atomic<int64_t> latency;
+    };
+
+private:
+    // A deque, because Stages can't be moved. In the order they were created, which is the script's order.
+    std::deque<Stage> stages;
+    std::mutex stages_mutex;
+
+    QElapsedTimer timer;
+
+    // Request latency seen by the collector. Bucket i counts the requests that took less than 2^(i + 1) microseconds.
+    std::array<std::atomic<int64_t>, 32> request_histogram;
+    std::atomic<int64_t> requests;
+    std::atomic<int64_t> request_latency;
+
+    double getPercentile(double fraction) const;
+
+public:
+    StageProfiler();
+
+    // Forgets everything. Not thread safe.
+    void clear();
+
+    // Scripts evaluated with several cores share the same stages, looked up by name.
+    Stage *getStage(const std::string &name, const std::string &previous);
+
+    // Adds the function wibbly_probe(clip, stage, previous) to a map of script variables.
+    void addProbeFunction(VSMap *variables, VSCore *core, const VSAPI *vsapi);
+
+    // Microseconds since clear().
+    int64_t now() const;
+
+    void addRequestLatency(int64_t microseconds);
+
+    std::string getSummary() const;
+
+    void writeReport(const std::string &path, const std::string &input_file, int num_frames, int configurations, int segments, int64_t elapsed_milliseconds) const;
+
+    static std::string getReportPath(const std::string &output_file);
+};
+
+#endif // STAGEPROFILER_H
@@ -0,0 +1,448 @@
+/*
+
+Copyright (c) 2018, John Smith
+
+Permission to use, copy, modify, and/or distribute this software for
+any purpose with or without fee is hereby granted, provided that the
+above copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR
+BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES
+OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+
+*/
+
+
+
+#include <cstdio>
+#include <map>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStringList>
+#include <QTimer>
+
+#include "JobScheduler.h"
+#include "WibblyJob.h"
+#include "WobblyException.h"
+
+
+// Same keys as Wibbly's own settings file, so that it can be used as a job file.
+#define KEY_COUNT                           QStringLiteral("jobs/count")
+#define KEY_JOB                             QStringLiteral("jobs/job%1")
+#define KEY_INPUT_FILE                      QStringLiteral("input_file")
+#define KEY_SOURCE_FILTER                   QStringLiteral("source_filter")
+#define KEY_OUTPUT_FILE                     QStringLiteral("output_file")
+#define KEY_STEPS                           QStringLiteral("steps")
+#define KEY_CROP                            QStringLiteral("crop")
+#define KEY_TRIMS                           QStringLiteral("trims")
+#define KEY_VFM                             QStringLiteral("vfm/")
+#define KEY_VDECIMATE                       QStringLiteral("vdecimate/")
+#define KEY_FADES_THRESHOLD                 QStringLiteral("fades_threshold")
+
+
+static void readJobs(const QString &path, std::vector<WibblyJob> &jobs) {
+    if (!QFileInfo::exists(path))
+        throw WobblyException("Can't read jobs from '" + path.toStdString() + "': file doesn't exist.");
+
+    QSettings settings(path, QSettings::IniFormat);
+
+    int job_count = settings.value(KEY_COUNT, 0).toInt();
+
+    int field_width = QString::number(job_count - 1).size();
+
+    for (int i = 0; i < job_count; i++) {
+        QString key = KEY_JOB.arg(i, field_width, 10, QLatin1Char('0'));
+
+        WibblyJob job;
+
+        job.setInputFile(settings.value(key + KEY_INPUT_FILE).toString().toStdString());
+
+        job.setSourceFilter(settings.value(key + KEY_SOURCE_FILTER, QString::fromStdString(WibblyJob::guessSourceFilter(job.getInputFile()))).toString().toStdString());
+
+        job.setOutputFile(settings.value(key + KEY_OUTPUT_FILE, QString::fromStdString(job.getInputFile() + ".wob")).toString().toStdString());
+
+        job.setSteps(settings.value(key + KEY_STEPS, job.getSteps()).toInt());
+
+        QList<QVariant> crop_list = settings.value(key + KEY_CROP).toList();
+        if (crop_list.size() == 4)
+            job.setCrop(crop_list[0].toInt(), crop_list[1].toInt(), crop_list[2].toInt(), crop_list[3].toInt());
+
+        QList<QVariant> trim_list = settings.value(key + KEY_TRIMS).toList();
+        for (int j = 0; j + 1 < trim_list.size(); j += 2)
+            job.addTrim(trim_list[j].toInt(), trim_list[j + 1].toInt());
+
+        // Every parameter has a default value, so the job already knows all the names.
+        VIVTCParameters vfm = job.getVFMParameters();
+
+        for (auto it = vfm.int_params.cbegin(); it != vfm.int_params.cend(); it++)
+            job.setVFMParameter(it->first, settings.value(key + KEY_VFM + QString::fromStdString(it->first), it->second).toInt());
+        for (auto it = vfm.double_params.cbegin(); it != vfm.double_params.cend(); it++)
+            job.setVFMParameter(it->first, settings.value(key + KEY_VFM + QString::fromStdString(it->first), it->second).toDouble());
+        for (auto it = vfm.bool_params.cbegin(); it != vfm.bool_params.cend(); it++)
+            job.setVFMParameter(it->first, settings.value(key + KEY_VFM + QString::fromStdString(it->first), it->second).toBool());
+
+        VIVTCParameters vdecimate = job.getVDecimateParameters();
+
+        for (auto it = vdecimate.int_params.cbegin(); it != vdecimate.int_params.cend(); it++)
+            job.setVDecimateParameter(it->first, settings.value(key + KEY_VDECIMATE + QString::fromStdString(it->first), it->second).toInt());
+        for (auto it = vdecimate.double_params.cbegin(); it != vdecimate.double_params.cend(); it++)
+            job.setVDecimateParameter(it->first, settings.value(key + KEY_VDECIMATE + QString::fromStdString(it->first), it->second).toDouble());
+        for (auto it = vdecimate.bool_params.cbegin(); it != vdecimate.bool_params.cend(); it++)
+            job.setVDecimateParameter(it->first, settings.value(key + KEY_VDECIMATE + QString::fromStdString(it->first), it->second).toBool());
+
+        job.setFadesThreshold(settings.value(key + KEY_FADES_THRESHOLD, job.getFadesThreshold()).toDouble());
+
+        if (job.getInputFile().empty())
+            throw WobblyException("Can't read job number " + std::to_string(i + 1) + " from '" + path.toStdString() + "': no input file.");
+
+        jobs.push_back(job);
+    }
+}
+
+
+static int parseSteps(const QString &steps_string) {
+    const std::map<QString, int> step_names = {
+        { "trim", StepTrim },
+        { "crop", StepCrop },
+        { "fieldmatch", StepFieldMatch },
+        { "fades", StepInterlacedFades },
+        { "decimation", StepDecimation },
+        { "scenechanges", StepSceneChanges }
+    };
+
+    int steps = StepNone;
+
+    QStringList names = steps_string.split(',', QString::SkipEmptyParts);
+    for (int i = 0; i < names.size(); i++) {
+        auto it = step_names.find(names[i].trimmed());
+        if (it == step_names.cend())
+            throw WobblyException("Unknown step '" + names[i].toStdString() + "'.");
+
+        steps |= it->second;
+    }
+
+    return steps;
+}
+
+
+static void setParameter(VIVTCParameters &params, const char *filter, const QString &assignment) {
+    int equals = assignment.indexOf('=');
+    if (equals < 1)
+        throw WobblyException("Parameter '" + assignment.toStdString() + "' must be of the form name=value.");
+
+    std::string name = assignment.left(equals).trimmed().toStdString();
+    QString value = assignment.mid(equals + 1).trimmed();
+
+    bool ok = true;
+
+    if (params.int_params.count(name)) {
+        int int_value = value.toInt(&ok);
+        if (ok)
+            params.int_params[name] = int_value;
+    } else if (params.double_params.count(name)) {
+        double double_value = value.toDouble(&ok);
+        if (ok)
+            params.double_params[name] = double_value;
+    } else if (params.bool_params.count(name)) {
+        bool bool_value = value == "1" || value == "true";
+        ok = bool_value || value == "0" || value == "false";
+        if (ok)
+            params.bool_params[name] = bool_value;
+    } else {
+        throw WobblyException(std::string("Unknown ") + filter + " parameter '" + name + "'.");
+    }
+
+    if (!ok)
+        throw WobblyException(std::string("Invalid value '") + value.toStdString() + "' for " + filter + " parameter '" + name + "'.");
+}
+
+
+// Each configuration starts from the job's own parameters and changes only the ones listed,
+// e.g. "vfm:cthresh=12,vdecimate:dupthresh=2".
+static void addSweepConfiguration(WibblyJob &job, const QString &changes) {
+    VIVTCParameters vfm = job.getVFMParameters();
+    VIVTCParameters vdecimate = job.getVDecimateParameters();
+
+    QStringList assignments = changes.split(',', QString::SkipEmptyParts);
+    for (int i = 0; i < assignments.size(); i++) {
+        QString assignment = assignments[i].trimmed();
+
+        if (assignment.startsWith("vfm:"))
+            setParameter(vfm, "VFM", assignment.mid(4));
+        else if (assignment.startsWith("vdecimate:"))
+            setParameter(vdecimate, "VDecimate", assignment.mid(10));
+        else
+            throw WobblyException("Sweep parameter '" + assignment.toStdString() + "' must start with 'vfm:' or 'vdecimate:'.");
+    }
+
+    job.addSweepConfiguration(vfm, vdecimate);
+}
+
+
+static std::vector<int> parseIntegers(const QString &list, int count, const char *option) {
+    QStringList parts = list.split(',');
+
+    std::vector<int> values;
+
+    bool ok = parts.size() == count;
+    for (int i = 0; ok && i < count; i++)
+        values.push_back(parts[i].trimmed().toInt(&ok));
+
+    if (!ok)
+        throw WobblyException(std::string("Option --") + option + " expects " + std::to_string(count) + " comma-separated integers, got '" + list.toStdString() + "'.");
+
+    return values;
+}
+
+
+static void applyOptions(const QCommandLineParser &parser, WibblyJob &job) {
+    if (parser.isSet("steps"))
+        job.setSteps(parseSteps(parser.value("steps")));
+
+    if (parser.isSet("crop")) {
+        std::vector<int> crop = parseIntegers(parser.value("crop"), 4, "crop");
+        job.setCrop(crop[0], crop[1], crop[2], crop[3]);
+    }
+
+    if (parser.isSet("trim")) {
+        QStringList trims = parser.values("trim");
+        for (int i = 0; i < trims.size(); i++) {
+            std::vector<int> trim = parseIntegers(trims[i], 2, "trim");
+            job.addTrim(trim[0], trim[1]);
+        }
+    }
+
+    VIVTCParameters vfm_params = job.getVFMParameters();
+    QStringList vfm = parser.values("vfm");
+    for (int i = 0; i < vfm.size(); i++)
+        setParameter(vfm_params, "VFM", vfm[i]);
+    job.setVFMParameters(vfm_params);
+
+    VIVTCParameters vdecimate_params = job.getVDecimateParameters();
+    QStringList vdecimate = parser.values("vdecimate");
+    for (int i = 0; i < vdecimate.size(); i++)
+        setParameter(vdecimate_params, "VDecimate", vdecimate[i]);
+    job.setVDecimateParameters(vdecimate_params);
+
+    // After --vfm and --vdecimate, so that the sweep starts from them.
+    QStringList sweep = parser.values("sweep");
+    for (int i = 0; i < sweep.size(); i++)
+        addSweepConfiguration(job, sweep[i]);
+
+    if (parser.isSet("dmetrics")) {
+        bool ok;
+        int nt = parser.value("dmetrics").toInt(&ok);
+        if (!ok)
+            throw WobblyException("Option --dmetrics expects an integer, got '" + parser.value("dmetrics").toStdString() + "'.");
+
+        job.setDMetrics(true, nt);
+    }
+
+    if (parser.isSet("fades-threshold")) {
+        bool ok;
+        double threshold = parser.value("fades-threshold").toDouble(&ok);
+        if (!ok)
+            throw WobblyException("Option --fades-threshold expects a number, got '" + parser.value("fades-threshold").toStdString() + "'.");
+
+        job.setFadesThreshold(threshold);
+    }
+}
+
+
+static void printLogMessage(int msgType, const QString &msg) {
+    if (msgType == mtDebug || msgType == mtInformation)
+        return;
+
+    fprintf(stderr, "\nvsLog: %s\n", msg.toUtf8().constData());
+}
+
+
+int main(int argc, char **argv) {
+    QCoreApplication app(argc, argv);
+
+    app.setOrganizationName("wobbly");
+    app.setApplicationName("wibbly-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Collects metrics from video files and creates Wobbly projects, without a graphical interface.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("videos", "Video files to process. Each one becomes a job.", "[videos...]");
+    parser.addOptions({
+        { { "j", "jobs" }, "Read jobs from <file>. Wibbly's own settings file can be used.", "file" },
+        { { "o", "output" }, "Project file to create. Only valid with a single video. A name ending in \".gz\" gives a gzip compressed project. Default: <video>.wob", "file" },
+        { "source-filter", "Source filter used to open the videos. Default: guessed from the extension.", "filter" },
+        { "steps", "Comma-separated list of steps: trim, crop, fieldmatch, fades, decimation, scenechanges. Default: all of them.", "steps" },
+        { "crop", "Crop applied to the videos.", "left,top,right,bottom" },
+        { "trim", "Add a trim. Can be given multiple times.", "first,last" },
+        { "vfm", "Set a VFM parameter. Can be given multiple times.", "name=value" },
+        { "vdecimate", "Set a VDecimate parameter. Can be given multiple times.", "name=value" },
+        { "sweep", "Also collect the metrics with these VFM and VDecimate parameters, from the same decoded frames, into <project>.N.wob. Can be given multiple times.", "vfm:name=value,vdecimate:name=value,..." },
+        { "dmetrics", "Enable DMetrics with the given nt.", "nt" },
+        { "fades-threshold", "Threshold for detecting interlaced fades.", "threshold" },
+        { "parallel", "Run up to <jobs> jobs at once, each with its share of the CPU cores. 0 means one per core. Default: 1.", "jobs" },
+        { "memory-budget", "Total cache size for all the jobs running at once, in MiB. Also limits how many run at once. Default: unlimited.", "MiB" },
+        { "segments", "Split every job into <count> segments, collected at the same time. Jobs that detect scene changes are never split. Default: 1.", "count" },
+        { "segment-overlap", "Number of extra frames each segment gets for context, rounded up to a multiple of 5. Default: 100.", "frames" },
+        { "index", "Before collecting any metrics, open up to <files> input files at once, so that the source filters build their indexes in parallel. 0 disables this. Default: 4.", "files" },
+        { "checkpoint-interval", "Save the metrics collected so far every <seconds> seconds, so that an interrupted job can resume. 0 disables checkpoints. Default: 60.", "seconds" },
+        { "profile", "Measure the time spent in each stage of the script and write it to <project>.profile.json." },
+        { "compact", "Create compact project files." },
+        { "relative-paths", "Use relative paths in project files." },
+        { "columns", "Store the per-frame data in a binary file next to each project." }
+    });
+
+    parser.process(app);
+
+    std::vector<WibblyJob> jobs;
+
+    try {
+        if (parser.isSet("jobs"))
+            readJobs(parser.value("jobs"), jobs);
+
+        QStringList videos = parser.positionalArguments();
+
+        if (parser.isSet("output") && videos.size() != 1)
+            throw WobblyException("Option --output can only be used with a single video.");
+
+        for (int i = 0; i < videos.size(); i++) {
+            std::string path = videos[i].toStdString();
+
+            WibblyJob job;
+
+            job.setInputFile(path);
+            job.setSourceFilter(parser.isSet("source-filter") ? parser.value("source-filter").toStdString() : WibblyJob::guessSourceFilter(path));
+            job.setOutputFile(parser.isSet("output") ? parser.value("output").toStdString() : path + ".wob");
+
+            applyOptions(parser, job);
+
+            jobs.push_back(job);
+        }
+    } catch (WobblyException &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    if (!jobs.size()) {
+        fprintf(stderr, "No jobs given.\n\n");
+        parser.showHelp(1);
+    }
+
+    const VSSCRIPTAPI *vssapi = getVSScriptAPI(VSSCRIPT_API_VERSION);
+    if (!vssapi) {
+        fprintf(stderr, "Fatal error: failed to initialise VSScript. Your VapourSynth installation is probably broken. Python probably couldn't 'import vapoursynth'.\n");
+        return 1;
+    }
+
+    const VSAPI *vsapi = vssapi->getVSAPI(VAPOURSYNTH_API_VERSION);
+    if (!vsapi) {
+        fprintf(stderr, "Fatal error: failed to acquire VapourSynth API struct. Did you update the VapourSynth library but not the Python module (or the other way around)?\n");
+        return 1;
+    }
+
+    int maximum_jobs = 1;
+    int memory_budget = 0;
+    int segments = 1;
+    int segment_overlap = 100;
+    int checkpoint_interval = 60;
+    int indexing_concurrency = 4;
+
+    bool ok = true;
+    if (parser.isSet("parallel"))
+        maximum_jobs = parser.value("parallel").toInt(&ok);
+    if (ok && parser.isSet("memory-budget"))
+        memory_budget = parser.value("memory-budget").toInt(&ok);
+    if (ok && parser.isSet("segments"))
+        segments = parser.value("segments").toInt(&ok);
+    if (ok && parser.isSet("segment-overlap"))
+        segment_overlap = parser.value("segment-overlap").toInt(&ok);
+    if (ok && parser.isSet("checkpoint-interval"))
+        checkpoint_interval = parser.value("checkpoint-interval").toInt(&ok);
+    if (ok && parser.isSet("index"))
+        indexing_concurrency = parser.value("index").toInt(&ok);
+    if (!ok || maximum_jobs < 0 || memory_budget < 0 || segments < 1 || segment_overlap < 0 || checkpoint_interval < 0 || indexing_concurrency < 0) {
+        fprintf(stderr, "Options --parallel, --memory-budget, --segments, --segment-overlap, --checkpoint-interval, and --index expect non-negative integers.\n");
+        return 1;
+    }
+
+    JobScheduler scheduler(vssapi, vsapi);
+    scheduler.setMaximumJobs(maximum_jobs);
+    scheduler.setMemoryBudget(memory_budget);
+    scheduler.setProjectOptions(parser.isSet("compact"), parser.isSet("relative-paths"), parser.isSet("columns"));
+    scheduler.setStopOnError(false);
+    scheduler.setSegments(segments, segment_overlap);
+    scheduler.setCheckpointInterval(checkpoint_interval);
+    scheduler.setProfiling(parser.isSet("profile"));
+    scheduler.setIndexingConcurrency(indexing_concurrency);
+
+    std::vector<int> frames_done(jobs.size(), 0);
+    std::vector<int> frames_total(jobs.size(), 0);
+    std::vector<int> requests_in_flight(jobs.size(), 0);
+
+    QObject::connect(&scheduler, &JobScheduler::errorMessage, [] (QString text) {
+        fprintf(stderr, "%s\n", text.toUtf8().constData());
+    });
+
+    QObject::connect(&scheduler, &JobScheduler::vsLogMessage, printLogMessage);
+
+    QObject::connect(&scheduler, &JobScheduler::indexingStarted, [] (int file, int total, QString path) {
+        fprintf(stderr, "Indexing file %d/%d: %s\n", file + 1, total, path.toUtf8().constData());
+    });
+
+    QObject::connect(&scheduler, &JobScheduler::indexingFinished, [] (int file, int total, bool success) {
+        fprintf(stderr, "File %d/%d %s.\n", file + 1, total, success ? "indexed" : "failed to index");
+    });
+
+    QObject::connect(&scheduler, &JobScheduler::jobStarted, [&] (int job, int threads) {
+        fprintf(stderr, "Job %d/%d started: %s", job + 1, (int)jobs.size(), jobs[job].getOutputFile().c_str());
+        if (jobs[job].getConfigurationCount() > 1)
+            fprintf(stderr, " (%d configurations)", jobs[job].getConfigurationCount());
+        if (threads)
+            fprintf(stderr, " (%d threads)", threads);
+        fprintf(stderr, "\n");
+    });
+
+    QObject::connect(&scheduler, &JobScheduler::progressUpdate, [&] (int job, int frame, int total) {
+        frames_done[job] = frame;
+        frames_total[job] = total;
+    });
+
+    QObject::connect(&scheduler, &JobScheduler::requestWindowUpdate, [&] (int job, int requests, double) {
+        requests_in_flight[job] = requests;
+    });
+
+    QObject::connect(&scheduler, &JobScheduler::speedUpdate, [&] (int job, double fps, QString time_left) {
+        fprintf(stderr, "Job %d/%d: %d/%d frames, %.2f fps, %s to finish this job", job + 1, (int)jobs.size(), frames_done[job], frames_total[job], fps, time_left.toUtf8().constData());
+        if (requests_in_flight[job])
+            fprintf(stderr, " (%d frames in flight)", requests_in_flight[job]);
+        fprintf(stderr, "\n");
+    });
+
+    QObject::connect(&scheduler, &JobScheduler::profileReport, [&] (int job, QString summary) {
+        fprintf(stderr, "Job %d/%d profile: %s\n", job + 1, (int)jobs.size(), summary.toUtf8().constData());
+    });
+
+    QObject::connect(&scheduler, &JobScheduler::jobFinished, [&] (int job, bool success) {
+        fprintf(stderr, "Job %d/%d %s.\n", job + 1, (int)jobs.size(), success ? "finished" : "failed");
+    });
+
+    QObject::connect(&scheduler, &JobScheduler::workFinished, [&] (int failed_jobs) {
+        if (failed_jobs)
+            fprintf(stderr, "%d of %d jobs failed.\n", failed_jobs, (int)jobs.size());
+
+        app.exit(failed_jobs ? 1 : 0);
+    });
+
+    QTimer::singleShot(0, [&] () {
+        scheduler.start(jobs);
+    });
+
+    return app.exec();
+}
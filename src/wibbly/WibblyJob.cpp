@@ -85,8 +85,20 @@ void WibblyJob::setSourceFilter(const std::string &filter) {
 }
 
 
-std::string WibblyJob::getOutputFile() const {
-    return output_file;
+std::string WibblyJob::getOutputFile(int configuration) const {
+    if (configuration == 0)
+        return output_file;
+
+    std::string path = output_file;
+
+    size_t last_slash = path.find_last_of("/\\");
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (last_slash != std::string::npos && dot < last_slash))
+        dot = path.size();
+
+    path.insert(dot, "." + std::to_string(configuration));
+
+    return path;
 }
 
 
@@ -156,6 +168,19 @@ void WibblyJob::setDMetrics(bool enabled, int nt) {
 }
 
 
+const VIVTCParameters &WibblyJob::getVFMParameters(int configuration) const {
+    if (configuration == 0)
+        return vfm;
+
+    return sweep.at(configuration - 1).vfm;
+}
+
+
+void WibblyJob::setVFMParameters(const VIVTCParameters &params) {
+    vfm = params;
+}
+
+
 int WibblyJob::getVFMParameterInt(const std::string &name) const {
     return vfm.int_params.at(name);
 }
@@ -186,6 +211,19 @@ void WibblyJob::setVFMParameter(const std::string &name, bool value) {
 }
 
 
+const VIVTCParameters &WibblyJob::getVDecimateParameters(int configuration) const {
+    if (configuration == 0)
+        return vdecimate;
+
+    return sweep.at(configuration - 1).vdecimate;
+}
+
+
+void WibblyJob::setVDecimateParameters(const VIVTCParameters &params) {
+    vdecimate = params;
+}
+
+
 int WibblyJob::getVDecimateParameterInt(const std::string &name) const {
     return vdecimate.int_params.at(name);
 }
@@ -226,6 +264,26 @@ void WibblyJob::setFadesThreshold(double threshold) {
 }
 
 
+int WibblyJob::getConfigurationCount() const {
+    return 1 + (int)sweep.size();
+}
+
+
+const std::vector<VIVTCConfiguration> &WibblyJob::getSweep() const {
+    return sweep;
+}
+
+
+void WibblyJob::addSweepConfiguration(const VIVTCParameters &vfm_params, const VIVTCParameters &vdecimate_params) {
+    sweep.push_back({ vfm_params, vdecimate_params });
+}
+
+
+void WibblyJob::clearSweep() {
+    sweep.clear();
+}
+
+
 void WibblyJob::headerToScript(std::string &script) const {
     script +=
             "import vapoursynth as vs\n"
@@ -277,54 +335,44 @@ void WibblyJob::cropToScript(std::string &script) const {
 }
 
 
-void WibblyJob::fieldMatchToScript(std::string &script) const {
-    if (dmetrics.enabled) {
-        script += "src = c.dmetrics.DMetrics(clip=src, tff=" + std::to_string(vfm.int_params.at("order")) +
-            ", nt=" + std::to_string(dmetrics.nt) +
-            ", chroma=" + std::to_string(vfm.bool_params.at("chroma")) +
-            ", y0=" + std::to_string(vfm.int_params.at("y0")) +
-            ", y1=" + std::to_string(vfm.int_params.at("y1")) + ")\n\n";
-    }
+void WibblyJob::segmentToScript(std::string &script, int first_frame, int last_frame) const {
+    script += "src = src[" + std::to_string(first_frame) + ":" + std::to_string(last_frame + 1) + "]\n\n";
+}
+
 
+void WibblyJob::dmetricsToScript(std::string &script, const VIVTCParameters &vfm_params) const {
+    script += "src = c.dmetrics.DMetrics(clip=src, tff=" + std::to_string(vfm_params.int_params.at("order")) +
+        ", nt=" + std::to_string(dmetrics.nt) +
+        ", chroma=" + std::to_string(vfm_params.bool_params.at("chroma")) +
+        ", y0=" + std::to_string(vfm_params.int_params.at("y0")) +
+        ", y1=" + std::to_string(vfm_params.int_params.at("y1")) + ")\n\n";
+}
+
+
+void WibblyJob::fieldMatchToScript(std::string &script, const VIVTCParameters &vfm_params) const {
     script += "src = c.vivtc.VFM(clip=src";
 
-    for (auto it = vfm.int_params.cbegin(); it != vfm.int_params.cend(); it++)
+    for (auto it = vfm_params.int_params.cbegin(); it != vfm_params.int_params.cend(); it++)
         script += ", " + it->first + "=" + std::to_string(it->second);
-    for (auto it = vfm.double_params.cbegin(); it != vfm.double_params.cend(); it++) {
+    for (auto it = vfm_params.double_params.cbegin(); it != vfm_params.double_params.cend(); it++) {
         std::stringstream ss;
         ss.imbue(std::locale::classic());
         ss << it->second;
         script += ", " + it->first + "=" + ss.str();
     }
-    for (auto it = vfm.bool_params.cbegin(); it != vfm.bool_params.cend(); it++)
+    for (auto it = vfm_params.bool_params.cbegin(); it != vfm_params.bool_params.cend(); it++)
         script += ", " + it->first + "=" + std::to_string((int)it->second);
 
-    script += ", field=" + std::to_string(!vfm.int_params.at("order"));
+    script += ", field=" + std::to_string(!vfm_params.int_params.at("order"));
     script += ", mode=0";
     script += ", micout=1";
     script += ")\n\n";
 }
 
 
+// wibbly_field_difference is a native filter, passed to the script as a variable. See FieldDifference.h.
 void WibblyJob::interlacedFadesToScript(std::string &script) const {
-    script +=
-            "def copyProp(n, f):\n"
-            "    fout = f[0].copy()\n"
-            "    fout.props.WibblyFieldDifference = abs(f[0].props.WibblyEvenAverage - f[1].props.WibblyOddAverage)\n"
-            "    return fout\n"
-            "\n"
-            "separated = c.std.SeparateFields(clip=src, tff=True)\n"
-
-            "even = c.std.SelectEvery(clip=separated, cycle=2, offsets=0)\n"
-            "even = c.std.PlaneStats(clipa=even, plane=0, prop='WibblyEven')\n"
-
-            "odd = c.std.SelectEvery(clip=separated, cycle=2, offsets=1)\n"
-            "odd = c.std.PlaneStats(clipa=odd, plane=0, prop='WibblyOdd')\n"
-
-            "even = c.std.ModifyFrame(clip=even, clips=[even, odd], selector=copyProp)\n"
-            "src = c.std.Interleave(clips=[even, odd])\n"
-            "src = c.std.DoubleWeave(clip=src, tff=True)\n"
-            "src = c.std.SelectEvery(clip=src, cycle=2, offsets=0)\n\n";
+    script += "src = wibbly_field_difference(clip=src)\n\n";
 }
 
 
@@ -345,18 +393,18 @@ void WibblyJob::framePropsToScript(std::string &script) const {
 }
 
 
-void WibblyJob::decimationToScript(std::string &script) const {
+void WibblyJob::decimationToScript(std::string &script, const VIVTCParameters &vdecimate_params) const {
     script += "src = c.vivtc.VDecimate(clip=src";
 
-    for (auto it = vdecimate.int_params.cbegin(); it != vdecimate.int_params.cend(); it++)
+    for (auto it = vdecimate_params.int_params.cbegin(); it != vdecimate_params.int_params.cend(); it++)
         script += ", " + it->first + "=" + std::to_string(it->second);
-    for (auto it = vdecimate.double_params.cbegin(); it != vdecimate.double_params.cend(); it++) {
+    for (auto it = vdecimate_params.double_params.cbegin(); it != vdecimate_params.double_params.cend(); it++) {
         std::stringstream ss;
         ss.imbue(std::locale::classic());
         ss << it->second;
         script += ", " + it->first + "=" + ss.str();
     }
-    for (auto it = vdecimate.bool_params.cbegin(); it != vdecimate.bool_params.cend(); it++)
+    for (auto it = vdecimate_params.bool_params.cbegin(); it != vdecimate_params.bool_params.cend(); it++)
         script += ", " + it->first + "=" + std::to_string((int)it->second);
 
     script += ", cycle=5";
@@ -370,35 +418,103 @@ void WibblyJob::sceneChangesToScript(std::string &script) const {
 }
 
 
+// Probes are only inserted when previous_stage isn't nullptr.
+void WibblyJob::probeToScript(std::string &script, const std::string &stage, std::string *previous_stage) const {
+    if (!previous_stage)
+        return;
+
+    script += "src = wibbly_probe(clip=src, stage='" + stage + "', previous='" + *previous_stage + "')\n\n";
+
+    *previous_stage = stage;
+}
+
+
+void WibblyJob::metricsToScript(std::string &script, const VIVTCConfiguration &configuration, const std::string &suffix, std::string *previous_stage) const {
+    if (steps & StepFieldMatch) {
+        if (dmetrics.enabled) {
+            dmetricsToScript(script, configuration.vfm);
+            probeToScript(script, "dmetrics" + suffix, previous_stage);
+        }
+
+        fieldMatchToScript(script, configuration.vfm);
+        probeToScript(script, "vfm" + suffix, previous_stage);
+    }
+
+    if (steps & StepInterlacedFades) {
+        interlacedFadesToScript(script);
+        probeToScript(script, "fades" + suffix, previous_stage);
+    }
+
+    if (steps & StepDecimation) {
+        decimationToScript(script, configuration.vdecimate);
+        probeToScript(script, "vdecimate" + suffix, previous_stage);
+    }
+
+    if (steps & StepSceneChanges) {
+        sceneChangesToScript(script);
+        probeToScript(script, "scxvid" + suffix, previous_stage);
+    }
+}
+
+
+// Every configuration gets its own branch, all fed by the same source node, so the video is decoded only once.
+// modify_duration=False keeps the frame rate of the source.
+// Each branch's first probe follows the last shared one.
+void WibblyJob::sweepToScript(std::string &script, std::string *previous_stage) const {
+    script += "wibbly_source = src\n\n";
+
+    int configurations = getConfigurationCount();
+
+    for (int i = 0; i < configurations; i++) {
+        script += "src = wibbly_source\n\n";
+
+        std::string branch_stage = previous_stage ? *previous_stage : std::string();
+
+        metricsToScript(script, { getVFMParameters(i), getVDecimateParameters(i) }, "[" + std::to_string(i) + "]", previous_stage ? &branch_stage : nullptr);
+
+        script += "wibbly_configuration" + std::to_string(i) + " = src\n\n";
+    }
+
+    script += "src = c.std.Interleave(clips=[";
+    for (int i = 0; i < configurations; i++)
+        script += "wibbly_configuration" + std::to_string(i) + ", ";
+    script += "], modify_duration=False)\n\n";
+}
+
+
 void WibblyJob::setOutputToScript(std::string &script) const {
     script += "src.set_output()\n";
 }
 
 
-std::string WibblyJob::generateFinalScript() const {
+std::string WibblyJob::generateFinalScript(int first_frame, int last_frame, bool profile) const {
     std::string script;
 
+    std::string previous_stage;
+    std::string *probes = profile ? &previous_stage : nullptr;
+
     headerToScript(script);
 
     sourceToScript(script);
+    probeToScript(script, "source", probes);
 
-    if (steps & StepTrim)
+    if (steps & StepTrim) {
         trimToScript(script);
+        probeToScript(script, "trim", probes);
+    }
 
-    if (steps & StepCrop)
+    if (steps & StepCrop) {
         cropToScript(script);
+        probeToScript(script, "crop", probes);
+    }
 
-    if (steps & StepFieldMatch)
-        fieldMatchToScript(script);
-
-    if (steps & StepInterlacedFades)
-        interlacedFadesToScript(script);
-
-    if (steps & StepDecimation)
-        decimationToScript(script);
+    if (first_frame > -1 && last_frame > -1)
+        segmentToScript(script, first_frame, last_frame);
 
-    if (steps & StepSceneChanges)
-        sceneChangesToScript(script);
+    if (sweep.size())
+        sweepToScript(script, probes);
+    else
+        metricsToScript(script, { vfm, vdecimate }, "", probes);
 
     setOutputToScript(script);
 
@@ -416,8 +532,12 @@ std::string WibblyJob::generateDisplayScript() const {
     if (steps & StepCrop)
         cropToScript(script);
 
-    if (steps & StepFieldMatch)
-        fieldMatchToScript(script);
+    if (steps & StepFieldMatch) {
+        if (dmetrics.enabled)
+            dmetricsToScript(script, vfm);
+
+        fieldMatchToScript(script, vfm);
+    }
 
     if (steps & StepInterlacedFades)
         interlacedFadesToScript(script);
@@ -430,3 +550,36 @@ std::string WibblyJob::generateDisplayScript() const {
     return script;
 }
 
+
+std::string WibblyJob::generateIndexScript() const {
+    std::string script;
+
+    headerToScript(script);
+
+    script +=
+            "src = c." + source_filter + "(r'" + handleSingleQuotes(input_file) + "')\n"
+            "\n";
+
+    setOutputToScript(script);
+
+    return script;
+}
+
+
+std::string WibblyJob::guessSourceFilter(const std::string &path) {
+    std::string extension;
+
+    size_t dot = path.find_last_of('.');
+    if (dot != std::string::npos)
+        extension = path.substr(dot + 1);
+
+    if (extension == "dgi")
+        return "dgdecodenv.DGSource";
+    else if (extension == "d2v")
+        return "d2v.Source";
+    else if (extension == "mp4" || extension == "m4v" || extension == "mov")
+        return "lsmas.LibavSMASHSource";
+    else
+        return "lsmas.LWLibavSource";
+}
+
@@ -24,6 +24,7 @@ SOFTWARE.
 #include <map>
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 #include "WobblyProject.h"
 
@@ -46,6 +47,12 @@ struct VIVTCParameters {
 };
 
 
+struct VIVTCConfiguration {
+    VIVTCParameters vfm;
+    VIVTCParameters vdecimate;
+};
+
+
 class WibblyJob {
     std::string input_file;
 
@@ -67,16 +74,25 @@ class WibblyJob {
 
     double fades_threshold;
 
+    // Additional parameter sets, collected from the same decoded frames.
+    // Each one produces its own project file.
+    std::vector<VIVTCConfiguration> sweep;
+
 
     void headerToScript(std::string &script) const;
     void sourceToScript(std::string &script) const;
     void trimToScript(std::string &script) const;
     void cropToScript(std::string &script) const;
-    void fieldMatchToScript(std::string &script) const;
+    void segmentToScript(std::string &script, int first_frame, int last_frame) const;
+    void dmetricsToScript(std::string &script, const VIVTCParameters &vfm_params) const;
+    void fieldMatchToScript(std::string &script, const VIVTCParameters &vfm_params) const;
     void interlacedFadesToScript(std::string &script) const;
     void framePropsToScript(std::string &script) const;
-    void decimationToScript(std::string &script) const;
+    void decimationToScript(std::string &script, const VIVTCParameters &vdecimate_params) const;
     void sceneChangesToScript(std::string &script) const;
+    void probeToScript(std::string &script, const std::string &stage, std::string *previous_stage) const;
+    void metricsToScript(std::string &script, const VIVTCConfiguration &configuration, const std::string &suffix, std::string *previous_stage) const;
+    void sweepToScript(std::string &script, std::string *previous_stage) const;
     void setOutputToScript(std::string &script) const;
 
 public:
@@ -91,7 +107,8 @@ public:
     void setSourceFilter(const std::string &filter);
 
 
-    std::string getOutputFile() const;
+    // Configuration 0 writes to the output file itself. The others insert their number before the extension.
+    std::string getOutputFile(int configuration = 0) const;
     void setOutputFile(const std::string &path);
 
 
@@ -111,6 +128,8 @@ public:
     void setDMetrics(bool enabled, int nt);
 
 
+    const VIVTCParameters &getVFMParameters(int configuration = 0) const;
+    void setVFMParameters(const VIVTCParameters &params);
     int getVFMParameterInt(const std::string &name) const;
     double getVFMParameterDouble(const std::string &name) const;
     bool getVFMParameterBool(const std::string &name) const;
@@ -119,6 +138,8 @@ public:
     void setVFMParameter(const std::string &name, bool value);
 
 
+    const VIVTCParameters &getVDecimateParameters(int configuration = 0) const;
+    void setVDecimateParameters(const VIVTCParameters &params);
     int getVDecimateParameterInt(const std::string &name) const;
     double getVDecimateParameterDouble(const std::string &name) const;
     bool getVDecimateParameterBool(const std::string &name) const;
@@ -131,8 +152,24 @@ public:
     void setFadesThreshold(double threshold);
 
 
-    std::string generateFinalScript() const;
+    // Configuration 0 is the job's own VFM and VDecimate parameters, followed by the sweep.
+    int getConfigurationCount() const;
+    const std::vector<VIVTCConfiguration> &getSweep() const;
+    void addSweepConfiguration(const VIVTCParameters &vfm_params, const VIVTCParameters &vdecimate_params);
+    void clearSweep();
+
+
+    // With first_frame and last_frame, the metrics are collected only from that part of the (trimmed) video.
+    // With a sweep, the output node interleaves the configurations: frame n * getConfigurationCount() + c
+    // is frame n as seen by configuration c.
+    // With profile, every stage is followed by wibbly_probe. See StageProfiler.h.
+    std::string generateFinalScript(int first_frame = -1, int last_frame = -1, bool profile = false) const;
     std::string generateDisplayScript() const;
+    // Only opens the input file, so that the source filter builds its index.
+    std::string generateIndexScript() const;
+
+
+    static std::string guessSourceFilter(const std::string &path);
 };
 
 #endif // WIBBLYJOB_H
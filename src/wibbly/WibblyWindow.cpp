@@ -18,9 +18,6 @@ SOFTWARE.
 */
 
 
-#include <condition_variable>
-#include <mutex>
-
 #include <QApplication>
 #include <QButtonGroup>
 #include <QFile>
@@ -39,6 +36,7 @@ SOFTWARE.
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 
+#include "FieldDifference.h"
 #include "ScrollArea.h"
 #include "WibblyWindow.h"
 #include "WobblyException.h"
@@ -53,8 +51,16 @@ SOFTWARE.
 #define KEY_LAST_DIR                        QStringLiteral("user_interface/last_dir")
 #define KEY_LAST_CROP                       QStringLiteral("user_interface/last_crop")
 
+#define KEY_SIMULTANEOUS_JOBS               QStringLiteral("processing/simultaneous_jobs")
+#define KEY_MEMORY_BUDGET                   QStringLiteral("processing/memory_budget")
+#define KEY_SEGMENTS_PER_JOB                QStringLiteral("processing/segments_per_job")
+#define KEY_CHECKPOINT_INTERVAL             QStringLiteral("processing/checkpoint_interval")
+#define KEY_PROFILE_JOBS                    QStringLiteral("processing/profile_jobs")
+#define KEY_INDEXING_CONCURRENCY            QStringLiteral("processing/indexing_concurrency")
+
 #define KEY_COMPACT_PROJECT_FILES           QStringLiteral("projects/compact_project_files")
 #define KEY_USE_RELATIVE_PATHS              QStringLiteral("projects/use_relative_paths")
+#define KEY_USE_COLUMNS_FILE                QStringLiteral("projects/use_columns_file")
 
 #define KEY_JOBS                            QStringLiteral("jobs")
 #define KEY_COUNT                           QStringLiteral("jobs/count")
@@ -70,13 +76,8 @@ SOFTWARE.
 #define KEY_FADES_THRESHOLD                 QStringLiteral("fades_threshold")
 
 
-static std::mutex requests_mutex;
-static std::condition_variable requests_condition;
-
-
 WibblyWindow::WibblyWindow()
     : QMainWindow()
-    , request_count(0)
 #ifdef _WIN32
     , settings(QApplication::applicationDirPath() + "/wibbly.ini", QSettings::IniFormat)
 #endif
@@ -159,6 +160,11 @@ void WibblyWindow::initialiseVapourSynth() {
     vsscript = vssapi->createScript(vscore);
     if (!vsscript)
         throw WobblyException(std::string("Fatal error: failed to create VSScript object. Error message: ") + vssapi->getError(vsscript));
+
+    VSMap *m = vsapi->createMap();
+    addFieldDifferenceFunction(m, vscore, vsapi);
+    vssapi->setVariables(vsscript, m);
+    vsapi->freeMap(m);
 }
 
 
@@ -421,7 +427,7 @@ void WibblyWindow::createMainWindow() {
     connect(main_destination_edit, &QLineEdit::editingFinished, destinationChanged);
 
     connect(main_choose_button, &QPushButton::clicked, [this, destinationChanged] () {
-        QString path = QFileDialog::getSaveFileName(this, QStringLiteral("Choose destination"), settings.value(KEY_LAST_DIR).toString(), QStringLiteral("Wobbly projects (*.wob);;All files (*)"));
+        QString path = QFileDialog::getSaveFileName(this, QStringLiteral("Choose destination"), settings.value(KEY_LAST_DIR).toString(), QStringLiteral("Wobbly projects (*.wob *.wob.gz);;All files (*)"));
 
         if (!path.isEmpty()) {
             settings.setValue(KEY_LAST_DIR, QFileInfo(path).absolutePath());
@@ -591,22 +597,19 @@ void WibblyWindow::createMainWindow() {
             return;
         }
 
-        startNextJob();
+        startJobs();
     });
 
     connect(main_progress_dialog, &ProgressDialog::canceled, [this] () {
-        aborted = true;
-
-        delete current_project;
-        current_project = nullptr;
-
-        current_job = -1;
-
-        int current_row = main_jobs_list->currentRow();
-        main_jobs_list->setCurrentRow(-1, QItemSelectionModel::NoUpdate);
-        main_jobs_list->setCurrentRow(current_row, QItemSelectionModel::NoUpdate);
+        if (scheduler) {
+            // The running jobs take a moment to stop. Let the scheduler clean up after itself.
+            scheduler->disconnect(this);
+            connect(scheduler, &JobScheduler::workFinished, scheduler, &JobScheduler::deleteLater);
+            scheduler->stop();
+            scheduler = nullptr;
+        }
 
-        setEnabled(true);
+        stopJobs();
     });
 
     connect(main_progress_dialog, &ProgressDialog::minimiseChanged, [this] (bool minimised) {
@@ -1062,12 +1065,49 @@ void WibblyWindow::createSettingsWindow() {
 
     settings_use_relative_paths_check = new QCheckBox(QStringLiteral("Use relative paths in project files"));
 
+    settings_use_columns_file_check = new QCheckBox(QStringLiteral("Store per-frame data in a binary file next to the project"));
+    settings_use_columns_file_check->setToolTip(QStringLiteral("Large projects open and save much faster, but the project needs the '.columns' file and older versions of Wobbly can't open it."));
+
     settings_cache_spin = new QSpinBox;
     settings_cache_spin->setRange(1, 99999);
     settings_cache_spin->setValue(200);
     settings_cache_spin->setPrefix(QStringLiteral("Maximum cache size: "));
     settings_cache_spin->setSuffix(QStringLiteral(" MiB"));
 
+    settings_jobs_spin = new QSpinBox;
+    settings_jobs_spin->setRange(1, std::max(1, QThread::idealThreadCount()));
+    settings_jobs_spin->setValue(1);
+    settings_jobs_spin->setPrefix(QStringLiteral("Simultaneous jobs: "));
+
+    settings_segments_spin = new QSpinBox;
+    settings_segments_spin->setRange(1, std::max(1, QThread::idealThreadCount()));
+    settings_segments_spin->setValue(1);
+    settings_segments_spin->setPrefix(QStringLiteral("Segments per job: "));
+
+    settings_memory_spin = new QSpinBox;
+    settings_memory_spin->setRange(0, 999999);
+    settings_memory_spin->setValue(0);
+    settings_memory_spin->setPrefix(QStringLiteral("Memory budget for jobs: "));
+    settings_memory_spin->setSuffix(QStringLiteral(" MiB"));
+    settings_memory_spin->setSpecialValueText(QStringLiteral("Memory budget for jobs: unlimited"));
+
+    settings_checkpoint_spin = new QSpinBox;
+    settings_checkpoint_spin->setRange(0, 3600);
+    settings_checkpoint_spin->setValue(60);
+    settings_checkpoint_spin->setPrefix(QStringLiteral("Save checkpoints every "));
+    settings_checkpoint_spin->setSuffix(QStringLiteral(" s"));
+    settings_checkpoint_spin->setSpecialValueText(QStringLiteral("No checkpoints"));
+
+    settings_indexing_spin = new QSpinBox;
+    settings_indexing_spin->setRange(0, std::max(1, QThread::idealThreadCount()));
+    settings_indexing_spin->setValue(std::min(4, settings_indexing_spin->maximum()));
+    settings_indexing_spin->setPrefix(QStringLiteral("Files indexed at once: "));
+    settings_indexing_spin->setSpecialValueText(QStringLiteral("No pre-indexing"));
+    settings_indexing_spin->setToolTip(QStringLiteral("Open all the input files with their source filters before collecting any metrics, so that their indexes are built in parallel."));
+
+    settings_profile_check = new QCheckBox(QStringLiteral("Profile jobs"));
+    settings_profile_check->setToolTip(QStringLiteral("Measure the time spent in each stage of the script and save it next to the project, in <project>.profile.json."));
+
 
     connect(settings_font_spin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this] (int value) {
         QFont font = QApplication::font();
@@ -1085,10 +1125,38 @@ void WibblyWindow::createSettingsWindow() {
         settings.setValue(KEY_USE_RELATIVE_PATHS, checked);
     });
 
+    connect(settings_use_columns_file_check, &QCheckBox::clicked, [this] (bool checked) {
+        settings.setValue(KEY_USE_COLUMNS_FILE, checked);
+    });
+
     connect(settings_cache_spin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this] (int value) {
         settings.setValue(KEY_MAXIMUM_CACHE_SIZE, value);
     });
 
+    connect(settings_jobs_spin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this] (int value) {
+        settings.setValue(KEY_SIMULTANEOUS_JOBS, value);
+    });
+
+    connect(settings_segments_spin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this] (int value) {
+        settings.setValue(KEY_SEGMENTS_PER_JOB, value);
+    });
+
+    connect(settings_memory_spin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this] (int value) {
+        settings.setValue(KEY_MEMORY_BUDGET, value);
+    });
+
+    connect(settings_checkpoint_spin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this] (int value) {
+        settings.setValue(KEY_CHECKPOINT_INTERVAL, value);
+    });
+
+    connect(settings_indexing_spin, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this] (int value) {
+        settings.setValue(KEY_INDEXING_CONCURRENCY, value);
+    });
+
+    connect(settings_profile_check, &QCheckBox::clicked, [this] (bool checked) {
+        settings.setValue(KEY_PROFILE_JOBS, checked);
+    });
+
 
     QVBoxLayout *vbox = new QVBoxLayout;
 
@@ -1102,11 +1170,46 @@ void WibblyWindow::createSettingsWindow() {
     hbox->addStretch(1);
     vbox->addLayout(hbox);
 
+    hbox = new QHBoxLayout;
+    hbox->addWidget(settings_use_columns_file_check);
+    hbox->addStretch(1);
+    vbox->addLayout(hbox);
+
     hbox = new QHBoxLayout;
     hbox->addWidget(settings_cache_spin);
     hbox->addStretch(1);
     vbox->addLayout(hbox);
 
+    hbox = new QHBoxLayout;
+    hbox->addWidget(settings_jobs_spin);
+    hbox->addStretch(1);
+    vbox->addLayout(hbox);
+
+    hbox = new QHBoxLayout;
+    hbox->addWidget(settings_segments_spin);
+    hbox->addStretch(1);
+    vbox->addLayout(hbox);
+
+    hbox = new QHBoxLayout;
+    hbox->addWidget(settings_memory_spin);
+    hbox->addStretch(1);
+    vbox->addLayout(hbox);
+
+    hbox = new QHBoxLayout;
+    hbox->addWidget(settings_checkpoint_spin);
+    hbox->addStretch(1);
+    vbox->addLayout(hbox);
+
+    hbox = new QHBoxLayout;
+    hbox->addWidget(settings_indexing_spin);
+    hbox->addStretch(1);
+    vbox->addLayout(hbox);
+
+    hbox = new QHBoxLayout;
+    hbox->addWidget(settings_profile_check);
+    hbox->addStretch(1);
+    vbox->addLayout(hbox);
+
     vbox->addStretch(1);
 
 
@@ -1127,21 +1230,6 @@ void WibblyWindow::createSettingsWindow() {
 
 
 void WibblyWindow::realOpenVideo(const QString &path) {
-    QString source_filter;
-
-    QString extension = path.mid(path.lastIndexOf('.') + 1);
-
-    QStringList mp4 = { "mp4", "m4v", "mov" };
-
-    if (extension == "dgi")
-        source_filter = "dgdecodenv.DGSource";
-    else if (extension == "d2v")
-        source_filter = "d2v.Source";
-    else if (mp4.contains(extension))
-        source_filter = "lsmas.LibavSMASHSource";
-    else
-        source_filter = "lsmas.LWLibavSource";
-
     jobs.emplace_back();
 
     WibblyJob &job = jobs.back();
@@ -1149,7 +1237,7 @@ void WibblyWindow::realOpenVideo(const QString &path) {
     job.setCrop(settings_last_crop[0], settings_last_crop[1], settings_last_crop[2], settings_last_crop[3]);
 
     job.setInputFile(path.toStdString());
-    job.setSourceFilter(source_filter.toStdString());
+    job.setSourceFilter(WibblyJob::guessSourceFilter(path.toStdString()));
     job.setOutputFile(QStringLiteral("%1.wob").arg(path).toStdString());
 
     main_jobs_list->addItem(path);
@@ -1235,11 +1323,6 @@ void WibblyWindow::evaluateDisplayScript() {
         throw WobblyException("Failed to evaluate display script. Error message:\n" + error);
     }
 
-    // Wait until all requests are done before freeing the node.
-    std::unique_lock<std::mutex> lock(requests_mutex);
-    while (request_count)
-        requests_condition.wait(lock);
-
     vsapi->freeNode(vsnode);
 
     vsnode = vssapi->getOutputNode(vsscript, 0);
@@ -1324,258 +1407,154 @@ void WibblyWindow::displayFrame(int n) {
 }
 
 
-void VS_CC frameDoneCallback(void *userData, const VSFrame *f, int n, VSNode *, const char *errorMsg) {
-    WibblyWindow *window = (WibblyWindow *)userData;
-
-    // Qt::DirectConnection = frameDone runs in the worker threads
-    // Qt::QueuedConnection = frameDone runs in the GUI thread
-    QMetaObject::invokeMethod(window, "frameDone", Qt::DirectConnection, Q_ARG(void *, (void *)f), Q_ARG(int, n), Q_ARG(QString, QString(errorMsg)));
-}
-
-
 // Always runs in the GUI thread.
-void WibblyWindow::startNextJob() {
-    current_job++;
-
-    if (current_job == (int)jobs.size()) {
-        // No more jobs.
-        current_job = -1;
-
-        int current_row = main_jobs_list->currentRow();
-        main_jobs_list->setCurrentRow(-1, QItemSelectionModel::NoUpdate);
-        main_jobs_list->setCurrentRow(current_row, QItemSelectionModel::NoUpdate);
-
-        QApplication::alert(this, 0);
-
-        // Re-enable the user interface.
-        setEnabled(true);
-
-        return;
-    }
-
+void WibblyWindow::startJobs() {
     setEnabled(false);
 
-    const WibblyJob &job = jobs[current_job];
-
-    try {
-        evaluateFinalScript(current_job);
-    } catch (WobblyException &e) {
-        errorPopup(e.what());
-        return;
-    }
-
-    QString input_file = QString::fromStdString(job.getInputFile());
-    if (settings_use_relative_paths_check->isChecked())
-        input_file = QFileInfo(input_file).fileName();
+    job_progress.assign(jobs.size(), 0);
+    running_jobs.clear();
+    running_windows.clear();
+    job_profiles.clear();
+    indexing_files.clear();
+    jobs_finished = 0;
 
-    current_project = new WobblyProject(false, input_file.toStdString(), job.getSourceFilter(), vsvi->fpsNum, vsvi->fpsDen, vsvi->width, vsvi->height, vsvi->numFrames);
-
-    auto trims = job.getTrims();
-    for (auto it = trims.cbegin(); it != trims.cend(); it++)
-        current_project->addTrim(it->second.first, it->second.last);
-
-    if (!trims.size())
-        current_project->addTrim(0, vsvi->numFrames - 1);
+    main_progress_dialog->setMinimum(0);
+    main_progress_dialog->setMaximum((int)jobs.size() * 100);
+    main_progress_dialog->setValue(0);
 
-    int steps = job.getSteps();
+    scheduler = new JobScheduler(vssapi, vsapi, this);
+    scheduler->setMaximumJobs(settings_jobs_spin->value());
+    scheduler->setMemoryBudget(settings_memory_spin->value());
+    scheduler->setSegments(settings_segments_spin->value(), 100);
+    scheduler->setCheckpointInterval(settings_checkpoint_spin->value());
+    scheduler->setProfiling(settings_profile_check->isChecked());
+    scheduler->setIndexingConcurrency(settings_indexing_spin->value());
+    scheduler->setProjectOptions(settings_compact_projects_check->isChecked(), settings_use_relative_paths_check->isChecked(), settings_use_columns_file_check->isChecked());
 
-    if (steps & StepFieldMatch) {
-        for (size_t i = 0; i < vfm_params.size(); i++) {
-            if (vfm_params[i].type == VIVTCParamInt) {
-                current_project->setVFMParameter(vfm_params[i].name.toStdString(), job.getVFMParameterInt(vfm_params[i].name.toStdString()));
-            } else if (vfm_params[i].type == VIVTCParamDouble) {
-                current_project->setVFMParameter(vfm_params[i].name.toStdString(), job.getVFMParameterDouble(vfm_params[i].name.toStdString()));
-            } else if (vfm_params[i].type == VIVTCParamBool) {
-                current_project->setVFMParameter(vfm_params[i].name.toStdString(), (int)job.getVFMParameterBool(vfm_params[i].name.toStdString()));
-            }
-        }
-    }
+    connect(scheduler, &JobScheduler::errorMessage, this, &WibblyWindow::errorPopup);
 
-    if (steps & StepDecimation) {
-        for (size_t i = 0; i < vdecimate_params.size(); i++) {
-            if (vdecimate_params[i].type == VIVTCParamInt) {
-                current_project->setVDecimateParameter(vdecimate_params[i].name.toStdString(), job.getVDecimateParameterInt(vdecimate_params[i].name.toStdString()));
-            } else if (vdecimate_params[i].type == VIVTCParamDouble) {
-                current_project->setVDecimateParameter(vdecimate_params[i].name.toStdString(), job.getVDecimateParameterDouble(vdecimate_params[i].name.toStdString()));
-            } else if (vdecimate_params[i].type == VIVTCParamBool) {
-                current_project->setVDecimateParameter(vdecimate_params[i].name.toStdString(), (int)job.getVDecimateParameterBool(vdecimate_params[i].name.toStdString()));
-            }
-        }
-    }
+    connect(scheduler, &JobScheduler::vsLogMessage, this, &WibblyWindow::vsLogPopup);
 
-    if (!(steps & StepFieldMatch || steps & StepInterlacedFades || steps & StepDecimation || steps & StepSceneChanges)) {
-        // No metrics to collect. Just create the project file and move on.
-        try {
-            current_project->writeProject(job.getOutputFile(), settings_compact_projects_check->isChecked());
+    connect(scheduler, &JobScheduler::indexingStarted, this, [this] (int file, int total, QString path) {
+        indexing_files[file] = QStringLiteral("Indexing file %1/%2:\n%3").arg(file + 1).arg(total).arg(path);
 
-            delete current_project;
-            current_project = nullptr;
-        } catch (WobblyException &e) {
-            errorPopup(e.what());
+        updateProgressLabel();
+    });
 
-            delete current_project;
-            current_project = nullptr;
-        }
+    connect(scheduler, &JobScheduler::indexingFinished, this, [this] (int file, int, bool) {
+        indexing_files.erase(file);
 
-        QApplication::processEvents();
+        updateProgressLabel();
+    });
 
-        // A little recursion, but surely there won't be enough jobs to make it a problem.
-        startNextJob();
+    connect(scheduler, &JobScheduler::jobStarted, this, [this] (int job, int) {
+        running_jobs[job] = QStringLiteral("Job %1/%2:\n%3").arg(job + 1).arg(jobs.size()).arg(QString::fromStdString(jobs[job].getOutputFile()));
 
-        return;
-    }
+        updateProgressLabel();
+    });
 
-    progress_dialog_label_text = QStringLiteral("Job %1/%2:\n%3").arg(current_job + 1).arg(jobs.size()).arg(QString::fromStdString(job.getOutputFile()));
+    connect(scheduler, &JobScheduler::progressUpdate, this, [this] (int job, int frame, int total) {
+        setJobProgress(job, (int)((int64_t)frame * 100 / total));
+    });
 
-    main_progress_dialog->setLabelText(progress_dialog_label_text + "\n\n");
-    main_progress_dialog->setMinimum(0);
-    main_progress_dialog->setMaximum(vsvi->numFrames);
-    main_progress_dialog->setValue(0);
+    connect(scheduler, &JobScheduler::speedUpdate, this, [this] (int job, double fps, QString time_left) {
+        running_jobs[job] = QStringLiteral("Job %1/%2:\n%3\n%4 fps, %5 to finish this job")
+                .arg(job + 1)
+                .arg(jobs.size())
+                .arg(QString::fromStdString(jobs[job].getOutputFile()))
+                .arg(fps, 0, 'f', 2)
+                .arg(time_left);
 
-    VSCoreInfo core_info;
-    vsapi->getCoreInfo(vscore, &core_info);
-    int requests = std::min(core_info.numThreads, vsvi->numFrames);
+        updateProgressLabel();
+    });
 
-    aborted = false;
+    connect(scheduler, &JobScheduler::requestWindowUpdate, this, [this] (int job, int requests, double fps) {
+        running_windows[job] = QStringLiteral("%1 frames in flight, %2 fps").arg(requests).arg(fps, 0, 'f', 2);
 
-    frames_left = vsvi->numFrames;
+        updateProgressLabel();
+    });
 
-    next_frame = 0;
-    elapsed_timer.start();
-    update_timer.start();
-    for (int i = 0; i < requests; i++) {
-        ++request_count;
-        vsapi->getFrameAsync(next_frame, vsnode, frameDoneCallback, (void *)this);
-        next_frame++;
-    }
-}
+    connect(scheduler, &JobScheduler::profileReport, this, [this] (int job, QString summary) {
+        job_profiles[job] = QStringLiteral("Job %1/%2 profile:\n%3").arg(job + 1).arg(jobs.size()).arg(summary);
 
+        updateProgressLabel();
+    });
 
-// Runs in the worker threads, so don't touch the GUI directly.
-// The worker threads are queued up inside VapourSynth, so they run one at a time.
-void WibblyWindow::frameDone(void *frame_v, int n, const QString &error_msg) {
-    const VSFrame *frame = (const VSFrame *)frame_v;
+    connect(scheduler, &JobScheduler::jobFinished, this, [this] (int job, bool) {
+        running_jobs.erase(job);
+        running_windows.erase(job);
+        jobs_finished++;
 
-    if (aborted) {
-        vsapi->freeFrame(frame);
-    } else {
-        if (frame) {
-            const VSMap *props = vsapi->getFramePropertiesRO(frame);
+        setJobProgress(job, 100);
 
-            int err;
+        updateProgressLabel();
+    });
 
-            const char match_chars[] = { 'p', 'c', 'n', 'b', 'u' };
-            int64_t match = vsapi->mapGetInt(props, "VFMMatch", 0, &err);
-            if (!err)
-                current_project->setOriginalMatch(n, match_chars[match]);
+    connect(scheduler, &JobScheduler::workFinished, this, [this] (int failed_jobs) {
+        scheduler->deleteLater();
+        scheduler = nullptr;
 
-            if (vsapi->mapGetInt(props, "_Combed", 0, &err))
-                current_project->addCombedFrame(n);
+        stopJobs();
 
-            if (vsapi->mapNumElements(props, "VFMMics") == 5) {
-                const int64_t *mics = vsapi->mapGetIntArray(props, "VFMMics", &err);
-                current_project->setMics(n, mics[0], mics[1], mics[2], mics[3], mics[4]);
-            }
+        if (!failed_jobs)
+            QApplication::alert(this, 0);
 
-            if (vsapi->mapNumElements(props, "MMetrics") == 2 && vsapi->mapNumElements(props, "VMetrics") == 2) {
-                const int64_t *mmetrics = vsapi->mapGetIntArray(props, "MMetrics", &err);
-                const int64_t *vmetrics = vsapi->mapGetIntArray(props, "VMetrics", &err);
-                current_project->setDMetrics(n, mmetrics[0], mmetrics[1], vmetrics[0], vmetrics[1]);
-            }
+        if (job_profiles.size()) {
+            QString text;
+            for (auto it = job_profiles.cbegin(); it != job_profiles.cend(); it++)
+                text += it->second + "\n\n";
 
-            if (vsapi->mapGetInt(props, "_SceneChangePrev", 0, &err))
-                current_project->addSection(n);
+            QMessageBox::information(this, QStringLiteral("Profiles"), text.trimmed());
+        }
+    });
 
-            int64_t decimate_metric = vsapi->mapGetInt(props, "VDecimateMaxBlockDiff", 0, &err);
-            if (!err)
-                current_project->setDecimateMetric(n, decimate_metric);
+    updateProgressLabel();
 
-            if (vsapi->mapGetInt(props, "VDecimateDrop", 0, &err))
-                current_project->addDecimatedFrame(n);
+    scheduler->start(jobs);
+}
 
-            double field_difference = vsapi->mapGetFloat(props, "WibblyFieldDifference", 0, &err);
-            if (field_difference > jobs[current_job].getFadesThreshold())
-                current_project->addInterlacedFade(n, field_difference);
 
-            vsapi->freeFrame(frame);
+void WibblyWindow::stopJobs() {
+    main_progress_dialog->reset();
 
-            if (next_frame < vsvi->numFrames) {
-                ++request_count;
-                vsapi->getFrameAsync(next_frame, vsnode, frameDoneCallback, (void *)this);
-                next_frame++;
-            }
+    int current_row = main_jobs_list->currentRow();
+    main_jobs_list->setCurrentRow(-1, QItemSelectionModel::NoUpdate);
+    main_jobs_list->setCurrentRow(current_row, QItemSelectionModel::NoUpdate);
 
-            frames_left--;
-
-            // Speed and time remaining updated every five seconds,
-            // or as long as it takes to process a frames, whichever is larger.
-            if (update_timer.elapsed() >= 5000) {
-                update_timer.start();
-
-                qint64 elapsed_milliseconds = elapsed_timer.elapsed();
-                double frames_per_second = (double)(vsvi->numFrames - frames_left) * 1000 / elapsed_milliseconds;
-                int seconds_left = (int)(frames_left / frames_per_second);
-                int minutes_left = seconds_left / 60;
-                seconds_left = seconds_left % 60;
-                int hours_left = minutes_left / 60;
-                minutes_left = minutes_left % 60;
-
-                QMetaObject::invokeMethod(
-                            main_progress_dialog,
-                            "setLabelText",
-                            Qt::QueuedConnection,
-                            Q_ARG(QString, QStringLiteral("%1\n\n%2 fps, %3:%4:%5 to finish this job")
-                                  .arg(progress_dialog_label_text)
-                                  .arg(frames_per_second, 0, 'f', 2)
-                                  .arg(hours_left, 2, 10, QLatin1Char('0'))
-                                  .arg(minutes_left, 2, 10, QLatin1Char('0'))
-                                  .arg(seconds_left, 2, 10, QLatin1Char('0'))));
-            }
+    // Re-enable the user interface.
+    setEnabled(true);
+}
 
-            QMetaObject::invokeMethod(
-                        main_progress_dialog,
-                        "setValue",
-                        Qt::QueuedConnection,
-                        Q_ARG(int, vsvi->numFrames - frames_left));
 
-            if (frames_left == 0) {
-                try {
-                    current_project->resetRangeMatches(0, vsvi->numFrames - 1);
+void WibblyWindow::setJobProgress(int job, int percent) {
+    int value = main_progress_dialog->value() + percent - job_progress[job];
 
-                    // If the project was successfully saved earlier, this will probably work.
-                    current_project->writeProject(jobs[current_job].getOutputFile(), settings_compact_projects_check->isChecked());
+    job_progress[job] = percent;
 
-                    delete current_project;
-                    current_project = nullptr;
+    // Reaching the maximum would reset the dialog before the last project is written.
+    if (value < main_progress_dialog->maximum())
+        main_progress_dialog->setValue(value);
+}
 
-                    QMetaObject::invokeMethod(this, "startNextJob", Qt::QueuedConnection);
-                } catch (WobblyException &e) {
-                    QMetaObject::invokeMethod(this, "errorPopup", Qt::QueuedConnection, Q_ARG(QString, QString(e.what())));
 
-                    aborted = true;
-                    current_job = -1;
-                    QMetaObject::invokeMethod(this, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, true));
+void WibblyWindow::updateProgressLabel() {
+    QString text = QStringLiteral("%1/%2 jobs finished, %3 running").arg(jobs_finished).arg(jobs.size()).arg(running_jobs.size());
 
-                    delete current_project;
-                    current_project = nullptr;
-                }
-            }
-        } else {
-            aborted = true;
+    for (auto it = indexing_files.cbegin(); it != indexing_files.cend(); it++)
+        text += "\n\n" + it->second;
 
-            delete current_project;
-            current_project = nullptr;
+    for (auto it = running_jobs.cbegin(); it != running_jobs.cend(); it++) {
+        text += "\n\n" + it->second;
 
-            QMetaObject::invokeMethod(this, "errorPopup", Qt::QueuedConnection, Q_ARG(QString, QStringLiteral("Job number %1: failed to retrieve frame number %2. Error message:\n\n%3").arg(current_job).arg(n).arg(error_msg)));
-        }
+        auto window = running_windows.find(it->first);
+        if (window != running_windows.cend())
+            text += "\n" + window->second;
     }
 
-    --request_count;
+    for (auto it = job_profiles.cbegin(); it != job_profiles.cend(); it++)
+        text += "\n\n" + it->second;
 
-    if (request_count == 0) {
-        std::lock_guard<std::mutex> lock(requests_mutex);
-        requests_condition.notify_one();
-    }
+    main_progress_dialog->setLabelText(text);
 }
 
 
@@ -1592,8 +1571,22 @@ void WibblyWindow::readSettings() {
 
     settings_use_relative_paths_check->setChecked(settings.value(KEY_USE_RELATIVE_PATHS, false).toBool());
 
+    settings_use_columns_file_check->setChecked(settings.value(KEY_USE_COLUMNS_FILE, false).toBool());
+
     if (settings.contains(KEY_MAXIMUM_CACHE_SIZE))
         settings_cache_spin->setValue(settings.value(KEY_MAXIMUM_CACHE_SIZE).toInt());
+
+    settings_jobs_spin->setValue(settings.value(KEY_SIMULTANEOUS_JOBS, 1).toInt());
+
+    settings_segments_spin->setValue(settings.value(KEY_SEGMENTS_PER_JOB, 1).toInt());
+
+    settings_memory_spin->setValue(settings.value(KEY_MEMORY_BUDGET, 0).toInt());
+
+    settings_checkpoint_spin->setValue(settings.value(KEY_CHECKPOINT_INTERVAL, 60).toInt());
+
+    settings_indexing_spin->setValue(settings.value(KEY_INDEXING_CONCURRENCY, settings_indexing_spin->value()).toInt());
+
+    settings_profile_check->setChecked(settings.value(KEY_PROFILE_JOBS, false).toBool());
     
     if (settings.contains(KEY_LAST_CROP)) {
         QList<QVariant> crop_list = settings.value(KEY_LAST_CROP).toList();
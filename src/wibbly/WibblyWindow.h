@@ -21,12 +21,9 @@ SOFTWARE.
 #ifndef WIBBLYWINDOW_H
 #define WIBBLYWINDOW_H
 
-#include <atomic>
-
 #include <QCheckBox>
 #include <QCloseEvent>
 #include <QDoubleSpinBox>
-#include <QElapsedTimer>
 #include <QLabel>
 #include <QLineEdit>
 #include <QMainWindow>
@@ -41,6 +38,7 @@ SOFTWARE.
 #include "ListWidget.h"
 #include "ProgressDialog.h"
 
+#include "JobScheduler.h"
 #include "WibblyJob.h"
 
 
@@ -102,7 +100,14 @@ class WibblyWindow : public QMainWindow
     QSpinBox *settings_font_spin;
     QCheckBox *settings_compact_projects_check;
     QCheckBox *settings_use_relative_paths_check;
+    QCheckBox *settings_use_columns_file_check;
     QSpinBox *settings_cache_spin;
+    QSpinBox *settings_jobs_spin;
+    QSpinBox *settings_segments_spin;
+    QSpinBox *settings_memory_spin;
+    QSpinBox *settings_checkpoint_spin;
+    QCheckBox *settings_profile_check;
+    QSpinBox *settings_indexing_spin;
     int settings_last_crop[4] = {};
 
 
@@ -123,16 +128,15 @@ class WibblyWindow : public QMainWindow
     int trim_start = -1;
     int trim_end = -1;
 
-    WobblyProject *current_project = nullptr;
-    int current_job = -1;
-    int next_frame = 0;
-    int frames_left = 0;
-    bool aborted = false;
-    std::atomic<int> request_count;
-
-    QString progress_dialog_label_text;
-    QElapsedTimer elapsed_timer;
-    QElapsedTimer update_timer;
+    JobScheduler *scheduler = nullptr;
+    std::vector<int> job_progress;
+    std::map<int, QString> running_jobs;
+    std::map<int, QString> running_windows;
+    // File number -> progress text, while the source filters build their indexes.
+    std::map<int, QString> indexing_files;
+    // Job index -> summary of its profile. Kept until all the jobs are done.
+    std::map<int, QString> job_profiles;
+    int jobs_finished = 0;
 
     QSettings settings;
 
@@ -163,6 +167,10 @@ class WibblyWindow : public QMainWindow
     void evaluateDisplayScript();
     void displayFrame(int n);
 
+    void stopJobs();
+    void setJobProgress(int job, int percent);
+    void updateProgressLabel();
+
     void readSettings();
     void writeSettings();
 
@@ -191,9 +199,8 @@ public:
 
 public slots:
     void vsLogPopup(int msgType, const QString &msg);
-    void frameDone(void *frame_v, int n, const QString &error_msg);
 
-    void startNextJob();
+    void startJobs();
 
     void errorPopup(const QString &msg);
 };
@@ -76,6 +76,8 @@ void CombedFramesCollector::start(std::string script, const char *script_name) {
     elapsed_timer.start();
     update_timer.start();
 
+    request_window.start(requests, requests * 4);
+
     for (int i = 0; i < requests; i++) {
         request_count++;
         vsapi->getFrameAsync(next_frame, vsnode, CombedFramesCollector::frameDoneCallback, (void *)this);
@@ -120,8 +122,12 @@ void CombedFramesCollector::frameDone(void *frame_v, int n, const QString &error
 
             vsapi->freeFrame(frame);
 
-            // Request another frame
-            if (next_frame < num_frames) {
+            if (request_window.frameDone(elapsed_timer.elapsed()))
+                emit requestWindowUpdate(request_window.getSize(), request_window.getThroughput());
+
+            // Request more frames, unless the window shrank.
+            // This frame's request still counts, hence the - 1.
+            while (request_count - 1 < request_window.getSize() && next_frame < num_frames) {
                 request_count++;
                 vsapi->getFrameAsync(next_frame, vsnode, CombedFramesCollector::frameDoneCallback, (void *)this);
                 next_frame++;
@@ -29,6 +29,8 @@ SOFTWARE.
 #include <QElapsedTimer>
 #include <QObject>
 
+#include "RequestWindow.h"
+
 class CombedFramesCollector : public QObject {
     Q_OBJECT
 
@@ -47,6 +49,8 @@ class CombedFramesCollector : public QObject {
     QElapsedTimer update_timer;
     QElapsedTimer elapsed_timer;
 
+    RequestWindow request_window;
+
     std::set<int> combed_frames;
 
     static void VS_CC frameDoneCallback(void *userData, const VSFrame *f, int n, VSNode *, const char *errorMsg);
@@ -63,6 +67,7 @@ signals:
     void workFinished();
     void progressUpdate(int frame);
     void speedUpdate(double fps, QString time_left);
+    void requestWindowUpdate(int requests, double fps);
     void errorMessage(const char *text);
     void combedFramesCollected(const std::set<int> &frames);
 
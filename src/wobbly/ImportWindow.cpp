@@ -66,7 +66,7 @@ ImportWindow::ImportWindow(const QString &_file_name, const ImportedThings &impo
 
 
     connect(browse_button, &QPushButton::clicked, [this] () {
-        QString path = QFileDialog::getOpenFileName(this, QStringLiteral("Select Wobbly project"), file_name, QStringLiteral("Wobbly projects (*.wob);;All files (*)"));
+        QString path = QFileDialog::getOpenFileName(this, QStringLiteral("Select Wobbly project"), file_name, QStringLiteral("Wobbly projects (*.wob *.wob.gz);;All files (*)"));
 
         if (!path.isEmpty()) {
             file_name_edit->setText(path);
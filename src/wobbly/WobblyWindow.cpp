@@ -69,6 +69,8 @@ SOFTWARE.
 
 #define KEY_COMPACT_PROJECT_FILES           QStringLiteral("projects/compact_project_files")
 #define KEY_USE_RELATIVE_PATHS              QStringLiteral("projects/use_relative_paths")
+#define KEY_USE_COLUMNS_FILE                QStringLiteral("projects/use_columns_file")
+#define KEY_USE_JOURNAL                     QStringLiteral("projects/use_journal")
 
 
 struct CallbackData {
@@ -164,6 +166,10 @@ void WobblyWindow::readSettings() {
 
     settings_use_relative_paths_check->setChecked(settings.value(KEY_USE_RELATIVE_PATHS, false).toBool());
 
+    settings_use_columns_file_check->setChecked(settings.value(KEY_USE_COLUMNS_FILE, false).toBool());
+
+    settings_use_journal_check->setChecked(settings.value(KEY_USE_JOURNAL, false).toBool());
+
     settings_bookmark_description_check->setChecked(settings.value(KEY_ASK_FOR_BOOKMARK_DESCRIPTION, true).toBool());
 
     /// Why is it that the default values for some of these settings are kept in this function,
@@ -2468,8 +2474,15 @@ void WobblyWindow::createCombedFramesWindow() {
 
         connect(collector, &CombedFramesCollector::progressUpdate, progress_dialog, &QProgressDialog::setValue);
 
-        connect(collector, &CombedFramesCollector::speedUpdate, [progress_dialog] (double fps, QString time_left) {
-            progress_dialog->setLabelText(QStringLiteral("%1 fps, %2 left").arg(fps, 0, 'f', 2).arg(time_left));
+        // Shown with the next speed update.
+        std::shared_ptr<QString> window_text = std::make_shared<QString>();
+
+        connect(collector, &CombedFramesCollector::requestWindowUpdate, [window_text] (int requests, double fps) {
+            *window_text = QStringLiteral("\n%1 frames in flight, %2 fps").arg(requests).arg(fps, 0, 'f', 2);
+        });
+
+        connect(collector, &CombedFramesCollector::speedUpdate, [progress_dialog, window_text] (double fps, QString time_left) {
+            progress_dialog->setLabelText(QStringLiteral("%1 fps, %2 left").arg(fps, 0, 'f', 2).arg(time_left) + *window_text);
         });
 
         connect(collector, &CombedFramesCollector::combedFramesCollected, [this] (const std::set<int> &combed_frames) {
@@ -2602,6 +2615,12 @@ void WobblyWindow::createSettingsWindow() {
 
     settings_use_relative_paths_check = new QCheckBox(QStringLiteral("Use relative paths in project files"));
 
+    settings_use_columns_file_check = new QCheckBox(QStringLiteral("Store per-frame data in a binary file next to the project"));
+    settings_use_columns_file_check->setToolTip(QStringLiteral("Large projects open and save much faster, but the project needs the '.columns' file and older versions of Wobbly can't open it."));
+
+    settings_use_journal_check = new QCheckBox(QStringLiteral("Keep a journal of unsaved edits for crash recovery"));
+    settings_use_journal_check->setToolTip(QStringLiteral("Every edit is appended to a '.journal' file next to the project, and replayed when the project is opened after a crash. The journal starts working once the project has been saved with this option enabled. A large journal is folded into the project by saving it automatically."));
+
     settings_print_details_check = new QCheckBox(QStringLiteral("Print frame details on top of the video"));
 
     settings_bookmark_description_check = new QCheckBox(QStringLiteral("Ask for bookmark description"));
@@ -2650,6 +2669,18 @@ void WobblyWindow::createSettingsWindow() {
         settings.setValue(KEY_USE_RELATIVE_PATHS, checked);
     });
 
+    connect(settings_use_columns_file_check, &QCheckBox::toggled, [this] (bool checked) {
+        settings.setValue(KEY_USE_COLUMNS_FILE, checked);
+    });
+
+    connect(settings_use_journal_check, &QCheckBox::toggled, [this] (bool checked) {
+        settings.setValue(KEY_USE_JOURNAL, checked);
+
+        // Turning it on takes effect at the next save.
+        if (!checked && project)
+            project->stopJournal();
+    });
+
     connect(settings_print_details_check, &QCheckBox::toggled, [this] (bool checked) {
         settings.setValue(KEY_PRINT_DETAILS_ON_VIDEO, checked);
 
@@ -2794,6 +2825,8 @@ void WobblyWindow::createSettingsWindow() {
     QFormLayout *form = new QFormLayout;
     form->addRow(settings_compact_projects_check);
     form->addRow(settings_use_relative_paths_check);
+    form->addRow(settings_use_columns_file_check);
+    form->addRow(settings_use_journal_check);
     form->addRow(settings_print_details_check);
     form->addRow(settings_bookmark_description_check);
     form->addRow(QStringLiteral("Font size"), settings_font_spin);
@@ -3560,12 +3593,17 @@ void WobblyWindow::initialiseUIFromProject() {
 
 
 void WobblyWindow::realOpenProject(const QString &path) {
+    waitForSave();
+
     WobblyProject *tmp = new WobblyProject(true);
 
     try {
         QApplication::setOverrideCursor(Qt::WaitCursor);
 
-        tmp->readProject(path.toStdString());
+        // The mics and the metrics get decoded while the user starts working.
+        tmp->readProject(path.toStdString(), true);
+
+        int recovered_edits = tmp->replayJournal(path.toStdString());
 
         QApplication::restoreOverrideCursor();
 
@@ -3585,6 +3623,23 @@ void WobblyWindow::realOpenProject(const QString &path) {
         vssapi->evaluateBuffer(vsscript, "vs.clear_output(1)", "wobbly.cleanup");
 
         connect(project, &WobblyProject::modifiedChanged, this, &WobblyWindow::updateWindowTitle);
+        connect(project, &WobblyProject::journalFull, this, &WobblyWindow::compactJournal);
+        connect(project, &WobblyProject::journalFailed, this, &WobblyWindow::journalFailed);
+        connect(project, &WobblyProject::metricsLoaded, this, &WobblyWindow::updateFrameDetails);
+        connect(project, &WobblyProject::metricsFailed, this, &WobblyWindow::metricsFailed);
+
+        project->loadMetricsInBackground();
+
+        if (settings_use_journal_check->isChecked()) {
+            try {
+                project->startJournal(path.toStdString());
+            } catch (WobblyException &e) {
+                errorPopup(e.what());
+            }
+        }
+
+        if (recovered_edits)
+            QMessageBox::information(this, QStringLiteral("Recovered edits"), QStringLiteral("Recovered %1 edits made after the project was last saved. Save the project to keep them.").arg(recovered_edits));
 
         evaluateMainDisplayScript();
     } catch (WobblyException &e) {
@@ -3606,7 +3661,7 @@ void WobblyWindow::realOpenProject(const QString &path) {
 
 
 void WobblyWindow::openFile(const QString &path) {
-    if (path.endsWith(".wob") || path.endsWith(".json"))
+    if (path.endsWith(".wob") || path.endsWith(".wob.gz") || path.endsWith(".json"))
         realOpenProject(path);
     else
         realOpenVideo(path);
@@ -3617,7 +3672,7 @@ void WobblyWindow::openProject() {
     if (askToSaveIfModified() == QMessageBox::Cancel)
         return;
 
-    QString path = QFileDialog::getOpenFileName(this, QStringLiteral("Open Wobbly project"), settings.value(KEY_LAST_DIR).toString(), QStringLiteral("Wobbly projects (*.wob);;All files (*)"));
+    QString path = QFileDialog::getOpenFileName(this, QStringLiteral("Open Wobbly project"), settings.value(KEY_LAST_DIR).toString(), QStringLiteral("Wobbly projects (*.wob *.wob.gz);;All files (*)"));
 
     if (!path.isNull()) {
         settings.setValue(KEY_LAST_DIR, QFileInfo(path).absolutePath());
@@ -3628,6 +3683,8 @@ void WobblyWindow::openProject() {
 
 
 void WobblyWindow::realOpenVideo(const QString &path) {
+    waitForSave();
+
     try {
         QString source_filter;
 
@@ -3699,6 +3756,8 @@ void WobblyWindow::realOpenVideo(const QString &path) {
         addRecentFile(path);
 
         connect(project, &WobblyProject::modifiedChanged, this, &WobblyWindow::updateWindowTitle);
+        connect(project, &WobblyProject::journalFull, this, &WobblyWindow::compactJournal);
+        connect(project, &WobblyProject::journalFailed, this, &WobblyWindow::journalFailed);
     } catch(WobblyException &e) {
         errorPopup(e.what());
     }
@@ -3719,10 +3778,15 @@ void WobblyWindow::openVideo() {
 }
 
 
-void WobblyWindow::realSaveProject(const QString &path) {
+void WobblyWindow::realSaveProject(const QString &path, bool in_background) {
     if (!project)
         return;
 
+    waitForSave();
+
+    // Saving a project that was just opened shouldn't drop its metrics.
+    project->waitForMetrics();
+
     // The currently selected preset might not have been stored in the project yet.
     presetEdited();
 
@@ -3733,24 +3797,116 @@ void WobblyWindow::realSaveProject(const QString &path) {
     project->setUIState(std::string(state.constData(), state.size()));
     project->setUIGeometry(std::string(geometry.constData(), geometry.size()));
 
-    QApplication::setOverrideCursor(Qt::WaitCursor);
+    // The journal has to be in place before the snapshot, so the project
+    // file records which journal entries it already contains.
+    if (settings_use_journal_check->isChecked()) {
+        try {
+            project->startJournal(path.toStdString());
+        } catch (WobblyException &e) {
+            errorPopup(e.what());
+        }
+    } else {
+        project->stopJournal();
+    }
 
-    try {
-        project->writeProject(path.toStdString(), settings_compact_projects_check->isChecked());
-    } catch (WobblyException &e) {
-        QApplication::restoreOverrideCursor();
+    // The snapshot is written while the user keeps working on the project.
+    // Any change made in the meantime marks the project as modified again.
+    save_snapshot = project->createSnapshot();
+    save_path = path;
+    save_error.clear();
 
-        throw e;
-    }
+    project->setModified(false);
+
+    bool compact_project = settings_compact_projects_check->isChecked();
+    bool use_columns_file = settings_use_columns_file_check->isChecked();
+
+    save_thread = std::thread([this, compact_project, use_columns_file] () {
+        try {
+            save_snapshot->writeProject(save_path.toStdString(), compact_project, use_columns_file);
+        } catch (WobblyException &e) {
+            save_error = e.what();
+        }
+
+        QMetaObject::invokeMethod(this, "waitForSave", Qt::QueuedConnection);
+    });
+
+    if (in_background)
+        return;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+
+    std::string error = finishSave();
 
     QApplication::restoreOverrideCursor();
 
-    project_path = path;
+    if (!error.empty())
+        throw WobblyException(error);
+}
+
+
+std::string WobblyWindow::finishSave() {
+    save_thread.join();
+
+    uint64_t saved_sequence = save_snapshot->getJournalSequence();
+
+    delete save_snapshot;
+    save_snapshot = nullptr;
+
+    if (!save_error.empty()) {
+        // Nothing was saved, so the changes made before the save are still unsaved.
+        if (project)
+            project->setModified(true);
+
+        return save_error;
+    }
+
+    project_path = save_path;
     video_path.clear();
 
+    // The journal only needs the edits made after the snapshot was taken.
+    // After Save As, it only leaves the old project now that the new one exists.
+    if (project)
+        project->compactJournal(saved_sequence, save_path.toStdString());
+
     updateWindowTitle();
 
-    addRecentFile(path);
+    addRecentFile(save_path);
+
+    return std::string();
+}
+
+
+void WobblyWindow::waitForSave() {
+    if (!save_thread.joinable())
+        return;
+
+    std::string error = finishSave();
+
+    if (!error.empty())
+        errorPopup(error.c_str());
+}
+
+
+void WobblyWindow::compactJournal() {
+    if (save_thread.joinable() || !project || project_path.isEmpty())
+        return;
+
+    // Folding the journal into the project file is just a save.
+    try {
+        realSaveProject(project_path, true);
+    } catch (WobblyException &e) {
+        errorPopup(e.what());
+    }
+}
+
+
+void WobblyWindow::journalFailed(const QString &message) {
+    errorPopup(("The journal was stopped. Save the project to avoid losing your work. Error message: " + message).toUtf8().constData());
+}
+
+
+void WobblyWindow::metricsFailed(const QString &message) {
+    errorPopup(("The mics and metrics could not be loaded. They will be left out when the project is saved. Error message: " + message).toUtf8().constData());
 }
 
 
@@ -3762,7 +3918,7 @@ void WobblyWindow::saveProject() {
         if (project_path.isEmpty())
             saveProjectAs();
         else
-            realSaveProject(project_path);
+            realSaveProject(project_path, true);
     } catch (WobblyException &e) {
         errorPopup(e.what());
     }
@@ -3774,12 +3930,12 @@ void WobblyWindow::saveProjectAs() {
         if (!project)
             throw WobblyException("Can't save the project because none has been loaded.");
 
-        QString path = QFileDialog::getSaveFileName(this, QStringLiteral("Save Wobbly project"), settings.value(KEY_LAST_DIR).toString(), QStringLiteral("Wobbly projects (*.wob);;All files (*)"));
+        QString path = QFileDialog::getSaveFileName(this, QStringLiteral("Save Wobbly project"), settings.value(KEY_LAST_DIR).toString(), QStringLiteral("Wobbly projects (*.wob *.wob.gz);;All files (*)"));
 
         if (!path.isNull()) {
             settings.setValue(KEY_LAST_DIR, QFileInfo(path).absolutePath());
 
-            realSaveProject(path);
+            realSaveProject(path, true);
         }
     } catch (WobblyException &e) {
         errorPopup(e.what());
@@ -3981,11 +4137,24 @@ void WobblyWindow::saveSectionsAs() {
 QMessageBox::StandardButton WobblyWindow::askToSaveIfModified() {
     QMessageBox::StandardButton answer = QMessageBox::NoButton;
 
+    // The caller is about to close or replace the project, so a save still
+    // running in the background must be done first. If it failed, the
+    // project is marked as modified again and the user gets asked below.
+    waitForSave();
+
     if (project && project->isModified()) {
         answer = QMessageBox::question(this, QStringLiteral("Save?"), QStringLiteral("Save project?"), QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel, QMessageBox::Yes);
 
-        if (answer == QMessageBox::Yes)
+        if (answer == QMessageBox::Yes) {
             saveProject();
+            waitForSave();
+
+            if (project->isModified())
+                answer = QMessageBox::Cancel;
+        } else if (answer == QMessageBox::No) {
+            // Otherwise the edits would come back the next time the project is opened.
+            project->discardJournal();
+        }
     }
 
     return answer;
@@ -4448,46 +4617,52 @@ void WobblyWindow::updateFrameDetails() {
         combed_label->clear();
 
 
-    decimate_metric_label->setText(QStringLiteral("DMetric: ") + QString::number(project->getDecimateMetric(current_frame)));
-
+    if (!project->areMetricsLoaded()) {
+        decimate_metric_label->setText(QStringLiteral("DMetric: loading"));
+        mmetric_label->setText(QStringLiteral("MMetrics: loading"));
+        vmetric_label->setText(QStringLiteral("VMetrics: loading"));
+        mic_label->setText(QStringLiteral("Mics: loading"));
+    } else {
+        decimate_metric_label->setText(QStringLiteral("DMetric: ") + QString::number(project->getDecimateMetric(current_frame)));
 
-    int match_index2 = matchCharToIndexDMetrics(project->getMatch(current_frame));
-    QString mmetrics("MMetrics: ");
-    for (int i = 0; i < 3; i++) {
-        if (i == match_index2)
-            mmetrics += "<b>";
+        int match_index2 = matchCharToIndexDMetrics(project->getMatch(current_frame));
+        QString mmetrics("MMetrics: ");
+        for (int i = 0; i < 3; i++) {
+            if (i == match_index2)
+                mmetrics += "<b>";
 
-        mmetrics += QStringLiteral("%1 ").arg((int)project->getMMetrics(current_frame)[i]);
+            mmetrics += QStringLiteral("%1 ").arg((int)project->getMMetrics(current_frame)[i]);
 
-        if (i == match_index2)
-            mmetrics += "</b>";
-    }
-    mmetric_label->setText(mmetrics);
+            if (i == match_index2)
+                mmetrics += "</b>";
+        }
+        mmetric_label->setText(mmetrics);
 
-    QString vmetrics("VMetrics: ");
-    for (int i = 0; i < 3; i++) {
-        if (i == match_index2)
-            vmetrics += "<b>";
+        QString vmetrics("VMetrics: ");
+        for (int i = 0; i < 3; i++) {
+            if (i == match_index2)
+                vmetrics += "<b>";
 
-        vmetrics += QStringLiteral("%1 ").arg((int)project->getVMetrics(current_frame)[i]);
+            vmetrics += QStringLiteral("%1 ").arg((int)project->getVMetrics(current_frame)[i]);
 
-        if (i == match_index2)
-            vmetrics += "</b>";
-    }
-    vmetric_label->setText(vmetrics);
+            if (i == match_index2)
+                vmetrics += "</b>";
+        }
+        vmetric_label->setText(vmetrics);
 
-    int match_index = matchCharToIndex(project->getMatch(current_frame));
-    QString mics("Mics: ");
-    for (int i = 0; i < 5; i++) {
-        if (i == match_index)
-            mics += "<b>";
+        int match_index = matchCharToIndex(project->getMatch(current_frame));
+        QString mics("Mics: ");
+        for (int i = 0; i < 5; i++) {
+            if (i == match_index)
+                mics += "<b>";
 
-        mics += QStringLiteral("%1 ").arg((int)project->getMics(current_frame)[i]);
+            mics += QStringLiteral("%1 ").arg((int)project->getMics(current_frame)[i]);
 
-        if (i == match_index)
-            mics += "</b>";
+            if (i == match_index)
+                mics += "</b>";
+        }
+        mic_label->setText(mics);
     }
-    mic_label->setText(mics);
 
 
     const Section *current_section = project->findSection(current_frame);
@@ -4509,13 +4684,12 @@ void WobblyWindow::updateFrameDetails() {
 
     QString custom_lists;
     const CustomListsModel *lists = project->getCustomListsModel();
-    for (size_t i = 0; i < lists->size(); i++) {
-        const FrameRange *range = project->findCustomListRange(i, current_frame);
-        if (range) {
-            if (!custom_lists.isEmpty())
-                custom_lists += "\n";
-            custom_lists += QStringLiteral("%1: [%2,%3]").arg(QString::fromStdString(lists->at(i).name)).arg(range->first).arg(range->last);
-        }
+    auto list_ranges = project->findCustomListRanges(current_frame);
+    for (size_t i = 0; i < list_ranges.size(); i++) {
+        const FrameRange *range = list_ranges[i].second;
+        if (!custom_lists.isEmpty())
+            custom_lists += "\n";
+        custom_lists += QStringLiteral("%1: [%2,%3]").arg(QString::fromStdString(lists->at(list_ranges[i].first).name)).arg(range->first).arg(range->last);
     }
 
     if (custom_lists.isNull())
@@ -4694,6 +4868,8 @@ void WobblyWindow::jumpToPreviousMic() {
     if (!project)
         return;
 
+    project->waitForMetrics();
+
     int frame = project->getPreviousFrameWithMic(mic_search_minimum_spin->value(), current_frame);
     if (frame != -1)
         requestFrames(frame);
@@ -4704,6 +4880,8 @@ void WobblyWindow::jumpToNextMic() {
     if (!project)
         return;
 
+    project->waitForMetrics();
+
     int frame = project->getNextFrameWithMic(mic_search_minimum_spin->value(), current_frame);
     if (frame != -1)
         requestFrames(frame);
@@ -21,6 +21,8 @@ SOFTWARE.
 #ifndef WOBBLYWINDOW_H
 #define WOBBLYWINDOW_H
 
+#include <string>
+#include <thread>
 
 #include <QCheckBox>
 #include <QCloseEvent>
@@ -167,6 +169,8 @@ private:
     QSpinBox *settings_font_spin;
     QCheckBox *settings_compact_projects_check;
     QCheckBox *settings_use_relative_paths_check;
+    QCheckBox *settings_use_columns_file_check;
+    QCheckBox *settings_use_journal_check;
     QComboBox *settings_colormatrix_combo;
     QSpinBox *settings_cache_spin;
     QCheckBox *settings_print_details_check;
@@ -194,6 +198,12 @@ private:
     QString project_path;
     QString video_path;
 
+    // Background saving. The thread writes save_snapshot, a copy of the project, to save_path.
+    std::thread save_thread;
+    WobblyProject *save_snapshot = nullptr;
+    QString save_path;
+    std::string save_error;
+
     int current_frame = 0;
     int pending_frame = 0;
     int pending_requests = 0;
@@ -300,7 +310,8 @@ private:
 
     void realOpenProject(const QString &path);
     void realOpenVideo(const QString &path);
-    void realSaveProject(const QString &path);
+    void realSaveProject(const QString &path, bool in_background = false);
+    std::string finishSave();
     void realSaveScript(const QString &path);
     void realSaveTimecodes(const QString &path);
     void realSaveSections(const QString &path);
@@ -434,6 +445,10 @@ public slots:
     void zoomOut();
 
     void vsLogPopup(int msgType, const QString &msg);
+    void waitForSave();
+    void compactJournal();
+    void journalFailed(const QString &message);
+    void metricsFailed(const QString &message);
     void frameDone(void *framev, int n, bool preview_node, const QString &errorMsg);
 };
 